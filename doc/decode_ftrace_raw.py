@@ -0,0 +1,159 @@
+#!/usr/bin/env python
+#
+# Decode the markers written by rt-app in trace_marker_raw when the global
+# "ftrace_format" is "binary".
+#
+# The kernel stores the first 4 bytes of each write as the id of a raw_data
+# event, the rest is printed as buf, e.g. in tracefs trace or trace_pipe:
+#   task-123 [001] 456.789: # 72746170 buf: 02 00 01 00 00 00 00 00 ...
+# or with "trace-cmd report -R":
+#   task-123 [001] 456.789: raw_data: id=0x72746170 buf=ARRAY[02, 00, ...]
+#
+# Each raw_data event of rt-app is replaced by the text marker that rt-app
+# writes with the "text" ftrace_format, the other lines are kept as they are.
+# The rtapp_event_desc markers give the name of the events and the
+# rtapp_stats_desc ones the name of the perf_events counters.
+#
+# usage: decode_ftrace_raw.py [-b] [trace.txt]
+
+from __future__ import print_function
+
+import argparse
+import re
+import struct
+import sys
+
+RAW_ID = 0x72746170
+
+RAW_EVENT = 1
+RAW_LOOP_START = 2
+RAW_LOOP_END = 3
+RAW_STATS = 4
+RAW_DMISS = 5
+RAW_WAKEUP = 6
+
+# struct ftrace_raw_hdr without its id: type, version, ind, reserved
+HDR = "HHiI"
+
+PAYLOADS = {
+    RAW_EVENT: "iiiI",
+    RAW_LOOP_START: "iiiI",
+    RAW_LOOP_END: "iiiI",
+    RAW_STATS: "qqqqqqqII",
+    RAW_DMISS: "qQiI",
+    RAW_WAKEUP: "qIIiI",
+}
+
+RE_TRACEFS = re.compile(r"# ([0-9a-fA-F]+) buf:((?: [0-9a-fA-F]{2})+)")
+RE_TRACECMD = re.compile(r"raw_data:\s+id=(\S+)\s+buf=ARRAY\[([^\]]*)\]")
+RE_DESC = re.compile(r"rtapp_event_desc: ind=(-?\d+) phase=(\d+) id=(\d+) "
+                     r"type=(\d+) desc=(\S*)")
+RE_STATS_DESC = re.compile(r"rtapp_stats_desc: ind=(-?\d+) pmu=(\S*)")
+
+
+def raw_bytes(match, tracecmd):
+    if tracecmd:
+        vals = [v.strip() for v in match.group(2).split(",") if v.strip()]
+        return bytearray(int(v, 16) for v in vals)
+    return bytearray(int(v, 16) for v in match.group(2).split())
+
+
+def decode(rid, buf, order, desc, counters):
+    hdr_size = struct.calcsize(order + HDR)
+    if rid != RAW_ID or len(buf) < hdr_size:
+        return None
+
+    rtype, version, ind, _ = struct.unpack_from(order + HDR, bytes(buf))
+    if rtype not in PAYLOADS:
+        return None
+
+    fmt = order + PAYLOADS[rtype]
+    if len(buf) < hdr_size + struct.calcsize(fmt):
+        return None
+    f = struct.unpack_from(fmt, bytes(buf), hdr_size)
+
+    if rtype == RAW_EVENT:
+        phase, event, etype = f[0], f[1], f[2]
+        name = desc.get((ind, phase, event), "phase%d:%d" % (phase, event))
+        return "rtapp_event: id=%d type=%d desc=%s" % (event, etype, name)
+
+    if rtype in (RAW_LOOP_START, RAW_LOOP_END):
+        return ("rtapp_loop: event=%s thread_loop=%d phase=%d phase_loop=%d" %
+                ("start" if rtype == RAW_LOOP_START else "end",
+                 f[0], f[1], f[2]))
+
+    if rtype == RAW_STATS:
+        line = ("rtapp_stats: period=%d run=%d wu_lat=%d slack=%d "
+                "c_period=%d c_run=%d ovr=%d" % f[:7])
+        nr_pmu = f[7]
+        names = counters.get(ind, [])
+        off = hdr_size + struct.calcsize(fmt)
+        for i in range(nr_pmu):
+            if len(buf) < off + 8:
+                break
+            name = names[i] if i < len(names) else "pmu%d" % i
+            line += " %s=%d" % (name, struct.unpack_from(order + "Q",
+                                                         bytes(buf), off)[0])
+            off += 8
+        return line
+
+    if rtype == RAW_WAKEUP:
+        return ("rtapp_wakeup: res=%d seq=%d rank=%d lat_ns=%d" %
+                (f[3], f[1], f[2], f[0]))
+
+    return ("rtapp_dmiss: timer=%d overrun=%d consecutive=%d" %
+            (f[2], f[0], f[1]))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Decode the rt-app markers of trace_marker_raw")
+    parser.add_argument("-b", "--big-endian", action="store_true",
+                        help="the trace comes from a big endian machine")
+    parser.add_argument("trace", nargs="?", help="trace file, default stdin")
+    args = parser.parse_args()
+
+    order = ">" if args.big_endian else "<"
+    desc = {}
+    counters = {}
+
+    out = sys.stdout
+    trace = open(args.trace) if args.trace else sys.stdin
+
+    for line in trace:
+        m = RE_DESC.search(line)
+        if m:
+            desc[(int(m.group(1)), int(m.group(2)), int(m.group(3)))] = \
+                m.group(5)
+            out.write(line)
+            continue
+
+        m = RE_STATS_DESC.search(line)
+        if m:
+            counters[int(m.group(1))] = [n for n in m.group(2).split(",") if n]
+            out.write(line)
+            continue
+
+        tracecmd = False
+        m = RE_TRACEFS.search(line)
+        if not m:
+            m = RE_TRACECMD.search(line)
+            tracecmd = True
+        if not m:
+            out.write(line)
+            continue
+
+        text = decode(int(m.group(1), 16), raw_bytes(m, tracecmd), order,
+                      desc, counters)
+        if text is None:
+            out.write(line)
+            continue
+
+        out.write(line[:m.start()] + text + line[m.end():])
+
+    if trace is not sys.stdin:
+        trace.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,477 @@
+#!/usr/bin/env python
+#
+# Generate a rt-app use case from a scheduler trace.
+#
+# The trace is the text output of "trace-cmd report" or "perf sched script"
+# with the sched_switch and sched_wakeup (or better sched_waking) events:
+#   trace-cmd record -e sched_switch -e sched_waking -e sched_wakeup_new ...
+#   trace-cmd report > trace.txt
+# or
+#   perf sched record ...
+#   perf sched script > trace.txt
+#
+# Each thread is cut in activations: from its wakeup to the time it blocks.
+# The cpu time of an activation gives a "run" event. Then the activations are
+# matched to a pattern:
+# - woken up by another thread: most of the activations have been woken up by
+#   the same thread, the thread waits a semaphore ("sem_wait") that the other
+#   one posts ("sem_post") at the same point of its own activation, the
+#   semaphore keeps the posts done before the wait. When the threads wake
+#   each other up in a cycle, like the 2 sides of a request/response, the
+#   first one of the cycle to run in the trace posts before waiting so that
+#   the cycle starts,
+# - periodic: the activations start at a regular interval, the thread uses a
+#   "timer" event,
+# - otherwise the thread "sleep"s for the median time between 2 activations.
+# Independent threads with the same name, once the trailing number removed,
+# and the same behavior are merged into one task with several "instance"s.
+#
+# The durations are the median of the activations, in usec of the CPU of the
+# trace: the use case is calibrated on the CPU on which the threads ran the
+# most in the trace, or with the -C option, e.g. the ns per loop measured on
+# the traced machine.
+#
+# usage: trace2json.py [-o out.json] [-C calibration] [options] [trace.txt]
+
+from __future__ import division, print_function
+
+import argparse
+import collections
+import json
+import math
+import re
+import sys
+
+RE_HDR = re.compile(r"^\s*(?P<comm>.+?)[- ](?P<pid>\d+)\s+"
+                    r"(?:\(\s*[\d-]+\)\s+)?\[(?P<cpu>\d+)\]\s+"
+                    r"(?:(?P<flags>[^\s:]+)\s+)?(?P<ts>\d+\.\d+):\s+"
+                    r"(?:\w+:)?(?P<event>sched_switch|sched_wakeup_new|"
+                    r"sched_wakeup|sched_waking):\s*(?P<args>.*)$")
+
+RE_SWITCH = re.compile(r"prev_comm=(?P<pcomm>.*?) prev_pid=(?P<ppid>\d+) "
+                       r"prev_prio=(?P<pprio>-?\d+) prev_state=(?P<pstate>\S+)"
+                       r" ==> next_comm=(?P<ncomm>.*?) next_pid=(?P<npid>\d+)"
+                       r" next_prio=(?P<nprio>-?\d+)")
+RE_SWITCH_OLD = re.compile(r"(?P<pcomm>.*?):(?P<ppid>\d+) \[(?P<pprio>-?\d+)\]"
+                           r" (?P<pstate>\S+) ==> (?P<ncomm>.*?):(?P<npid>\d+)"
+                           r" \[(?P<nprio>-?\d+)\]")
+RE_WAKEUP = re.compile(r"comm=(?P<comm>.*?) pid=(?P<pid>\d+) "
+                       r"prio=(?P<prio>-?\d+)")
+RE_WAKEUP_OLD = re.compile(r"(?P<comm>.*?):(?P<pid>\d+) \[(?P<prio>-?\d+)\]")
+
+# Kernel priorities below this one are RT priorities
+MAX_RT_PRIO = 100
+DEFAULT_PRIO = 120
+
+
+class Event(object):
+    def __init__(self, ts, cpu, pid, irq, name, args):
+        self.ts = ts
+        self.cpu = cpu
+        self.pid = pid
+        self.irq = irq
+        self.name = name
+        self.args = args
+
+
+class Activation(object):
+    def __init__(self, wake, waker, start):
+        self.wake = wake        # wakeup time, None if unknown
+        self.waker = waker      # pid which woke us up, None for irq/idle
+        self.start = start      # first time on a CPU
+        self.cpu = 0.0          # cpu time
+        self.block = None       # time the thread blocked
+        self.wakees = []        # (cpu time, pid) of the threads woken up
+
+
+class Thread(object):
+    def __init__(self, pid, comm, prio):
+        self.pid = pid
+        self.comm = comm
+        self.prio = prio
+        self.running_since = None
+        self.act = None
+        self.wakeup = None      # pending (time, waker)
+        self.cpu_time = collections.Counter()   # run time on each CPU
+        self.acts = []
+        self.seen = False       # first activation is partial
+
+    def switch_in(self, ts):
+        self.running_since = ts
+        if self.act is None:
+            wake, waker = self.wakeup if self.wakeup else (None, None)
+            self.act = Activation(wake, waker, ts)
+            self.act.partial = not self.seen
+            self.seen = True
+            self.wakeup = None
+
+    def cpu_now(self, ts):
+        if self.act is None:
+            return 0.0
+        cpu = self.act.cpu
+        if self.running_since is not None:
+            cpu += ts - self.running_since
+        return cpu
+
+    def switch_out(self, ts, cpu, blocked):
+        if self.act is None or self.running_since is None:
+            self.running_since = None
+            self.seen = True
+            return
+        self.act.cpu += ts - self.running_since
+        self.cpu_time[cpu] += ts - self.running_since
+        self.running_since = None
+        if blocked:
+            self.act.block = ts
+            if not self.act.partial:
+                self.acts.append(self.act)
+            self.act = None
+
+
+def parse_trace(trace):
+    events = []
+    for line in trace:
+        m = RE_HDR.match(line)
+        if not m:
+            continue
+        flags = m.group("flags") or ""
+        # latency format of ftrace: irqs-off, need-resched, hardirq/softirq
+        irq = len(flags) >= 3 and flags[2] in "hHsz"
+        events.append(Event(float(m.group("ts")), int(m.group("cpu")),
+                            int(m.group("pid")), irq, m.group("event"),
+                            m.group("args")))
+    return events
+
+
+def build_threads(events):
+    threads = {}
+    has_waking = any(e.name == "sched_waking" for e in events)
+
+    def thread(pid, comm, prio):
+        t = threads.get(pid)
+        if t is None:
+            t = threads[pid] = Thread(pid, comm, prio)
+        t.comm = comm
+        t.prio = prio
+        return t
+
+    for e in events:
+        if e.name == "sched_switch":
+            m = RE_SWITCH.search(e.args) or RE_SWITCH_OLD.search(e.args)
+            if not m:
+                continue
+            ppid, npid = int(m.group("ppid")), int(m.group("npid"))
+            if ppid:
+                prev = thread(ppid, m.group("pcomm"), int(m.group("pprio")))
+                # R or R+ is a preemption, other states block the thread
+                prev.switch_out(e.ts, e.cpu,
+                                not m.group("pstate").startswith("R"))
+            if npid:
+                thread(npid, m.group("ncomm"),
+                       int(m.group("nprio"))).switch_in(e.ts)
+            continue
+
+        # sched_wakeup can run on the CPU of the wakee, prefer sched_waking
+        if e.name == "sched_wakeup" and has_waking:
+            continue
+        m = RE_WAKEUP.search(e.args) or RE_WAKEUP_OLD.search(e.args)
+        if not m:
+            continue
+        pid = int(m.group("pid"))
+        if not pid:
+            continue
+        wakee = thread(pid, m.group("comm"), int(m.group("prio")))
+        if wakee.act is not None or wakee.wakeup is not None:
+            continue
+
+        waker = None
+        if e.pid and not e.irq and e.name != "sched_wakeup_new":
+            waker = e.pid
+            w = threads.get(e.pid)
+            if w is not None and w.act is not None:
+                w.act.wakees.append((w.cpu_now(e.ts), pid))
+        wakee.wakeup = (e.ts, waker)
+
+    return threads
+
+
+def median(values):
+    values = sorted(values)
+    n = len(values)
+    if not n:
+        return 0
+    if n % 2:
+        return values[n // 2]
+    return (values[n // 2 - 1] + values[n // 2]) / 2
+
+
+def usec(sec):
+    return int(round(sec * 1e6))
+
+
+def close(a, b, tolerance):
+    return abs(a - b) <= tolerance * max(abs(a), abs(b))
+
+
+class Pattern(object):
+    """Behavior of a thread derived from its activations"""
+
+    def __init__(self, t, tolerance):
+        self.thread = t
+        self.run = median([a.cpu for a in t.acts])
+        self.period = None
+        self.sleep = None
+        self.waker = None
+        self.post_first = False     # starts a cycle of wakeups
+        self.posts = []         # (cpu offset, wakee pattern)
+        self.start = t.acts[0].wake or t.acts[0].start
+
+        starts = [a.wake or a.start for a in t.acts]
+        intervals = [b - a for a, b in zip(starts, starts[1:])]
+        med = median(intervals)
+        if med > 0:
+            dev = median([abs(i - med) for i in intervals])
+            if dev <= tolerance * med:
+                self.period = med
+
+        wakers = collections.Counter(a.waker for a in t.acts)
+        pid, count = wakers.most_common(1)[0]
+        if pid is not None and pid != t.pid and 2 * count >= len(t.acts):
+            self.waker = pid
+
+        sleeps = [b.start - a.block for a, b in zip(t.acts, t.acts[1:])]
+        self.sleep = median(sleeps)
+
+    def kind(self):
+        if self.waker:
+            return "wait"
+        if self.period:
+            return "timer"
+        return "sleep"
+
+
+def base_name(comm):
+    name = re.sub(r"[^A-Za-z0-9_-]", "_", comm)
+    return re.sub(r"[-_:/]?\d+$", "", name) or name
+
+
+def task_name(comm):
+    return re.sub(r"[^A-Za-z0-9_-]", "_", comm) or "task"
+
+
+def sched_params(prio):
+    task = collections.OrderedDict()
+    if 0 <= prio < MAX_RT_PRIO:
+        task["policy"] = "SCHED_FIFO"
+        task["priority"] = MAX_RT_PRIO - 1 - prio
+    elif prio >= MAX_RT_PRIO and prio != DEFAULT_PRIO:
+        task["policy"] = "SCHED_OTHER"
+        task["priority"] = prio - DEFAULT_PRIO
+    return task
+
+
+class Phase(object):
+    """Events of a thread, with unique keys as required by json"""
+
+    def __init__(self):
+        self.events = collections.OrderedDict()
+
+    def add(self, key, value):
+        name, i = key, 0
+        while name in self.events:
+            i += 1
+            name = "%s%d" % (key, i)
+        self.events[name] = value
+
+
+def add_wait(phase, p):
+    phase.add("sem_wait", p.sem)
+
+
+def calibration(patterns, value):
+    """-C value, a CPU or ns per loop, or the CPU which ran the threads"""
+    if value is not None:
+        return int(value) if value.isdigit() else value
+    cpu_time = collections.Counter()
+    for p in patterns:
+        cpu_time.update(p.thread.cpu_time)
+    if not cpu_time:
+        return "CPU0"
+    return "CPU%d" % cpu_time.most_common(1)[0][0]
+
+
+def generate(patterns, t_start, args):
+    tasks = collections.OrderedDict()
+    names = {}
+
+    # one semaphore per wakee, posted at the median offset in the waker
+    by_pid = dict((p.thread.pid, p) for p in patterns)
+    for p in patterns:
+        if p.kind() != "wait" or p.waker not in by_pid:
+            p.waker = None
+            continue
+        waker = by_pid[p.waker]
+        offsets = [cpu for a in waker.thread.acts
+                   for cpu, pid in a.wakees if pid == p.thread.pid]
+        waker.posts.append((median(offsets), p))
+
+    # in a cycle of waits, everybody would wait for the previous one forever
+    done = set()
+    for p in patterns:
+        path = []
+        while p.waker and p.thread.pid not in done:
+            done.add(p.thread.pid)
+            path.append(p)
+            p = by_pid[p.waker]
+        if p in path:
+            cycle = path[path.index(p):]
+            min(cycle, key=lambda q: q.start).post_first = True
+
+    # merge the independent threads which behave the same
+    groups = []
+    for p in patterns:
+        if p.kind() != "wait" and not p.posts:
+            for g in groups:
+                q = g[0]
+                if (base_name(q.thread.comm) == base_name(p.thread.comm) and
+                        q.kind() == p.kind() and
+                        q.thread.prio == p.thread.prio and
+                        close(q.run, p.run, args.tolerance) and
+                        close(q.period or q.sleep, p.period or p.sleep,
+                              args.tolerance)):
+                    g.append(p)
+                    break
+            else:
+                groups.append([p])
+        else:
+            groups.append([p])
+
+    for g in groups:
+        p = g[0]
+        name = base_name(p.thread.comm) if len(g) > 1 \
+            else task_name(p.thread.comm)
+        if name in names:
+            name = "%s-%d" % (name, p.thread.pid)
+        names[name] = True
+        p.name = name
+
+    for p in patterns:
+        if p.waker:
+            p.sem = "%s_wakeup" % p.name
+
+    for g in groups:
+        p = g[0]
+        task = collections.OrderedDict()
+        if len(g) > 1:
+            task["instance"] = len(g)
+        task.update(sched_params(p.thread.prio))
+        task["loop"] = -1
+        delay = usec(min(q.start for q in g) - t_start)
+        if p.kind() == "timer" and delay > 0:
+            task["delay"] = delay
+
+        phase = Phase()
+        if p.kind() == "wait" and not p.post_first:
+            add_wait(phase, p)
+
+        run = median([q.run for q in g])
+        done = 0
+        for offset, wakee in sorted(p.posts, key=lambda s: s[0]):
+            offset = min(offset, run)
+            if usec(offset - done) > 0:
+                phase.add("run", usec(offset - done))
+            done = offset
+            phase.add("sem_post", wakee.sem)
+        if usec(run - done) > 0 or not p.posts:
+            phase.add("run", max(usec(run - done), 1))
+        if p.kind() == "wait" and p.post_first:
+            add_wait(phase, p)
+
+        if p.kind() == "timer":
+            phase.add("timer", collections.OrderedDict(
+                [("ref", "unique"),
+                 ("period", usec(median([q.period for q in g])))]))
+        elif p.kind() == "sleep" and usec(p.sleep) > 0:
+            phase.add("sleep", usec(median([q.sleep for q in g])))
+
+        task.update(phase.events)
+        tasks[p.name] = task
+
+    return tasks
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Generate a rt-app use case from a trace-cmd report or "
+                    "perf sched script output")
+    parser.add_argument("trace", nargs="?", help="trace file, default stdin")
+    parser.add_argument("-o", "--output", help="json file, default stdout")
+    parser.add_argument("-p", "--pid", type=int, action="append",
+                        help="only keep this pid, can be repeated")
+    parser.add_argument("-c", "--comm",
+                        help="only keep the threads whose name matches this "
+                             "regular expression")
+    parser.add_argument("-m", "--min-activations", type=int, default=3,
+                        help="ignore the threads with fewer activations, "
+                             "default 3")
+    parser.add_argument("-t", "--tolerance", type=float, default=0.1,
+                        help="relative dispersion of a period and between "
+                             "the instances of a task, default 0.1")
+    parser.add_argument("-C", "--calibration",
+                        help="calibration of the use case, a CPU (e.g. "
+                             "CPU2) or the ns per loop of the traced CPU, "
+                             "default the CPU which ran the threads the most")
+    parser.add_argument("-d", "--duration", type=int,
+                        help="duration of the use case in sec, default the "
+                             "length of the trace")
+    args = parser.parse_args()
+
+    trace = open(args.trace) if args.trace else sys.stdin
+    events = parse_trace(trace)
+    if trace is not sys.stdin:
+        trace.close()
+
+    if not events:
+        sys.exit("no sched_switch nor sched_wakeup event in the trace")
+
+    threads = build_threads(events)
+    comm = re.compile(args.comm) if args.comm else None
+
+    patterns = []
+    for pid in sorted(threads):
+        t = threads[pid]
+        if args.pid and pid not in args.pid:
+            continue
+        if comm and not comm.search(t.comm):
+            continue
+        if len(t.acts) < args.min_activations:
+            continue
+        patterns.append(Pattern(t, args.tolerance))
+
+    if not patterns:
+        sys.exit("no thread with at least %d activations" %
+                 args.min_activations)
+
+    t_start, t_end = events[0].ts, events[-1].ts
+    duration = args.duration
+    if duration is None:
+        duration = max(int(math.ceil(t_end - t_start)), 1)
+
+    doc = collections.OrderedDict()
+    doc["global"] = collections.OrderedDict([
+        ("duration", duration),
+        ("default_policy", "SCHED_OTHER"),
+        ("calibration", calibration(patterns, args.calibration)),
+        ("logdir", "./"),
+    ])
+    doc["tasks"] = generate(patterns, t_start, args)
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    json.dump(doc, out, indent=4, separators=(",", " : "))
+    out.write("\n")
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,240 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+ * rt-app-bench: micro-benchmarks of rt-app internals.
+ *
+ * "dispatch" measures the overhead of executing an event, excluding the work
+ * done by the event itself, with the compiled phase programs used by rt-app
+ * and with the legacy interpreter that looked up resources and switched on
+ * the event type for each event.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "rt-app_utils.h"
+#include "rt-app_program.h"
+
+#define DEFAULT_NB_EVENTS	32
+#define DEFAULT_NB_LOOPS	100000
+
+static volatile sig_atomic_t running = 1;
+/* keeps the result of the benchmarked loops alive */
+static volatile unsigned long sink;
+
+/*
+ * All the benchmarked variants do the same work per event so that the
+ * difference only comes from the dispatch.
+ */
+static int bench_handler(const event_op_t *op, event_ctx_t *ctx)
+{
+	ctx->perf += op->duration;
+	return 0;
+}
+
+/* Mimics the former run_event(): double switch and resources lookup */
+static int __attribute__((noinline))
+legacy_run_event(event_data_t *event, int dry_run, unsigned long *perf,
+		 rtapp_resources_t **global_resources)
+{
+	rtapp_resources_t *table_resources = *global_resources;
+	rtapp_resource_t *rdata = &(table_resources->resources[event->res]);
+	rtapp_resource_t *ddata = &(table_resources->resources[event->dep]);
+	int lock = 0;
+
+	switch (event->type) {
+	case rtapp_lock:
+		lock = 1;
+		break;
+	case rtapp_unlock:
+		lock = -1;
+		break;
+	default:
+		break;
+	}
+
+	if (dry_run)
+		return lock;
+
+	switch (event->type) {
+	case rtapp_run:
+		log_debug("run %d %s %s", event->duration, rdata->name, ddata->name);
+		*perf += event->duration;
+		break;
+	default:
+		break;
+	}
+
+	return lock;
+}
+
+static unsigned long legacy_run(event_data_t *events, int nbevents,
+				rtapp_resources_t **global_resources)
+{
+	unsigned long perf = 0;
+	int i, lock = 0;
+
+	for (i = 0; i < nbevents; i++) {
+		if (!running && !lock)
+			return perf;
+
+		log_debug("runs events %d type %d ", i, events[i].type);
+		log_ftrace(-1, FTRACE_EVENT,
+			   "rtapp_event: id=%d type=%d desc=%s",
+			   i, events[i].type, events[i].name);
+		lock += legacy_run_event(&events[i], !running, &perf,
+					 global_resources);
+	}
+
+	return perf;
+}
+
+static void __attribute__((noinline))
+run_prog_fast(const phase_prog_t *prog, event_ctx_t *ctx)
+{
+	prog_run(prog, ctx, &running, 0);
+}
+
+static void __attribute__((noinline))
+run_prog_traced(const phase_prog_t *prog, event_ctx_t *ctx)
+{
+	prog_run(prog, ctx, &running, 1);
+}
+
+static double elapsed_ns(struct timespec *start)
+{
+	struct timespec stop;
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	return (double)timespec_sub_to_ns(&stop, start);
+}
+
+static void bench_dispatch(int nbevents, int nloops)
+{
+	rtapp_resources_t *resources;
+	event_data_t *events;
+	phase_prog_t prog;
+	event_ctx_t ctx = { .marker_fd = -1, .raw_fd = -1 };
+	struct timespec start;
+	unsigned long check = 0;
+	double fast, traced, legacy;
+	int i;
+
+	resources = calloc(1, sizeof(rtapp_resources_t) + sizeof(rtapp_resource_t));
+	events = calloc(nbevents, sizeof(event_data_t));
+	prog.ops = calloc(nbevents, sizeof(event_op_t));
+	if (!resources || !events || !prog.ops) {
+		log_error("Cannot allocate benchmark data");
+		exit(EXIT_FAILURE);
+	}
+
+	resources->nresources = 1;
+	resources->resources[0].name = "bench";
+
+	for (i = 0; i < nbevents; i++) {
+		snprintf(events[i].name, sizeof(events[i].name), "run%d", i);
+		events[i].type = rtapp_run;
+		events[i].duration = 1;
+		prog.ops[i].handler = bench_handler;
+		prog.ops[i].rdata = &resources->resources[0];
+		prog.ops[i].duration = 1;
+	}
+	prog.events = events;
+	prog.markers = NULL;
+	prog.nbevents = nbevents;
+	prog.phase = 0;
+
+	/* warm up caches and branch predictors */
+	for (i = 0; i < nloops / 10; i++) {
+		run_prog_fast(&prog, &ctx);
+		check += legacy_run(events, nbevents, &resources);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nloops; i++)
+		run_prog_fast(&prog, &ctx);
+	fast = elapsed_ns(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nloops; i++)
+		run_prog_traced(&prog, &ctx);
+	traced = elapsed_ns(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nloops; i++)
+		check += legacy_run(events, nbevents, &resources);
+	legacy = elapsed_ns(&start);
+
+	sink = ctx.perf + check;
+
+	printf("dispatch: %d events x %d loops\n", nbevents, nloops);
+	printf("  %-28s %8.2f ns/event\n", "compiled program",
+	       fast / ((double)nbevents * nloops));
+	printf("  %-28s %8.2f ns/event\n", "compiled program, traced",
+	       traced / ((double)nbevents * nloops));
+	printf("  %-28s %8.2f ns/event\n", "legacy interpreter",
+	       legacy / ((double)nbevents * nloops));
+
+	free(prog.ops);
+	free(events);
+	free(resources);
+}
+
+static void usage(void)
+{
+	printf("Usage: rt-app-bench [-n <events>] [-l <loops>] [dispatch]\n");
+	exit(EXIT_INV_COMMANDLINE);
+}
+
+int main(int argc, char *argv[])
+{
+	int nbevents = DEFAULT_NB_EVENTS;
+	int nloops = DEFAULT_NB_LOOPS;
+	int c;
+
+	while ((c = getopt(argc, argv, "hn:l:")) != -1) {
+		switch (c) {
+		case 'n':
+			nbevents = atoi(optarg);
+			break;
+		case 'l':
+			nloops = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (nbevents <= 0 || nloops <= 0)
+		usage();
+
+	if (optind < argc && strcmp(argv[optind], "dispatch"))
+		usage();
+
+	bench_dispatch(nbevents, nloops);
+
+	return EXIT_SUCCESS;
+}
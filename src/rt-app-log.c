@@ -0,0 +1,245 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+/*
+ * rt-app-log: convert the binary logs of rt-app (log_format "binary") into
+ * the text log format of rt-app, CSV or JSON.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rt-app_binlog.h"
+
+enum output_format {
+	FORMAT_TEXT,
+	FORMAT_CSV,
+	FORMAT_JSON,
+};
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: rt-app-log [-f text|csv|json] <log.rtlog>...\n");
+	exit(EXIT_FAILURE);
+}
+
+static void print_value(const binlog_column_t *col, uint64_t val, int width)
+{
+	if (col->type == BINLOG_S64)
+		printf("%*lld", width, (long long)val);
+	else
+		printf("%*llu", width, (unsigned long long)val);
+}
+
+static void print_header(const binlog_header_t *hdr, enum output_format format)
+{
+	char name[BINLOG_NAME_LENGTH + 1];
+	uint32_t i;
+
+	for (i = 0; i < hdr->nr_columns; i++) {
+		const binlog_column_t *col = &hdr->columns[i];
+
+		switch (format) {
+		case FORMAT_TEXT:
+			if (!i) {
+				snprintf(name, sizeof(name), "#%s", col->name);
+				printf("%s", name);
+			} else {
+				printf(" %*s", col->width, col->name);
+			}
+			break;
+		case FORMAT_CSV:
+			printf("%s%s", i ? "," : "", col->name);
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (format != FORMAT_JSON)
+		printf("\n");
+}
+
+static void print_record(const binlog_header_t *hdr, const uint64_t *rec,
+			 enum output_format format, int first)
+{
+	uint32_t i;
+
+	if (format == FORMAT_JSON)
+		printf("%s\n\t\t{", first ? "" : ",");
+
+	for (i = 0; i < hdr->nr_columns; i++) {
+		const binlog_column_t *col = &hdr->columns[i];
+
+		switch (format) {
+		case FORMAT_TEXT:
+			if (i)
+				printf(" ");
+			print_value(col, rec[i], col->width);
+			break;
+		case FORMAT_CSV:
+			if (i)
+				printf(",");
+			print_value(col, rec[i], 0);
+			break;
+		case FORMAT_JSON:
+			printf("%s\"%s\": ", i ? ", " : "", col->name);
+			print_value(col, rec[i], 0);
+			break;
+		}
+	}
+
+	printf(format == FORMAT_JSON ? "}" : "\n");
+}
+
+static int check_header(const char *path, const binlog_header_t *hdr, size_t size)
+{
+	if (size < sizeof(*hdr) ||
+	    memcmp(hdr->magic, BINLOG_MAGIC, sizeof(hdr->magic))) {
+		fprintf(stderr, "%s: not an rt-app binary log\n", path);
+		return -1;
+	}
+
+	if (hdr->version != BINLOG_VERSION) {
+		fprintf(stderr, "%s: unsupported version %u\n", path, hdr->version);
+		return -1;
+	}
+
+	if (hdr->header_size > size || hdr->nr_columns > BINLOG_MAX_COLUMNS ||
+	    hdr->record_size != hdr->nr_columns * sizeof(uint64_t) ||
+	    hdr->chunk_size < hdr->record_size) {
+		fprintf(stderr, "%s: corrupted header\n", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int convert(const char *path, enum output_format format, int first_file)
+{
+	const binlog_header_t *hdr;
+	struct stat st;
+	uint64_t i, first, count;
+	char *map;
+	int fd, ret = -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		goto close_fd;
+	}
+
+	hdr = (const binlog_header_t *)map;
+	if (check_header(path, hdr, st.st_size))
+		goto unmap;
+
+	/* The oldest records of a ring have been overwritten */
+	first = 0;
+	count = hdr->nr_records;
+	if (hdr->capacity && count > hdr->capacity) {
+		first = count - hdr->capacity;
+		count = hdr->capacity;
+		fprintf(stderr, "%s: %llu oldest records lost in the ring\n",
+			path, (unsigned long long)first);
+	}
+
+	/* A log of a killed rt-app can be shorter than nr_records */
+	while (count && binlog_slot_offset(hdr, hdr->capacity ?
+			(first + count - 1) % hdr->capacity : first + count - 1) +
+			hdr->record_size > (uint64_t)st.st_size)
+		count--;
+
+	if (format == FORMAT_JSON)
+		printf("%s{\n\t\"task\": \"%s\",\n\t\"ind\": %d,\n\t\"records\": [",
+		       first_file ? "" : ",\n", hdr->task, hdr->ind);
+	else
+		print_header(hdr, format);
+
+	for (i = first; i < first + count; i++) {
+		uint64_t slot = hdr->capacity ? i % hdr->capacity : i;
+
+		print_record(hdr, (const uint64_t *)(map + binlog_slot_offset(hdr, slot)),
+			     format, i == first);
+	}
+
+	if (format == FORMAT_JSON)
+		printf("\n\t]\n}");
+
+	ret = 0;
+unmap:
+	munmap(map, st.st_size);
+close_fd:
+	close(fd);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	enum output_format format = FORMAT_TEXT;
+	int c, i, ret = EXIT_SUCCESS;
+
+	while ((c = getopt(argc, argv, "hf:")) != -1) {
+		switch (c) {
+		case 'f':
+			if (!strcmp(optarg, "text"))
+				format = FORMAT_TEXT;
+			else if (!strcmp(optarg, "csv"))
+				format = FORMAT_CSV;
+			else if (!strcmp(optarg, "json"))
+				format = FORMAT_JSON;
+			else
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind >= argc)
+		usage();
+
+	/* Several logs in JSON are gathered in an array */
+	if (format == FORMAT_JSON && argc - optind > 1)
+		printf("[\n");
+
+	for (i = optind; i < argc; i++)
+		if (convert(argv[i], format, i == optind))
+			ret = EXIT_FAILURE;
+
+	if (format == FORMAT_JSON)
+		printf(argc - optind > 1 ? "\n]\n" : "\n");
+
+	return ret;
+}
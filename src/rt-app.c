@@ -33,6 +33,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/mman.h>  /* for memlock */
+#include <sys/prctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -42,34 +43,97 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "rt-app_utils.h"
 #include "rt-app_args.h"
 #include "rt-app_taskgroups.h"
+#include "rt-app_program.h"
+#include "rt-app_calib.h"
+#include "rt-app_clock.h"
+#include "rt-app_pmu.h"
+#include "rt-app_binlog.h"
+#include "rt-app_logger.h"
+#include "rt-app_hist.h"
+#include "rt-app_ftrace.h"
+#include "rt-app_timeline.h"
+#include "rt-app_pages.h"
+#include "rt-app_timer.h"
+#include "rt-app_sync.h"
+#include "rt-app_queue.h"
+#include "rt-app_stream.h"
+#include "rt-app_chase.h"
+#include "rt-app_mem.h"
+#include "rt-app_numa.h"
 
 /*
- * To prevent infinite loops in fork bombs, we will limit the number of
- * permissible forks before we exit on error.
- *
- * This limit is per forking task/thread NOT the aggregated number of forks.
+ * Registry of the threads. It grows by chunks which never move, so a fork
+ * doesn't have to copy it and a slot below running_threads can be read
+ * without holding fork_mutex.
  */
-#define FORKS_LIMIT		1024
+#define THREAD_CHUNK_SHIFT	8
+#define THREAD_CHUNK_SIZE	(1 << THREAD_CHUNK_SHIFT)
+#define THREAD_CHUNKS		4096
+
+/* Tasks created by the main thread only, below that number of threads */
+#define STARTUP_PARALLEL_MIN	256
+#define STARTUP_THREADS_MAX	16
 
 static volatile sig_atomic_t continue_running;
-static pthread_data_t *threads;
+static volatile sig_atomic_t stop_loops; /* graceful stop: end at next loop */
+static int threads_looping; /* threads running their phases */
+static pthread_data_t *thread_chunks[THREAD_CHUNKS];
 static int nthreads;
 static volatile sig_atomic_t running_threads;
-static int p_load;
+static volatile sig_atomic_t exit_status = EXIT_SUCCESS;
+static __thread thread_data_t *self_data;
 rtapp_options_t opts;
 static struct timespec t_zero;
 static struct timespec t_start;
 static pthread_barrier_t threads_barrier;
 static pthread_mutex_t joining_mutex;
 static pthread_mutex_t fork_mutex;
+static FILE *log_sink; /* text log of all the threads with log_shared */
+static int pages_locked;
 
 static ftrace_data_t ft_data = {
 	.tracefs = TRACEFS_PATH,
 	.marker_fd = -1,
+	.raw_fd = -1,
 };
 
 void *thread_body(void *arg);
 void setup_thread_logging(thread_data_t *tdata);
+static int thread_data_compile_phases(thread_data_t *tdata);
+static int thread_data_share_phases(thread_data_t *td);
+
+static inline pthread_data_t *thread_slot(int index)
+{
+	return &thread_chunks[index >> THREAD_CHUNK_SHIFT]
+			     [index & (THREAD_CHUNK_SIZE - 1)];
+}
+
+/*
+ * Reserve the slot of a new thread and return its index, or -1. The caller
+ * holds fork_mutex unless no thread has been created yet.
+ */
+static int thread_reserve(void)
+{
+	int index = nthreads;
+	int chunk = index >> THREAD_CHUNK_SHIFT;
+
+	if (chunk >= THREAD_CHUNKS) {
+		log_error("Too many threads: %d", index);
+		return -1;
+	}
+
+	if (!thread_chunks[chunk]) {
+		thread_chunks[chunk] = calloc(THREAD_CHUNK_SIZE,
+					      sizeof(pthread_data_t));
+		if (!thread_chunks[chunk]) {
+			log_error("Cannot allocate threads");
+			return -1;
+		}
+	}
+
+	nthreads++;
+	return index;
+}
 
 static thread_data_t *find_thread_data(const char *name, rtapp_options_t *opts)
 {
@@ -142,18 +206,21 @@ static int thread_data_create_unique_resources(thread_data_t *tdata, const threa
  *
  * @index:	Index of the task to create.
  *
- * @forked:	Whether this task is a craeted from fork event or at
- *		application startup.
+ * @fork:	The fork event which creates this task, or NULL if it is
+ *		created at application startup.
  *
  * @nforks:	If this is a forked task, we use nforks to give it a unique name.
  *
+ * @fork_ts:	Time of the fork event in ns, or 0 to park the task in the
+ *		pool of @fork until a fork event wakes it up.
+ *
  * Returns 0 on success or -1 on failure.
  */
-static int create_thread(const thread_data_t *td, int index, int forked, int nforks)
+static int create_thread(thread_data_t *td, int index,
+			 rtapp_resource_t *fork, int nforks, __u64 fork_ts)
 {
 	thread_data_t *tdata;
 	pthread_attr_t attr;
-	sigset_t sigset;
 	int ret = 0;
 
 	if (!td) {
@@ -161,6 +228,13 @@ static int create_thread(const thread_data_t *td, int index, int forked, int nfo
 		return -1;
 	}
 
+	/*
+	 * Without resources of their own, the threads of a task only read its
+	 * program and resources: compile them once for all of them.
+	 */
+	if (!td->local_resources->nresources && thread_data_share_phases(td))
+		return -1;
+
 	tdata = malloc(sizeof(thread_data_t));
 	if (!tdata) {
 		log_error("Failed to duplicate thread data: %s", td->name);
@@ -177,31 +251,47 @@ static int create_thread(const thread_data_t *td, int index, int forked, int nfo
 	memcpy(tdata, td, sizeof(*tdata));
 
 	/* Mark this thread as forked */
-	tdata->forked = forked;
+	tdata->forked = (fork != NULL);
+	tdata->fork_res = fork;
+	tdata->fork_pooled = fork && !fork_ts;
+	tdata->fork_ts = fork_ts;
+	memset(&tdata->dmiss, 0, sizeof(tdata->dmiss));
+	tdata->minflt = tdata->majflt = 0;
+	tdata->start_skew = -1;
+	timer_waiter_init(&tdata->timer_waiter);
+	tdata->dl_overruns = 0;
 	/* update the index value */
 	tdata->ind = index;
 
 	/* Make sure each (forked) thread has a unique name */
 	thread_data_set_unique_name(tdata, nforks);
 
-	/* Make sure each (forked) thread has its own unique resources */
-	if(thread_data_create_unique_resources(tdata, td))
-		return -1;
+	if (!tdata->progs_shared) {
+		/* Make sure each (forked) thread has its own unique resources */
+		if(thread_data_create_unique_resources(tdata, td))
+			return -1;
+
+		/* Resolve the events of each phase against the thread's resources */
+		if (thread_data_compile_phases(tdata))
+			return -1;
+	}
 
 	setup_thread_logging(tdata);
 
 	/* save a pointer to thread's data */
-	threads[index].data = tdata;
+	thread_slot(index)->data = tdata;
 
 	pthread_attr_init(&attr);
-	sigemptyset(&sigset);
-	sigaddset(&sigset, SIGQUIT);
-	sigaddset(&sigset, SIGTERM);
-	sigaddset(&sigset, SIGHUP);
-	sigaddset(&sigset, SIGINT);
-	pthread_attr_setsigmask_np(&attr, &sigset);
-
-	if (pthread_create(&threads[index].thread, &attr, thread_body, (void*) tdata)) {
+	thread_attr_block_signals(&attr);
+	if (tdata->stack_size &&
+	    pthread_attr_setstacksize(&attr, tdata->stack_size)) {
+		log_error("Invalid stack_size %zu of %s", tdata->stack_size,
+			  tdata->name);
+		pthread_attr_destroy(&attr);
+		return -1;
+	}
+
+	if (pthread_create(&thread_slot(index)->thread, &attr, thread_body, (void*) tdata)) {
 		perror("Failed to create a thread");
 		ret = -1;
 	}
@@ -212,138 +302,28 @@ static int create_thread(const thread_data_t *td, int index, int forked, int nfo
 }
 
 /*
- * Function: to do some useless operation.
- * TODO: improve the waste loop with more heavy functions
+ * @cpu:	CPU the thread is pinned to, or -1 to use the current one when the
+ *		ns per loop differs between CPUs.
+ * @kernel:	burn kernel to execute
  */
-void waste_cpu_cycles(unsigned long long load_loops)
-{
-	double param, result;
-	double n;
-	unsigned long long i;
-
-	param = 0.95;
-	n = 4;
-	for (i = 0 ; i < load_loops ; i++) {
-		result = ldexp(param , (ldexp(param , ldexp(param , n))));
-		result = ldexp(param , (ldexp(param , ldexp(param , n))));
-		result = ldexp(param , (ldexp(param , ldexp(param , n))));
-		result = ldexp(param , (ldexp(param , ldexp(param , n))));
-	}
-	return;
-}
-
-/*
-* calibrate_cpu_cycles_1()
-* 1st method to calibrate the ns per loop value
-* We alternate idle period and run period in order to not trig some hw
-* protection mechanism like thermal mitgation
-*/
-int calibrate_cpu_cycles_1(int clock)
-{
-	struct timespec start, stop, sleep;
-	int max_load_loop = 10000;
-	unsigned int diff;
-	int nsec_per_loop, avg_per_loop = 0;
-	int cal_trial = 1000;
-
-	while (cal_trial) {
-		cal_trial--;
-		sleep.tv_sec = 1;
-		sleep.tv_nsec = 0;
-
-		clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep, NULL);
-
-		clock_gettime(clock, &start);
-		waste_cpu_cycles(max_load_loop);
-		clock_gettime(clock, &stop);
-
-		diff = (int)timespec_sub_to_ns(&stop, &start);
-		nsec_per_loop = diff / max_load_loop;
-		avg_per_loop = (avg_per_loop + nsec_per_loop) >> 1;
-
-		/* collect a critical mass of samples.*/
-		if ((abs(nsec_per_loop - avg_per_loop) * 50)  < avg_per_loop)
-			return avg_per_loop;
-
-		/*
-		* use several loop duration in order to be sure to not
-		* fall into a specific platform loop duration
-		*(like the cpufreq period)
-		*/
-		/*randomize the number of loops and recheck 1000 times*/
-		max_load_loop += 33333;
-		max_load_loop %= 1000000;
-	}
-	return 0;
-}
-
-/*
-* calibrate_cpu_cycles_2()
-* 2nd method to calibrate the ns per loop value
-* We continously runs something to ensure that CPU is set to max freq by the
-* governor
-*/
-int calibrate_cpu_cycles_2(int clock)
+static inline unsigned long loadwait(unsigned long exec, int cpu,
+				     const burn_kernel_t *kernel)
 {
-	struct timespec start, stop;
-	int max_load_loop = 10000;
-	unsigned int diff;
-	int nsec_per_loop, avg_per_loop = 0;
-	int cal_trial = 1000;
-
-	while (cal_trial) {
-		cal_trial--;
-
-		clock_gettime(clock, &start);
-		waste_cpu_cycles(max_load_loop);
-		clock_gettime(clock, &stop);
-
-		diff = (int)timespec_sub_to_ns(&stop, &start);
-		nsec_per_loop = diff / max_load_loop;
-		avg_per_loop = (avg_per_loop + nsec_per_loop) >> 1;
+	unsigned long load_count, secs, perf;
+	int i, p_load = kernel->p_load;
 
-		/* collect a critical mass of samples.*/
-		if ((abs(nsec_per_loop - avg_per_loop) * 50)  < avg_per_loop)
-			return avg_per_loop;
+	if (calib.per_cpu) {
+		if (cpu < 0)
+			cpu = sched_getcpu();
+		p_load = calib_cpu_ns_per_loop(kernel, cpu);
 
 		/*
-		* use several loop duration in order to be sure to not
-		* fall into a specific platform loop duration
-		*(like the cpufreq period)
-		*/
-		/*randomize the number of loops and recheck 1000 times*/
-		max_load_loop += 33333;
-		max_load_loop %= 1000000;
+		 * exec is the duration at max capacity; scale it to the time
+		 * needed to do the same amount of work on this CPU.
+		 */
+		if (calib.capacity_normalized)
+			exec = exec * CALIB_CAPACITY_SCALE / calib_cpu_capacity(cpu);
 	}
-	return 0;
-}
-
-/*
-* calibrate_cpu_cycles()
-* Use several methods to calibrate the ns per loop and get the min value which
-* correspond to the highest achievable compute capacity.
-*/
-int calibrate_cpu_cycles(int clock)
-{
-	int calib1, calib2;
-
-	/* Run 1st method */
-	calib1 = calibrate_cpu_cycles_1(clock);
-
-	/* Run 2nd method */
-	calib2 = calibrate_cpu_cycles_2(clock);
-
-	if (calib1 < calib2)
-		return calib1;
-	else
-		return calib2;
-
-}
-
-static inline unsigned long loadwait(unsigned long exec)
-{
-	unsigned long load_count, secs, perf;
-	int i;
 
 	/*
 	 * Performace is the fixed amount of work that is performed by this run
@@ -360,7 +340,7 @@ static inline unsigned long loadwait(unsigned long exec)
 
 	for (i = 0; i < secs; i++) {
 		load_count = 1000000000/p_load;
-		waste_cpu_cycles(load_count);
+		kernel->fn(load_count);
 		exec -= 1000000;
 	}
 
@@ -368,7 +348,7 @@ static inline unsigned long loadwait(unsigned long exec)
 	 * Run for the remainig exec (if any).
 	 */
 	load_count = (exec * 1000)/p_load;
-	waste_cpu_cycles(load_count);
+	kernel->fn(load_count);
 
 	return perf;
 }
@@ -446,314 +426,1302 @@ static void memwrite(unsigned long count, struct _rtapp_iomem_buf *iomem)
 		p[j] = (char)j;
 }
 
-static void memchase_run(unsigned long count, struct _rtapp_mem_chase_buf *chase)
+/*
+ * Event handlers
+ *
+ * Each event type has its own handler which is resolved, along with the
+ * resources used by the event, when the phases of a thread are compiled (see
+ * thread_data_compile_phases()). A handler returns the change in the number
+ * of mutexes held by the thread.
+ */
+static int ev_nop(const event_op_t *op, event_ctx_t *ctx)
+{
+	return 0;
+}
+
+/*
+ * The wakers stamp the time and a sequence number in the wait or semaphore
+ * resource before waking the waiters up. A waiter which finds a new sequence
+ * number when it returns accounts the latency since the stamp, also in the
+ * order it returns after the wake up. The sequence numbers link the wake ups
+ * to the waits they end in the timeline.
+ */
+static inline void wake_out(wake_stamp_t *wake, event_ctx_t *ctx)
+{
+	struct timespec t_now;
+	unsigned int seq;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_now);
+	__atomic_store_n(&wake->ts, timespec_to_nsec(&t_now), __ATOMIC_RELAXED);
+	__atomic_store_n(&wake->rank, 0, __ATOMIC_RELAXED);
+	seq = __atomic_add_fetch(&wake->seq, 1, __ATOMIC_RELEASE);
+	if (ctx->timeline)
+		ctx->flow_out = seq;
+}
+
+/* Sequence number to give to wake_in() once the wait returns */
+static inline unsigned int wake_seq(const wake_stamp_t *wake)
+{
+	return __atomic_load_n(&wake->seq, __ATOMIC_ACQUIRE);
+}
+
+static void wake_lat_add(lat_stats_t *lat, long ns)
 {
-	char **p = (char **)chase->base;
-	unsigned long i;
+	long max = __atomic_load_n(&lat->lat_max, __ATOMIC_RELAXED);
+
+	__atomic_add_fetch(&lat->wakeups, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&lat->lat_sum, ns, __ATOMIC_RELAXED);
+	while (ns > max &&
+	       !__atomic_compare_exchange_n(&lat->lat_max, &max, ns, 0,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
 
-	if (!p)
+static void wake_in(const event_op_t *op, event_ctx_t *ctx,
+		    wake_stamp_t *wake, unsigned int seq)
+{
+	struct timespec t_now;
+	unsigned int last, rank;
+	long lat;
+
+	last = wake_seq(wake);
+	if (ctx->timeline)
+		ctx->flow_in = last;
+	/* the wait didn't need a new wake up */
+	if (last == seq)
 		return;
 
-	for (i = 0; i < count; i++)
-		p = (char **)*p;
+	/* read after the stamp, so never before it */
+	lat = -__atomic_load_n(&wake->ts, __ATOMIC_RELAXED);
+	clock_gettime(CLOCK_MONOTONIC, &t_now);
+	lat += timespec_to_nsec(&t_now);
+
+	rank = __atomic_fetch_add(&wake->rank, 1, __ATOMIC_RELAXED);
+	wake_lat_add(&wake->lat, lat);
+	wake_lat_add(&wake->ranks[rank < WAKE_LAT_RANKS ?
+				  rank : WAKE_LAT_RANKS - 1], lat);
 
-	/* Prevent compiler from optimizing away the chases */
-	*(volatile char **)&chase->base = (char *)p;
+	if (ftrace_level & FTRACE_EVENT)
+		ftrace_wakeup(ctx->marker_fd, ctx->raw_fd,
+			      ctx->tdata ? ctx->tdata->ind : -1, op->rdata,
+			      lat, last, rank);
 }
 
-static int run_event(event_data_t *event, int dry_run,
-		unsigned long *perf, thread_data_t *tdata,
-		struct timespec *t_first, log_data_t *ldata)
+static int ev_lock(const event_op_t *op, event_ctx_t *ctx)
 {
-	/* By default we use global resources */
-	rtapp_resources_t *table_resources = *(tdata->global_resources);
-	rtapp_resource_t *rdata = &(table_resources->resources[event->res]);
-	rtapp_resource_t *ddata = &(table_resources->resources[event->dep]);
-	unsigned long lock = 0;
+	pthread_mutex_lock(&(op->rdata->res.mtx.obj));
+	if (ctx->timeline)
+		timeline_lock(ctx->timeline, op->rdata);
+	return 1;
+}
 
-	switch(event->type) {
-	case rtapp_lock:
-		log_debug("lock %s ", rdata->name);
-		pthread_mutex_lock(&(rdata->res.mtx.obj));
-		lock = 1;
-		break;
-	case rtapp_unlock:
-		log_debug("unlock %s ", rdata->name);
-		pthread_mutex_unlock(&(rdata->res.mtx.obj));
-		lock = -1;
-		break;
-	default:
-		break;
+static int ev_unlock(const event_op_t *op, event_ctx_t *ctx)
+{
+	if (ctx->timeline)
+		timeline_unlock(ctx->timeline, op->rdata);
+	pthread_mutex_unlock(&(op->rdata->res.mtx.obj));
+	return -1;
+}
+
+static int ev_wait(const event_op_t *op, event_ctx_t *ctx)
+{
+	struct _rtapp_cond *cond = &op->rdata->res.cond;
+	unsigned int seq = wake_seq(&cond->wake);
+
+	sync_cond_wait(cond, &op->ddata->res.mtx.obj);
+	wake_in(op, ctx, &cond->wake, seq);
+	return 0;
+}
+
+static int ev_signal(const event_op_t *op, event_ctx_t *ctx)
+{
+	wake_out(&op->rdata->res.cond.wake, ctx);
+	sync_cond_signal(&op->rdata->res.cond, 0);
+	return 0;
+}
+
+static int ev_barrier(const event_op_t *op, event_ctx_t *ctx)
+{
+	sync_barrier_wait(&op->rdata->res.barrier);
+	return 0;
+}
+
+static int ev_sig_and_wait(const event_op_t *op, event_ctx_t *ctx)
+{
+	struct _rtapp_cond *cond = &op->rdata->res.cond;
+	unsigned int seq;
+
+	wake_out(&cond->wake, ctx);
+	seq = wake_seq(&cond->wake);
+	sync_cond_signal(cond, 0);
+	sync_cond_wait(cond, &op->ddata->res.mtx.obj);
+	wake_in(op, ctx, &cond->wake, seq);
+	return 0;
+}
+
+static int ev_broadcast(const event_op_t *op, event_ctx_t *ctx)
+{
+	wake_out(&op->rdata->res.cond.wake, ctx);
+	sync_cond_signal(&op->rdata->res.cond, 1);
+	return 0;
+}
+
+static int ev_sleep(const event_op_t *op, event_ctx_t *ctx)
+{
+	struct timespec sleep = usec_to_timespec(op->duration);
+
+	nanosleep(&sleep, NULL);
+	return 0;
+}
+
+static int ev_run(const event_op_t *op, event_ctx_t *ctx)
+{
+	struct timespec t_start, t_end;
+
+	ctx->ldata->c_duration += op->duration;
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	ctx->perf += loadwait(op->duration, ctx->tdata->run_cpu, op->kernel);
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	t_end = timespec_sub(&t_end, &t_start);
+	ctx->ldata->duration += timespec_to_usec(&t_end);
+	return 0;
+}
+
+static inline int64_t thread_cputime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Burn @kernel until the thread's CPU time (@cputime) or the wall clock time
+ * has advanced by @target_ns.
+ *
+ * Each chunk of work is sized to half of the remaining time so the clock is
+ * read a logarithmic number of times and the overshoot is bounded by the last
+ * chunk, which is a single loop. The overshoot in ns is returned in
+ * @overshoot, the amount of work in the same unit as loadwait().
+ */
+static unsigned long burn_for(const burn_kernel_t *kernel, int cpu, int cputime,
+			      int64_t target_ns, int64_t *overshoot)
+{
+	unsigned long long loops, total = 0;
+	int64_t start, now, remaining;
+	int p_load;
+
+	if (calib.per_cpu && cpu < 0)
+		cpu = sched_getcpu();
+	p_load = calib.per_cpu ? calib_cpu_ns_per_loop(kernel, cpu) : kernel->p_load;
+
+	start = now = cputime ? thread_cputime_ns() : fastclock_ns();
+
+	while ((remaining = start + target_ns - now) > 0) {
+		loops = remaining / (2 * p_load);
+		if (!loops)
+			loops = 1;
+
+		kernel->fn(loops);
+		total += loops;
+
+		now = cputime ? thread_cputime_ns() : fastclock_ns();
 	}
 
-	if (dry_run)
-		return lock;
+	*overshoot = -remaining;
 
-	switch(event->type) {
-	case rtapp_wait:
-		log_debug("wait %s ", rdata->name);
-		pthread_cond_wait(&(rdata->res.cond.obj), &(ddata->res.mtx.obj));
-		break;
-	case rtapp_signal:
-		log_debug("signal %s ", rdata->name);
-		pthread_cond_signal(&(rdata->res.cond.obj));
-		break;
-	case rtapp_barrier:
-		log_debug("barrier %s ", rdata->name);
-		pthread_mutex_lock(&(rdata->res.barrier.m_obj));
-		if (rdata->res.barrier.waiting == 0) {
-			/* everyone is already waiting, signal */
-			pthread_cond_broadcast(&(rdata->res.barrier.c_obj));
-		} else {
-			/* not everyone is waiting, mark then wait */
-			rdata->res.barrier.waiting -= 1;
-			pthread_cond_wait(&(rdata->res.barrier.c_obj), &(rdata->res.barrier.m_obj));
-			rdata->res.barrier.waiting += 1;
-		}
-		pthread_mutex_unlock(&(rdata->res.barrier.m_obj));
-		break;
-	case rtapp_sig_and_wait:
-		log_debug("signal and wait %s", rdata->name);
-		pthread_cond_signal(&(rdata->res.cond.obj));
-		pthread_cond_wait(&(rdata->res.cond.obj), &(ddata->res.mtx.obj));
-		break;
-	case rtapp_broadcast:
-		log_debug("broadcast %s ", rdata->name);
-		pthread_cond_broadcast(&(rdata->res.cond.obj));
-		break;
-	case rtapp_sleep:
-		{
-		struct timespec sleep = usec_to_timespec(event->duration);
-		log_debug("sleep %d ", event->duration);
-		nanosleep(&sleep, NULL);
-		}
-		break;
-	case rtapp_run:
-		{
-			struct timespec t_start, t_end;
-			log_debug("run %d ", event->duration);
-			ldata->c_duration += event->duration;
-			clock_gettime(CLOCK_MONOTONIC, &t_start);
-			*perf += loadwait(event->duration);
-			clock_gettime(CLOCK_MONOTONIC, &t_end);
-			t_end = timespec_sub(&t_end, &t_start);
-			ldata->duration += timespec_to_usec(&t_end);
-		}
-		break;
-	case rtapp_runtime:
-		{
-			struct timespec t_start, t_end;
-			int64_t diff_ns;
+	return total / 1000;
+}
 
-			log_debug("runtime %d ", event->duration);
-			ldata->c_duration += event->duration;
-			clock_gettime(CLOCK_MONOTONIC, &t_start);
+static int ev_runtime(const event_op_t *op, event_ctx_t *ctx)
+{
+	struct timespec t_start, t_end;
+	int64_t overshoot;
 
-			do {
-				/* Do work for 32usec  */
-				*perf += loadwait(32);
+	ctx->ldata->c_duration += op->duration;
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
 
-				clock_gettime(CLOCK_MONOTONIC, &t_end);
-				diff_ns = timespec_sub_to_ns(&t_end, &t_start);
-			} while ((diff_ns / 1000) < event->duration);
+	ctx->perf += burn_for(op->kernel, ctx->tdata->run_cpu, 0,
+			      op->duration * 1000LL, &overshoot);
 
-			t_end = timespec_sub(&t_end, &t_start);
-			ldata->duration += timespec_to_usec(&t_end);
-		}
-		break;
-	case rtapp_timer_unique:
-		{
-			/* Unique timer uses local resources */
-			rdata = &(tdata->local_resources->resources[event->res]);
-		}
-	case rtapp_timer:
-		{
-			struct timespec t_period, t_now, t_wu, t_slack;
-			log_debug("timer %d ", event->duration);
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	t_end = timespec_sub(&t_end, &t_start);
+	ctx->ldata->duration += timespec_to_usec(&t_end);
+	ctx->ldata->overshoot += overshoot;
+	return 0;
+}
 
-			t_period = usec_to_timespec(event->duration);
-			ldata->c_period += event->duration;
+static int ev_cputime(const event_op_t *op, event_ctx_t *ctx)
+{
+	struct timespec t_start, t_end;
+	int64_t overshoot;
 
-			if (rdata->res.timer.init == 0) {
-				rdata->res.timer.init = 1;
-				rdata->res.timer.t_next = *t_first;
-			}
+	ctx->ldata->c_duration += op->duration;
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
 
-			rdata->res.timer.t_next = timespec_add(&rdata->res.timer.t_next, &t_period);
-			clock_gettime(CLOCK_MONOTONIC, &t_now);
-			t_slack = timespec_sub(&rdata->res.timer.t_next, &t_now);
-			if (opts.cumulative_slack)
-				ldata->slack += timespec_to_usec_long(&t_slack);
-			else
-				ldata->slack = timespec_to_usec_long(&t_slack);
-			if (timespec_lower(&t_now, &rdata->res.timer.t_next)) {
-				clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &rdata->res.timer.t_next, NULL);
-				clock_gettime(CLOCK_MONOTONIC, &t_now);
-				t_wu = timespec_sub(&t_now, &rdata->res.timer.t_next);
-				ldata->wu_latency += timespec_to_usec(&t_wu);
-			} else {
-				if (rdata->res.timer.relative)
-					clock_gettime(CLOCK_MONOTONIC, &rdata->res.timer.t_next);
-				ldata->wu_latency = 0UL;
-			}
-		}
-		break;
-	case rtapp_suspend:
-		{
-			log_debug("suspend %s ", rdata->name);
-			pthread_mutex_lock(&(ddata->res.mtx.obj));
-			pthread_cond_wait(&(rdata->res.cond.obj), &(ddata->res.mtx.obj));
-			pthread_mutex_unlock(&(ddata->res.mtx.obj));
-		break;
-		}
-	case rtapp_resume:
-		{
-			log_debug("resume %s ", rdata->name);
-			pthread_mutex_lock(&(ddata->res.mtx.obj));
-			pthread_cond_broadcast(&(rdata->res.cond.obj));
-			pthread_mutex_unlock(&(ddata->res.mtx.obj));
-		break;
-		}
-	case rtapp_mem:
-		{
-			log_debug("mem %d", event->count);
-			memload(event->count, &rdata->res.buf);
-		}
-		break;
-	case rtapp_mem_write:
-		{
-			log_debug("mem_write %d", event->count);
-			memwrite(event->count, &rdata->res.buf);
-		}
-		break;
-	case rtapp_mem_read:
-		{
-			log_debug("mem_read %d", event->count);
-			memread(event->count, &rdata->res.buf);
-		}
-		break;
-	case rtapp_mem_chase:
-		{
-			log_debug("mem_chase %d", event->count);
-			memchase_run(event->count, &rdata->res.chase);
-		}
-		break;
-	case rtapp_iorun:
-		{
-			log_debug("iorun %d", event->count);
-			ioload(event->count, &rdata->res.buf, ddata->res.dev.fd);
-		}
-		break;
-	case rtapp_yield:
-		{
-			log_debug("yield %d", event->count);
-			sched_yield();
-		}
-		break;
-	case rtapp_fork:
-		{
-			log_debug("fork %s", rdata->res.fork.ref);
-
-			/*
-			 * Check if the current thread reached its limit of
-			 * number of allowable forks.
-			 * We enforce a limit to prevent infinite loops.
-			 */
-			if (rdata->res.fork.nforks >= FORKS_LIMIT) {
-				log_error("%s reached its fork limit (%d)", rdata->res.fork.tdata->name, FORKS_LIMIT);
-				exit(EXIT_FAILURE);
-			}
+	ctx->perf += burn_for(op->kernel, ctx->tdata->run_cpu, 1,
+			      op->duration * 1000LL, &overshoot);
 
-			/*
-			 * If multiple threads race to fork, we must ensure
-			 * each one sees a unique index. Hence the lock.
-			 */
-			pthread_mutex_lock(&fork_mutex);
-			int new_thread_index = nthreads++;
-			threads = realloc(threads, nthreads * sizeof(*threads));
-
-			if (!threads) {
-				log_error("Failed to allocate memory for a new fork: %s", rdata->res.fork.tdata->name);
-				pthread_mutex_unlock(&fork_mutex);
-				exit(EXIT_FAILURE);
-			}
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	t_end = timespec_sub(&t_end, &t_start);
+	ctx->ldata->duration += timespec_to_usec(&t_end);
+	ctx->ldata->overshoot += overshoot;
+	return 0;
+}
 
-			/*
-			 * Find the thread data associated with this fork and
-			 * store it in tdata; this needs to be done once if the
-			 * fork is done within a loop.
-			 *
-			 * Note that we can't search for the reference at parse
-			 * time because we are not guaranteed that the task
-			 * that is referenced was already parsed; it'll depend
-			 * greatly on the ordering within the defined json
-			 * file.
-			 */
-			if (!rdata->res.fork.tdata) {
-				rdata->res.fork.tdata = find_thread_data(rdata->res.fork.ref, &opts);
-			}
+static inline void dmiss_hit(dmiss_stats_t *dmiss)
+{
+	dmiss->activations++;
+	dmiss->consecutive = 0;
+}
 
-			int ret = create_thread(rdata->res.fork.tdata, new_thread_index, 1, rdata->res.fork.nforks++);
-			if (ret) {
-				pthread_mutex_unlock(&fork_mutex);
-				exit(EXIT_FAILURE);
-			}
+static inline void dmiss_miss(dmiss_stats_t *dmiss, long overrun)
+{
+	dmiss->activations++;
+	dmiss->misses++;
+	dmiss->consecutive++;
+	if (dmiss->consecutive > dmiss->max_consecutive)
+		dmiss->max_consecutive = dmiss->consecutive;
+	dmiss->overrun_sum += overrun;
+	if (overrun > dmiss->overrun_max)
+		dmiss->overrun_max = overrun;
+}
 
-			running_threads = nthreads;
+/*
+ * Stop the use case from a task: the signal is blocked in the tasks so the
+ * main thread runs the usual shutdown, which cancels this task.
+ */
+static void abort_on_dmiss(thread_data_t *tdata, const char *timer)
+{
+	log_error("[%d] %s: %lu consecutive missed activations of %s, stopping",
+		  tdata->ind, tdata->name, tdata->dmiss.consecutive, timer);
+	exit_status = EXIT_DEADLINE_MISS;
+	kill(getpid(), SIGTERM);
+}
 
-			pthread_mutex_unlock(&fork_mutex);
-		}
-		break;
-	case rtapp_sem_post:
-		{
-			log_debug("sem_post %s", rdata->name);
-			sem_post(&rdata->res.sem.obj);
-		}
-		break;
-	case rtapp_sem_wait:
-		{
-			log_debug("sem_wait %s", rdata->name);
-			sem_wait(&rdata->res.sem.obj);
-		}
+static int ev_timer(const event_op_t *op, event_ctx_t *ctx)
+{
+	rtapp_resource_t *rdata = op->rdata;
+	struct _rtapp_timer *timer = &rdata->res.timer;
+	thread_data_t *tdata = ctx->tdata;
+	log_data_t *ldata = ctx->ldata;
+	struct timespec t_period, t_now, t_wu, t_slack;
+	long slack, lat;
+
+	t_period = usec_to_timespec(op->duration);
+	ldata->c_period += op->duration;
+
+	if (timer->init == 0) {
+		timer->init = 1;
+		timer->t_next = *ctx->t_first;
+	}
+
+	timer->t_next = timespec_add(&timer->t_next, &t_period);
+	clock_gettime(CLOCK_MONOTONIC, &t_now);
+	t_slack = timespec_sub(&timer->t_next, &t_now);
+	slack = timespec_to_usec_long(&t_slack);
+	if (opts.cumulative_slack)
+		ldata->slack += slack;
+	else
+		ldata->slack = slack;
+
+	if (timespec_lower(&t_now, &timer->t_next)) {
+		dmiss_hit(&timer->dmiss);
+		dmiss_hit(&tdata->dmiss);
+		goto sleep;
+	}
+
+	/* The activation is missed */
+	dmiss_miss(&timer->dmiss, -slack);
+	dmiss_miss(&tdata->dmiss, -slack);
+	if (ftrace_level & FTRACE_EVENT)
+		ftrace_dmiss(ctx->marker_fd, ctx->raw_fd, tdata->ind, rdata,
+			     -slack, tdata->dmiss.consecutive);
+
+	if (timer->overrun == timer_abort ||
+	    (opts.die_on_dmiss &&
+	     tdata->dmiss.consecutive >= opts.die_on_dmiss)) {
+		abort_on_dmiss(tdata, rdata->name);
+		ldata->wu_latency = 0UL;
+		return 0;
+	}
+
+	switch (timer->overrun) {
+	case timer_skip_to_next: {
+		/* drop the missed periods and wait for the next one */
+		unsigned long n = op->duration ? (-slack) / op->duration + 1 : 1;
+		struct timespec t_skip = usec_to_timespec(op->duration * n);
+
+		timer->t_next = timespec_add(&timer->t_next, &t_skip);
+		goto sleep;
+	}
+	case timer_reset_relative:
+		clock_gettime(CLOCK_MONOTONIC, &timer->t_next);
 		break;
 	default:
 		break;
 	}
+	ldata->wu_latency = 0UL;
+	return 0;
+
+sleep:
+	timer_wait(&tdata->timer_waiter, timer->backend, &timer->t_next,
+		   timer->spin);
+	clock_gettime(CLOCK_MONOTONIC, &t_now);
+	t_wu = timespec_sub(&t_now, &timer->t_next);
+	ldata->wu_latency += timespec_to_usec(&t_wu);
+
+	lat = timespec_sub_to_ns(&t_now, &timer->t_next);
+	timer->lat.wakeups++;
+	timer->lat.lat_sum += lat;
+	if (lat > timer->lat.lat_max)
+		timer->lat.lat_max = lat;
+	return 0;
+}
+
+static int ev_suspend(const event_op_t *op, event_ctx_t *ctx)
+{
+	struct _rtapp_cond *cond = &op->rdata->res.cond;
+	unsigned int seq;
+
+	pthread_mutex_lock(&(op->ddata->res.mtx.obj));
+	seq = wake_seq(&cond->wake);
+	sync_cond_wait(cond, &op->ddata->res.mtx.obj);
+	pthread_mutex_unlock(&(op->ddata->res.mtx.obj));
+	wake_in(op, ctx, &cond->wake, seq);
+	return 0;
+}
+
+static int ev_resume(const event_op_t *op, event_ctx_t *ctx)
+{
+	pthread_mutex_lock(&(op->ddata->res.mtx.obj));
+	wake_out(&op->rdata->res.cond.wake, ctx);
+	sync_cond_signal(&op->rdata->res.cond, 1);
+	pthread_mutex_unlock(&(op->ddata->res.mtx.obj));
+	return 0;
+}
+
+static int ev_mem(const event_op_t *op, event_ctx_t *ctx)
+{
+	memload(op->count, &op->rdata->res.buf);
+	return 0;
+}
+
+static int ev_mem_write(const event_op_t *op, event_ctx_t *ctx)
+{
+	memwrite(op->count, &op->rdata->res.buf);
+	return 0;
+}
+
+static int ev_mem_read(const event_op_t *op, event_ctx_t *ctx)
+{
+	memread(op->count, &op->rdata->res.buf);
+	return 0;
+}
+
+static int ev_mem_chase(const event_op_t *op, event_ctx_t *ctx)
+{
+	struct timespec t_start, t_end;
+	unsigned long hops;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	hops = chase_run(&op->rdata->res.chase, op->count);
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+	ctx->ldata->chase_hops += hops;
+	ctx->ldata->chase_ns += timespec_sub_to_ns(&t_end, &t_start);
+	return 0;
+}
+
+static int ev_mem_stream(const event_op_t *op, event_ctx_t *ctx)
+{
+	struct timespec t_start, t_end;
+	unsigned long bytes;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	bytes = stream_run(&op->rdata->res.stream, op->count);
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+	ctx->ldata->mem_bytes += bytes;
+	ctx->ldata->mem_ns += timespec_sub_to_ns(&t_end, &t_start);
+	return 0;
+}
+
+static int ev_iorun(const event_op_t *op, event_ctx_t *ctx)
+{
+	ioload(op->count, &op->rdata->res.buf, op->ddata->res.dev.fd);
+	return 0;
+}
+
+static int ev_yield(const event_op_t *op, event_ctx_t *ctx)
+{
+	sched_yield();
+	return 0;
+}
+
+/*
+ * A fork served by the pool only posts the semaphore of the parked threads.
+ * Returns 0 if the pool is empty.
+ */
+static int fork_pool_wake(rtapp_resource_t *rdata, struct timespec *t_fork)
+{
+	struct _rtapp_fork *fork = &rdata->res.fork;
+	unsigned int ticket;
+
+	ticket = __atomic_fetch_add(&fork->pool_posted, 1, __ATOMIC_RELAXED);
+	if (ticket >= fork->pool)
+		return 0;
+
+	__atomic_store_n(&fork->pool_ts[ticket], timespec_to_nsec(t_fork),
+			 __ATOMIC_RELEASE);
+	sem_post(&fork->pool_sem);
+	return 1;
+}
+
+/*
+ * Take the ticket of a fork served by the pool and not taken yet, -1 if
+ * there is none: the posts of fork_pools_release() don't have one.
+ */
+static int fork_pool_ticket(struct _rtapp_fork *fork)
+{
+	unsigned int taken, posted;
+
+	taken = __atomic_load_n(&fork->pool_taken, __ATOMIC_RELAXED);
+	do {
+		posted = __atomic_load_n(&fork->pool_posted, __ATOMIC_RELAXED);
+		if (posted > (unsigned int)fork->pool)
+			posted = fork->pool;
+		if (taken >= posted)
+			return -1;
+	} while (!__atomic_compare_exchange_n(&fork->pool_taken, &taken,
+					      taken + 1, 0, __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+
+	return taken;
+}
+
+/*
+ * Park a thread of a fork pool until a fork event wakes it up. Returns 0 if
+ * the use case ends first.
+ */
+static int fork_pool_park(thread_data_t *data)
+{
+	struct _rtapp_fork *fork = &data->fork_res->res.fork;
+	int ticket;
+
+	while (sem_wait(&fork->pool_sem) && errno == EINTR)
+		;
+
+	/*
+	 * A fork posted before the pool was closed is still served. The posts
+	 * are not taken in order: if the fork of this ticket hasn't stored its
+	 * time yet, its latency is not recorded.
+	 */
+	ticket = fork_pool_ticket(fork);
+	if (ticket < 0)
+		return 0;
+
+	data->fork_ts = __atomic_load_n(&fork->pool_ts[ticket], __ATOMIC_ACQUIRE);
+	if (data->fork_ts)
+		__atomic_fetch_add(&fork->stats.pooled, 1, __ATOMIC_RELAXED);
+
+	return 1;
+}
+
+/* Create the parked threads of the pool of each fork event */
+static int fork_pools_create(void)
+{
+	rtapp_resources_t *table = opts.resources;
+	int i, j, index;
+
+	for (i = 0; i < table->nresources; i++) {
+		rtapp_resource_t *rdata = &table->resources[i];
+		struct _rtapp_fork *fork = &rdata->res.fork;
+
+		if (rdata->type != rtapp_fork || !fork->pool)
+			continue;
+
+		if (!fork->tdata)
+			fork->tdata = find_thread_data(fork->ref, &opts);
+
+		sem_init(&fork->pool_sem, 0, 0);
+		fork->pool_ts = calloc(fork->pool, sizeof(*fork->pool_ts));
+		if (!fork->pool_ts) {
+			log_error("Cannot allocate the fork pool of %s", fork->ref);
+			return -1;
+		}
+
+		for (j = 0; j < fork->pool; j++) {
+			index = thread_reserve();
+			if (index < 0 ||
+			    create_thread(fork->tdata, index, rdata,
+					  fork->nforks++, 0))
+				return -1;
+		}
+
+		log_notice("%d threads of %s parked for its fork events",
+			   fork->pool, fork->ref);
+	}
+
+	return 0;
+}
+
+/* Wake up the threads still parked, those without a fork to serve exit */
+static void fork_pools_release(void)
+{
+	rtapp_resources_t *table = opts.resources;
+	int i, j;
+
+	for (i = 0; i < table->nresources; i++) {
+		rtapp_resource_t *rdata = &table->resources[i];
+		struct _rtapp_fork *fork = &rdata->res.fork;
+
+		if (rdata->type != rtapp_fork || !fork->pool)
+			continue;
+
+		for (j = 0; j < fork->pool; j++)
+			sem_post(&fork->pool_sem);
+	}
+}
+
+/* Free the pools once their threads have exited */
+static void fork_pools_free(void)
+{
+	rtapp_resources_t *table = opts.resources;
+	int i;
+
+	for (i = 0; i < table->nresources; i++) {
+		rtapp_resource_t *rdata = &table->resources[i];
+		struct _rtapp_fork *fork = &rdata->res.fork;
+
+		if (rdata->type != rtapp_fork || !fork->pool_ts)
+			continue;
+
+		sem_destroy(&fork->pool_sem);
+		free(fork->pool_ts);
+		fork->pool_ts = NULL;
+	}
+}
+
+/* Called by a forked thread when it starts its first loop */
+static void fork_latency(thread_data_t *data, struct timespec *t_start)
+{
+	fork_stats_t *stats = &data->fork_res->res.fork.stats;
+	__u64 now = timespec_to_nsec(t_start);
+	__u64 lat, old;
+
+	lat = now > data->fork_ts ? now - data->fork_ts : 0;
+	data->fork_ts = 0;
+
+	__atomic_fetch_add(&stats->forks, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->lat_sum, lat, __ATOMIC_RELAXED);
+
+	old = __atomic_load_n(&stats->lat_max, __ATOMIC_RELAXED);
+	while (lat > old &&
+	       !__atomic_compare_exchange_n(&stats->lat_max, &old, lat, 0,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	old = __atomic_load_n(&stats->lat_min, __ATOMIC_RELAXED);
+	while (lat < old &&
+	       !__atomic_compare_exchange_n(&stats->lat_min, &old, lat, 0,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+
+	log_debug("[%d] started %llu ns after its fork event", data->ind, lat);
+}
+
+static int ev_fork(const event_op_t *op, event_ctx_t *ctx)
+{
+	rtapp_resource_t *rdata = op->rdata;
+	struct timespec t_fork;
+	int index, ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_fork);
+
+	/* Waking up a parked thread is much faster than creating one */
+	if (rdata->res.fork.pool && fork_pool_wake(rdata, &t_fork))
+		return 0;
+
+	/*
+	 * Check if the current thread reached its limit of
+	 * number of allowable forks.
+	 * We enforce a limit to prevent infinite loops.
+	 */
+	if (rdata->res.fork.nforks >= FORKS_LIMIT) {
+		log_error("%s reached its fork limit (%d)", rdata->res.fork.tdata->name, FORKS_LIMIT);
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 * If multiple threads race to fork, we must ensure
+	 * each one sees a unique index. Hence the lock.
+	 */
+	pthread_mutex_lock(&fork_mutex);
+	index = thread_reserve();
+	if (index < 0) {
+		log_error("Failed to allocate memory for a new fork: %s", rdata->res.fork.ref);
+		pthread_mutex_unlock(&fork_mutex);
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 * Find the thread data associated with this fork and
+	 * store it in tdata; this needs to be done once if the
+	 * fork is done within a loop.
+	 *
+	 * Note that we can't search for the reference at parse
+	 * time because we are not guaranteed that the task
+	 * that is referenced was already parsed; it'll depend
+	 * greatly on the ordering within the defined json
+	 * file.
+	 */
+	if (!rdata->res.fork.tdata) {
+		rdata->res.fork.tdata = find_thread_data(rdata->res.fork.ref, &opts);
+	}
+
+	ret = create_thread(rdata->res.fork.tdata, index, rdata,
+			    rdata->res.fork.nforks++, timespec_to_nsec(&t_fork));
+	if (ret) {
+		pthread_mutex_unlock(&fork_mutex);
+		exit(EXIT_FAILURE);
+	}
+
+	running_threads = nthreads;
+
+	pthread_mutex_unlock(&fork_mutex);
+	return 0;
+}
+
+static int ev_sem_post(const event_op_t *op, event_ctx_t *ctx)
+{
+	wake_out(&op->rdata->res.sem.wake, ctx);
+	sem_post(&op->rdata->res.sem.obj);
+	return 0;
+}
+
+static int ev_sem_wait(const event_op_t *op, event_ctx_t *ctx)
+{
+	struct _rtapp_sem *sem = &op->rdata->res.sem;
+	unsigned int seq = wake_seq(&sem->wake);
+
+	sync_sem_wait(sem);
+	wake_in(op, ctx, &sem->wake, seq);
+	return 0;
+}
+
+/*
+ * The message of a push is produced in its payload and the one of a pop is
+ * consumed, in the ring or in the buffer of the thread with "copy". The policy
+ * on a full or empty queue is in count.
+ */
+static int ev_push(const event_op_t *op, event_ctx_t *ctx)
+{
+	struct _rtapp_queue *queue = &op->rdata->res.queue;
+	char *src = NULL;
+
+	if (queue->copy && queue->size) {
+		src = ctx->tdata->payload;
+		queue_payload_write(src, queue->size, ctx->tdata->ind);
+	}
+	queue_push(queue->ring, op->count, src);
+	return 0;
+}
+
+static int ev_pop(const event_op_t *op, event_ctx_t *ctx)
+{
+	struct _rtapp_queue *queue = &op->rdata->res.queue;
+	char *dst = NULL;
+
+	if (queue->copy && queue->size)
+		dst = ctx->tdata->payload;
+	if (!queue_pop(queue->ring, op->count, dst) && dst)
+		queue_payload_read(dst, queue->size);
+	return 0;
+}
+
+static int ev_migrate_pages(const event_op_t *op, event_ctx_t *ctx)
+{
+	if (mem_resource_migrate(op->rdata, op->count) < 0)
+		log_debug("[%d] migrate_pages %s to node %d: %s",
+			  ctx->tdata->ind, op->rdata->name, op->count,
+			  strerror(errno));
+	return 0;
+}
+
+static const event_handler_t event_handlers[] = {
+	[rtapp_lock] = ev_lock,
+	[rtapp_unlock] = ev_unlock,
+	[rtapp_wait] = ev_wait,
+	[rtapp_signal] = ev_signal,
+	[rtapp_barrier] = ev_barrier,
+	[rtapp_sig_and_wait] = ev_sig_and_wait,
+	[rtapp_broadcast] = ev_broadcast,
+	[rtapp_sleep] = ev_sleep,
+	[rtapp_run] = ev_run,
+	[rtapp_runtime] = ev_runtime,
+	[rtapp_timer] = ev_timer,
+	[rtapp_timer_unique] = ev_timer,
+	[rtapp_suspend] = ev_suspend,
+	[rtapp_resume] = ev_resume,
+	[rtapp_mem] = ev_mem,
+	[rtapp_mem_write] = ev_mem_write,
+	[rtapp_mem_read] = ev_mem_read,
+	[rtapp_mem_chase] = ev_mem_chase,
+	[rtapp_mem_stream] = ev_mem_stream,
+	[rtapp_iorun] = ev_iorun,
+	[rtapp_yield] = ev_yield,
+	[rtapp_fork] = ev_fork,
+	[rtapp_sem_post] = ev_sem_post,
+	[rtapp_cputime] = ev_cputime,
+	[rtapp_sem_wait] = ev_sem_wait,
+	[rtapp_push] = ev_push,
+	[rtapp_pop] = ev_pop,
+	[rtapp_migrate_pages] = ev_migrate_pages,
+};
+
+static rtapp_resource_t *resolve_resource(rtapp_resources_t *table, int idx)
+{
+	if (idx < 0 || idx >= table->nresources)
+		return NULL;
+
+	return &table->resources[idx];
+}
+
+/*
+ * Compile the phases of a thread into programs of pre-resolved ops.
+ *
+ * This can't be done while parsing: the global resources table is realloc'ed
+ * each time a new resource is found and the "unique" timers live in the local
+ * resources which are duplicated for each thread in create_thread().
+ */
+static int thread_data_compile_phases(thread_data_t *tdata)
+{
+	rtapp_resources_t *global = *(tdata->global_resources);
+	int i, j;
+
+	tdata->progs = calloc(tdata->nphases, sizeof(phase_prog_t));
+	if (!tdata->progs) {
+		log_error("Failed to allocate phase programs: %s", tdata->name);
+		return -1;
+	}
+
+	for (i = 0; i < tdata->nphases; i++) {
+		phase_data_t *pdata = &tdata->phases[i];
+		phase_prog_t *prog = &tdata->progs[i];
+
+		prog->events = pdata->events;
+		prog->nbevents = pdata->nbevents;
+		prog->phase = i;
+		prog->markers = NULL;
+		prog->ops = calloc(pdata->nbevents, sizeof(event_op_t));
+		if (!prog->ops) {
+			log_error("Failed to allocate phase program: %s", tdata->name);
+			return -1;
+		}
+
+		for (j = 0; j < pdata->nbevents; j++) {
+			event_data_t *event = &pdata->events[j];
+			event_op_t *op = &prog->ops[j];
+			rtapp_resources_t *table = global;
+
+			/* Unique timer uses local resources */
+			if (event->type == rtapp_timer_unique)
+				table = tdata->local_resources;
+
+			if (event->type < sizeof(event_handlers) / sizeof(event_handlers[0]))
+				op->handler = event_handlers[event->type];
+			if (!op->handler)
+				op->handler = ev_nop;
+
+			op->rdata = resolve_resource(table, event->res);
+			op->ddata = resolve_resource(global, event->dep);
+			op->kernel = &burn_kernels[event->kernel];
+			op->duration = event->duration;
+			op->count = event->count;
+			if (event->type == rtapp_lock || event->type == rtapp_unlock)
+				op->flags |= EVENT_OP_LOCK;
+		}
+
+		/* The raw events are named by rtapp_event_desc markers */
+		if (ft_data.raw_fd < 0)
+			prog->markers = ftrace_event_markers(prog);
+	}
+
+	return 0;
+}
+
+/* Compile the phases of the task @td once for all its threads */
+static int thread_data_share_phases(thread_data_t *td)
+{
+	static pthread_mutex_t share_mutex = PTHREAD_MUTEX_INITIALIZER;
+	int ret = 0;
+
+	pthread_mutex_lock(&share_mutex);
+	if (!td->progs_shared) {
+		ret = thread_data_compile_phases(td);
+		td->progs_shared = !ret;
+	}
+	pthread_mutex_unlock(&share_mutex);
+
+	return ret;
+}
+
+static void thread_data_free_phases(thread_data_t *tdata)
+{
+	int i;
+
+	/* the shared ones belong to the task */
+	if (!tdata->progs || tdata->progs_shared)
+		return;
+
+	for (i = 0; i < tdata->nphases; i++) {
+		free(tdata->progs[i].ops);
+		free(tdata->progs[i].markers);
+	}
+	free(tdata->progs);
+	tdata->progs = NULL;
+}
+
+int run(thread_data_t *tdata,
+	phase_prog_t *prog,
+	struct timespec *t_first,
+	log_data_t *ldata)
+{
+	event_ctx_t ctx = {
+		.tdata = tdata,
+		.t_first = t_first,
+		.ldata = ldata,
+		.perf = 0,
+		.marker_fd = ft_data.marker_fd,
+		.raw_fd = ft_data.raw_fd,
+		.timeline = tdata->timeline,
+	};
+
+	/* Select the variant of the loop once per phase, not per event */
+	if (prog_traced() || ctx.timeline)
+		prog_run(prog, &ctx, &continue_running, 1);
+	else
+		prog_run(prog, &ctx, &continue_running, 0);
+
+	return ctx.perf;
+}
+
+static void setup_main_gnuplot(void);
+
+static pthread_t hist_thread;
+static int hist_thread_started;
+
+static void report_dmiss_stats(const char *who, const dmiss_stats_t *dmiss)
+{
+	if (!dmiss->activations)
+		return;
+
+	log_notice("%s: %lu missed activations out of %lu, %lu max consecutive,"
+		   " overrun mean %llu max %ld usec",
+		   who, dmiss->misses, dmiss->activations,
+		   dmiss->max_consecutive,
+		   dmiss->misses ? dmiss->overrun_sum / dmiss->misses : 0,
+		   dmiss->overrun_max);
+}
+
+static void report_lat(const char *who, const lat_stats_t *lat)
+{
+	if (!lat->wakeups)
+		return;
+
+	log_notice("%s: %lu wake ups, latency mean %.1f max %.1f usec",
+		   who, lat->wakeups, lat->lat_sum / 1000.0 / lat->wakeups,
+		   lat->lat_max / 1000.0);
+}
+
+/* Add the wake up latencies of @lat to the ones of @sum */
+static void lat_stats_add(lat_stats_t *sum, const lat_stats_t *lat)
+{
+	sum->wakeups += lat->wakeups;
+	sum->lat_sum += lat->lat_sum;
+	if (lat->lat_max > sum->lat_max)
+		sum->lat_max = lat->lat_max;
+}
+
+static void report_timers(rtapp_resources_t *table, lat_stats_t *backends)
+{
+	char who[64];
+	int i;
+
+	for (i = 0; i < table->nresources; i++) {
+		rtapp_resource_t *rdata = &table->resources[i];
+		struct _rtapp_timer *timer = &rdata->res.timer;
+
+		if (rdata->type != rtapp_timer &&
+		    rdata->type != rtapp_timer_unique)
+			continue;
+
+		snprintf(who, sizeof(who), "timer %s", rdata->name);
+		report_dmiss_stats(who, &timer->dmiss);
+		snprintf(who, sizeof(who), "timer %s (%s)", rdata->name,
+			 timer_backend_name(timer->backend));
+		report_lat(who, &timer->lat);
+		lat_stats_add(&backends[timer->backend], &timer->lat);
+	}
+}
+
+/*
+ * Missed activations of the timers per task and per timer, and wake up
+ * latency per timer and per backend
+ */
+static void report_dmiss(void)
+{
+	lat_stats_t backends[timer_backends];
+	char who[64];
+	int i;
+
+	memset(backends, 0, sizeof(backends));
+
+	for (i = 0; i < running_threads; i++) {
+		thread_data_t *tdata = thread_slot(i)->data;
+
+		snprintf(who, sizeof(who), "[%d] %s", tdata->ind, tdata->name);
+		report_dmiss_stats(who, &tdata->dmiss);
+		if (tdata->dl_overruns)
+			log_notice("%s: %lu SCHED_DEADLINE runtime overruns",
+				   who, tdata->dl_overruns);
+		report_timers(tdata->local_resources, backends);
+	}
+	report_timers(opts.resources, backends);
+
+	for (i = 0; i < timer_backends; i++) {
+		snprintf(who, sizeof(who), "%s timers",
+			 timer_backend_name(i));
+		report_lat(who, &backends[i]);
+	}
+}
+
+/* Latency between the fork events and the first loop of the forked threads */
+static void report_forks(void)
+{
+	rtapp_resources_t *table = opts.resources;
+	int i;
+
+	for (i = 0; i < table->nresources; i++) {
+		rtapp_resource_t *rdata = &table->resources[i];
+		fork_stats_t *stats = &rdata->res.fork.stats;
+
+		if (rdata->type != rtapp_fork || !stats->forks)
+			continue;
+
+		log_notice("fork %s: %lu forks, %lu from a pool of %d, latency"
+			   " min %.1f mean %.1f max %.1f usec",
+			   rdata->res.fork.ref, stats->forks, stats->pooled,
+			   rdata->res.fork.pool, stats->lat_min / 1000.0,
+			   stats->lat_sum / 1000.0 / stats->forks,
+			   stats->lat_max / 1000.0);
+	}
+}
+
+/* How the waits on the wait, barrier and semaphore resources went */
+static void report_sync(void)
+{
+	rtapp_resources_t *table = opts.resources;
+	int i;
+
+	for (i = 0; i < table->nresources; i++) {
+		rtapp_resource_t *rdata = &table->resources[i];
+		sync_wait_t *sync;
+
+		switch (rdata->type) {
+		case rtapp_wait:
+			sync = &rdata->res.cond.sync;
+			break;
+		case rtapp_barrier:
+			sync = &rdata->res.barrier.sync;
+			break;
+		case rtapp_sem_post:
+			sync = &rdata->res.sem.sync;
+			break;
+		default:
+			continue;
+		}
+
+		if (!sync->waits)
+			continue;
+
+		log_notice("%s (%s): %lu waits, %lu polls, %lu sleeps",
+			   rdata->name, sync_strategy_name(sync->strategy),
+			   sync->waits, sync->spins, sync->sleeps);
+	}
+}
+
+/*
+ * Latency between the wakers and the wakees of the wait and semaphore
+ * resources, and per order of return when a wake up woke several wakees.
+ */
+static void report_wakeups(void)
+{
+	rtapp_resources_t *table = opts.resources;
+	wake_stamp_t *wake;
+	char who[64];
+	int i, r;
+
+	for (i = 0; i < table->nresources; i++) {
+		rtapp_resource_t *rdata = &table->resources[i];
+
+		if (rdata->type == rtapp_wait)
+			wake = &rdata->res.cond.wake;
+		else if (rdata->type == rtapp_sem_post)
+			wake = &rdata->res.sem.wake;
+		else
+			continue;
+
+		snprintf(who, sizeof(who), "%s wakees", rdata->name);
+		report_lat(who, &wake->lat);
+		if (!wake->ranks[1].wakeups)
+			continue;
+
+		for (r = 0; r < WAKE_LAT_RANKS; r++) {
+			snprintf(who, sizeof(who), "%s wakee %d%s", rdata->name,
+				 r + 1, r == WAKE_LAT_RANKS - 1 ? "+" : "");
+			report_lat(who, &wake->ranks[r]);
+		}
+	}
+}
+
+/* Occupancy, time in queue and lost messages of the queues */
+static void report_queues(void)
+{
+	rtapp_resources_t *table = opts.resources;
+	int i;
+
+	for (i = 0; i < table->nresources; i++) {
+		rtapp_resource_t *rdata = &table->resources[i];
+		queue_ring_t *q = rdata->res.queue.ring;
+
+		if (rdata->type != rtapp_push || (!q->pushes && !q->pops))
+			continue;
+
+		log_notice("queue %s: %lu pushes, %lu dropped, %lu waited for a"
+			   " slot, depth mean %.1f max %ld of %d",
+			   rdata->name, q->pushes, q->drops, q->full_waits,
+			   q->pushes ? (double)q->depth_sum / q->pushes : 0.0,
+			   q->depth_max, rdata->res.queue.capacity);
+		log_notice("queue %s: %lu pops, %lu missed, %lu waited for a"
+			   " message, time in queue mean %.1f max %.1f usec",
+			   rdata->name, q->pops, q->misses, q->empty_waits,
+			   q->pops ? q->lat_sum / 1000.0 / q->pops : 0.0,
+			   q->lat_max / 1000.0);
+	}
+}
+
+/* Time and throughput of the migrate_pages events of the memory buffers */
+static void report_migrations(void)
+{
+	rtapp_resources_t *table = opts.resources;
+	int i;
+
+	for (i = 0; i < table->nresources; i++) {
+		mem_migrate_t *m = &table->resources[i].migrate;
+
+		if (!m->count)
+			continue;
+
+		log_notice("%s: %lu migrations, %lu failed, mean %.1f max %.1f"
+			   " usec, %llu kB requested, %llu kB moved, %llu MB/s",
+			   table->resources[i].name, m->count, m->failed,
+			   m->ns / 1000.0 / m->count, m->max_ns / 1000.0,
+			   m->bytes >> 10, m->moved >> 10,
+			   m->ns ? m->moved * 1000 / m->ns : 0);
+	}
+}
+
+/* Delay between the start of the use case and the start of the threads */
+static void report_start_skew(void)
+{
+	long min = LONG_MAX, max = -1;
+	long long sum = 0;
+	int i, nr = 0, last = -1;
+
+	for (i = 0; i < running_threads; i++) {
+		thread_data_t *tdata = thread_slot(i)->data;
+
+		/* the forked threads don't start with the use case */
+		if (tdata->start_skew < 0)
+			continue;
+
+		nr++;
+		sum += tdata->start_skew;
+		if (tdata->start_skew < min)
+			min = tdata->start_skew;
+		if (tdata->start_skew > max) {
+			max = tdata->start_skew;
+			last = i;
+		}
+	}
+
+	if (!nr)
+		return;
+
+	log_notice("start skew of %d threads: min %ld mean %lld max %ld ns,"
+		   " last started is [%d] %s", nr, min, sum / nr, max,
+		   thread_slot(last)->data->ind, thread_slot(last)->data->name);
+}
+
+/* Page faults taken by the threads while running their phases */
+static void report_faults(void)
+{
+	long minflt = 0, majflt = 0;
+	int i;
+
+	for (i = 0; i < running_threads; i++) {
+		thread_data_t *tdata = thread_slot(i)->data;
+
+		if (tdata->minflt || tdata->majflt)
+			log_notice("[%d] %s: %ld minor and %ld major page faults",
+				   tdata->ind, tdata->name, tdata->minflt,
+				   tdata->majflt);
+		minflt += tdata->minflt;
+		majflt += tdata->majflt;
+	}
+
+	log_notice("%ld minor and %ld major page faults while running the phases",
+		   minflt, majflt);
+}
+
+/* SCHED_FLAG_DL_OVERRUN: the task has exceeded its runtime */
+static void dl_overrun(int sig)
+{
+	if (self_data)
+		self_data->dl_overruns++;
+}
+
+/*
+ * Write the histograms summary in <logdir>/<log_basename>-hist.{txt,json}
+ * and, if @out is set, in @out. The files are replaced atomically so that a
+ * periodic dump can be read at any time.
+ */
+static void dump_histograms(FILE *out)
+{
+	thread_data_t **tdata;
+	char tmp[PATH_LENGTH], path[PATH_LENGTH];
+	FILE *text = NULL, *json = NULL;
+	int i, nr;
+
+	pthread_mutex_lock(&fork_mutex);
+
+	nr = running_threads;
+	tdata = malloc(nr * sizeof(*tdata));
+	if (!tdata) {
+		pthread_mutex_unlock(&fork_mutex);
+		log_error("Cannot allocate histograms summary");
+		return;
+	}
+	for (i = 0; i < nr; i++)
+		tdata[i] = thread_slot(i)->data;
+
+	if (out)
+		hist_report(tdata, nr, out, NULL);
+
+	if (opts.logdir) {
+		snprintf(tmp, PATH_LENGTH, "%s/%s-hist.txt.tmp",
+			 opts.logdir, opts.logbasename);
+		text = fopen(tmp, "w");
+		snprintf(tmp, PATH_LENGTH, "%s/%s-hist.json.tmp",
+			 opts.logdir, opts.logbasename);
+		json = fopen(tmp, "w");
+		if (!text || !json)
+			log_error("Cannot write histograms in %s", opts.logdir);
+		else
+			hist_report(tdata, nr, text, json);
+	}
+
+	pthread_mutex_unlock(&fork_mutex);
+	free(tdata);
+
+	if (text) {
+		fclose(text);
+		snprintf(tmp, PATH_LENGTH, "%s/%s-hist.txt.tmp",
+			 opts.logdir, opts.logbasename);
+		snprintf(path, PATH_LENGTH, "%s/%s-hist.txt",
+			 opts.logdir, opts.logbasename);
+		rename(tmp, path);
+	}
+	if (json) {
+		fclose(json);
+		snprintf(tmp, PATH_LENGTH, "%s/%s-hist.json.tmp",
+			 opts.logdir, opts.logbasename);
+		snprintf(path, PATH_LENGTH, "%s/%s-hist.json",
+			 opts.logdir, opts.logbasename);
+		rename(tmp, path);
+	}
+}
+
+/* Write the timeline of all the threads in <logdir>/<log_basename>-timeline.json */
+static void dump_timeline(void)
+{
+	thread_data_t **tdata;
+	char path[PATH_LENGTH];
+	int i;
+
+	if (!opts.logdir) {
+		log_error("The timeline needs a logdir");
+		return;
+	}
+
+	tdata = malloc(running_threads * sizeof(*tdata));
+	if (!tdata) {
+		log_error("Cannot allocate timeline");
+		return;
+	}
+	for (i = 0; i < running_threads; i++)
+		tdata[i] = thread_slot(i)->data;
+
+	snprintf(path, PATH_LENGTH, "%s/%s-timeline.json",
+		 opts.logdir, opts.logbasename);
+	timeline_write(path, tdata, running_threads, &t_zero, opts.resources);
+
+	free(tdata);
+}
+
+/*
+ * The tasks keep updating the histograms while they are dumped so a periodic
+ * summary is only a close approximation of the state at the time of the dump.
+ */
+static void *hist_thread_body(void *arg)
+{
+	pthread_setname_np(pthread_self(), "rt-app-hist");
+
+	while (1) {
+		sleep(opts.hist_interval);
+		/* don't leave fork_mutex locked if cancelled by __shutdown() */
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+		dump_histograms(NULL);
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+	}
 
-	return lock;
+	return NULL;
 }
 
-int run(thread_data_t *tdata,
-	phase_data_t *pdata,
-	struct timespec *t_first,
-	log_data_t *ldata)
+/* Join the threads not joined yet, but the parked ones unless @parked */
+static void join_threads(int parked)
 {
-	event_data_t *events = pdata->events;
-	int ind = tdata->ind;
-	int nbevents = pdata->nbevents;
-	int i, lock = 0;
-	unsigned long perf = 0;
+	int i;
 
-	for (i = 0; i < nbevents; i++)
+	for (i = 0; i < running_threads; i++)
 	{
-		if (!continue_running && !lock)
-			return perf;
+		pthread_data_t *slot = thread_slot(i);
+		int ret;
 
-		log_debug("[%d] runs events %d type %d ", ind, i, events[i].type);
-		log_ftrace(ft_data.marker_fd, FTRACE_EVENT,
-			   "rtapp_event: id=%d type=%d desc=%s",
-			   i, events[i].type, events[i].name);
-		lock += run_event(&events[i], !continue_running, &perf,
-				  tdata, t_first, ldata);
-	}
+		if (slot->joined || (!parked && slot->data->fork_pooled))
+			continue;
 
-	return perf;
+		ret = pthread_join(slot->thread, NULL);
+		if (ret)
+			perror("pthread_join() failed");
+		slot->joined = 1;
+	}
 }
 
-static void setup_main_gnuplot(void);
-
 static void __shutdown(bool force_terminate)
 {
+	struct rusage usage;
 	int i;
 
 	if(!continue_running)
@@ -765,7 +1733,7 @@ static void __shutdown(bool force_terminate)
 		pthread_mutex_lock(&fork_mutex);
 
 		for (i = 0; i < running_threads; i++)
-			pthread_cancel(threads[i].thread);
+			pthread_cancel(thread_slot(i)->thread);
 
 		pthread_mutex_unlock(&fork_mutex);
 	}
@@ -790,13 +1758,36 @@ static void __shutdown(bool force_terminate)
 	 * guaranteed to check against the updated value in each iteration.
 	 * Hence we are guaranteed to wait for all forked threads beside the
 	 * originally created ones at startup time.
+	 *
+	 * The threads parked in a fork pool only leave once the others, which
+	 * can still fork, have finished.
 	 */
-	for (i = 0; i < running_threads; i++)
-	{
-		int ret = pthread_join(threads[i].thread, NULL);
-		if (ret)
-			perror("pthread_join() failed");
+	join_threads(0);
+	fork_pools_release();
+	join_threads(1);
+	fork_pools_free();
+
+	if (!getrusage(RUSAGE_SELF, &usage))
+		log_notice("peak RSS %ld kB", usage.ru_maxrss);
+
+	if (hist_thread_started) {
+		pthread_cancel(hist_thread);
+		pthread_join(hist_thread, NULL);
 	}
+	report_dmiss();
+	report_forks();
+	report_sync();
+	report_wakeups();
+	report_queues();
+	report_migrations();
+	report_start_skew();
+	report_faults();
+
+	if (opts.histogram)
+		dump_histograms(stdout);
+
+	if (opts.timeline)
+		dump_timeline();
 
 	/*
 	 * Set main gnuplot files
@@ -812,17 +1803,31 @@ static void __shutdown(bool force_terminate)
 	 */
 	for (i = 0; i < running_threads; i++)
 	{
+		/* The thread may have been cancelled before closing its log */
+		if (thread_slot(i)->data->binlog && !thread_slot(i)->data->log_ring)
+			binlog_close(thread_slot(i)->data->binlog);
+
 		/* clean up tdata if this was a forked thread */
-		free(threads[i].data->name);
-		free(threads[i].data);
+		thread_data_free_phases(thread_slot(i)->data);
+		hist_thread_free(thread_slot(i)->data);
+		timeline_thread_free(thread_slot(i)->data);
+		free(thread_slot(i)->data->name);
+		free(thread_slot(i)->data);
 	}
 
+	/* Write the records left in the rings and close the logs */
+	logger_stop();
+	if (log_sink)
+		fclose(log_sink);
+
 
 	log_ftrace(ft_data.marker_fd, FTRACE_MAIN,
 		   "rtapp_main: event=end");
 	if (ftrace_level) {
 		log_notice("deconfiguring ftrace");
 		close(ft_data.marker_fd);
+		if (ft_data.raw_fd >= 0)
+			close(ft_data.raw_fd);
 	}
 
 	remove_cgroups();
@@ -833,7 +1838,35 @@ static void __shutdown(bool force_terminate)
 	 * terminate the application and release all resources - we don't
 	 * really need to unlock the mutex anyway.
 	 */
-	exit(EXIT_SUCCESS);
+	exit(exit_status);
+}
+
+/*
+ * Let the threads finish their current loop, for up to graceful_stop msec.
+ * Returns true if they all did, false if some are still running.
+ */
+static bool stop_gracefully(void)
+{
+	struct timespec t_now, t_end, t_poll = msec_to_timespec(1);
+	struct timespec grace = msec_to_timespec(opts.graceful_stop);
+
+	clock_gettime(CLOCK_MONOTONIC, &t_now);
+	t_end = timespec_add(&t_now, &grace);
+
+	stop_loops = 1;
+	while (__atomic_load_n(&threads_looping, __ATOMIC_RELAXED) > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &t_now);
+		if (!timespec_lower(&t_now, &t_end)) {
+			log_notice("%d threads didn't finish their loop in %d ms",
+				   __atomic_load_n(&threads_looping,
+						   __ATOMIC_RELAXED),
+				   opts.graceful_stop);
+			return false;
+		}
+		nanosleep(&t_poll, NULL);
+	}
+
+	return true;
 }
 
 static void
@@ -846,20 +1879,20 @@ static int create_cpuset_str(cpuset_data_t *cpu_data)
 {
 	unsigned int cpu_count = CPU_COUNT_S(cpu_data->cpusetsize,
 							cpu_data->cpuset);
+	unsigned int nr_cpus = cpu_data->cpusetsize * 8;
 	unsigned int i;
 	unsigned int idx = 0;
 
 	/*
-	 * Assume we can go up to 9999 cpus. Each cpu would take up to 4 + 2
-	 * bytes (4 for the number and 2 for the comma and space). 2 bytes
-	 * for beginning bracket + space and 2 bytes for end bracket and space
-	 * and finally null-terminator.
+	 * Each cpu takes its number of digits + 2 bytes for the comma and
+	 * space. 2 bytes for beginning bracket + space and 2 bytes for end
+	 * bracket and space and finally null-terminator.
 	 */
-	unsigned int size_needed = cpu_count * 6 + 2 + 2 + 1;
+	size_t size_needed = 2 + 2 + 1;
 
-	if (cpu_count > 9999) {
-		log_error("Too many cpus specified. Up to 9999 cpus supported");
-		exit(EXIT_FAILURE);
+	for (i = 0; i < nr_cpus; i++) {
+		if (CPU_ISSET_S(i, cpu_data->cpusetsize, cpu_data->cpuset))
+			size_needed += snprintf(NULL, 0, "%u", i) + 2;
 	}
 
 	cpu_data->cpuset_str = malloc(size_needed);
@@ -871,39 +1904,34 @@ static int create_cpuset_str(cpuset_data_t *cpu_data)
 	strcpy(cpu_data->cpuset_str, "[ ");
 	idx += 2;
 
-	for (i = 0; i < 10000 && cpu_count; ++i) {
-		unsigned int n;
-
-		if (CPU_ISSET(i, cpu_data->cpuset)) {
+	for (i = 0; i < nr_cpus && cpu_count; ++i) {
+		if (CPU_ISSET_S(i, cpu_data->cpusetsize, cpu_data->cpuset)) {
 			--cpu_count;
-			if (size_needed <= (idx + 1)) {
-				log_error("Not enough memory for array");
-				exit(EXIT_FAILURE);
-			}
-			n = snprintf(&cpu_data->cpuset_str[idx],
-						size_needed - idx - 1, "%u", i);
-			if (n > 0) {
-				idx += n;
-			} else {
-				log_error("Error creating array");
-				exit(EXIT_FAILURE);
-			}
-			if (size_needed <= (idx + 1)) {
-				log_error("Not enough memory for array");
-				exit(EXIT_FAILURE);
-			}
-			if (cpu_count) {
-				strncat(cpu_data->cpuset_str, ", ",
-							size_needed - idx - 1);
-				idx += 2;
-			}
+			idx += snprintf(&cpu_data->cpuset_str[idx],
+					size_needed - idx, "%u%s", i,
+					cpu_count ? ", " : "");
 		}
 	}
-	strncat(cpu_data->cpuset_str, " ]", size_needed - idx - 1);
+	snprintf(&cpu_data->cpuset_str[idx], size_needed - idx, " ]");
 
 	return 0;
 }
 
+/* Return the CPU of a cpuset made of a single CPU, -1 otherwise */
+static int cpuset_single_cpu(cpuset_data_t *cpu_data)
+{
+	int cpu;
+
+	if (CPU_COUNT_S(cpu_data->cpusetsize, cpu_data->cpuset) != 1)
+		return -1;
+
+	for (cpu = 0; cpu < cpu_data->cpusetsize * 8; cpu++)
+		if (CPU_ISSET_S(cpu, cpu_data->cpusetsize, cpu_data->cpuset))
+			return cpu;
+
+	return -1;
+}
+
 static void set_thread_affinity(thread_data_t *data, cpuset_data_t *cpu_data)
 {
 	int ret;
@@ -912,7 +1940,6 @@ static void set_thread_affinity(thread_data_t *data, cpuset_data_t *cpu_data)
 	if (data->def_cpu_data.cpuset == NULL) {
 		/* Get default affinity */
 		cpu_set_t cpuset;
-		unsigned int cpu_count;
 
 		ret = pthread_getaffinity_np(pthread_self(),
 						    sizeof(cpu_set_t), &cpuset);
@@ -921,9 +1948,8 @@ static void set_thread_affinity(thread_data_t *data, cpuset_data_t *cpu_data)
 			perror("pthread_get_affinity");
 			exit(EXIT_FAILURE);
 		}
-		cpu_count = CPU_COUNT(&cpuset);
-		data->def_cpu_data.cpusetsize = CPU_ALLOC_SIZE(cpu_count);
-		data->def_cpu_data.cpuset = CPU_ALLOC(cpu_count);
+		data->def_cpu_data.cpusetsize = CPU_ALLOC_SIZE(CPU_SETSIZE);
+		data->def_cpu_data.cpuset = CPU_ALLOC(CPU_SETSIZE);
 		memcpy(data->def_cpu_data.cpuset, &cpuset,
 						data->def_cpu_data.cpusetsize);
 		create_cpuset_str(&data->def_cpu_data);
@@ -942,7 +1968,10 @@ static void set_thread_affinity(thread_data_t *data, cpuset_data_t *cpu_data)
 	if (actual_cpu_data->cpuset == NULL)
 		actual_cpu_data = &data->def_cpu_data;
 
-	if (!CPU_EQUAL(actual_cpu_data->cpuset, data->curr_cpu_data->cpuset))
+	/* the sets are allocated for different numbers of cpus */
+	if (actual_cpu_data->cpusetsize != data->curr_cpu_data->cpusetsize ||
+	    !CPU_EQUAL_S(actual_cpu_data->cpusetsize, actual_cpu_data->cpuset,
+			 data->curr_cpu_data->cpuset))
 	{
 		log_debug("[%d] setting cpu affinity to CPU(s) %s", data->ind,
 			actual_cpu_data->cpuset_str);
@@ -955,6 +1984,9 @@ static void set_thread_affinity(thread_data_t *data, cpuset_data_t *cpu_data)
 			exit(EXIT_FAILURE);
 		}
 		data->curr_cpu_data = actual_cpu_data;
+
+		/* run events can skip looking for the current CPU */
+		data->run_cpu = cpuset_single_cpu(actual_cpu_data);
 	}
 }
 
@@ -1137,6 +2169,8 @@ static void _set_thread_deadline(thread_data_t *data, sched_data_t *sched_data)
 	sa_params.sched_runtime = sched_data->runtime;
 	sa_params.sched_deadline = sched_data->deadline;
 	sa_params.sched_period = sched_data->period;
+	if (sched_data->dl_overrun)
+		sa_params.sched_flags |= SCHED_FLAG_DL_OVERRUN;
 
 	ret = sched_setattr(tid, &sa_params, flags);
 	if (ret) {
@@ -1233,10 +2267,233 @@ static void set_thread_param(thread_data_t *data, sched_data_t *sched_data)
 
 void setup_thread_gnuplot(thread_data_t *tdata);
 
+/* Fault in, and lock if @lock, a region used by the thread, returns its size */
+static size_t thread_region(thread_data_t *data, int lock, void *addr,
+			    size_t len)
+{
+	if (!addr || !len)
+		return 0;
+
+	pages_prefault(addr, len);
+	if (lock && pages_lock(addr, len)) {
+		perror("mlock");
+		exit(EXIT_FAILURE);
+	}
+
+	return len;
+}
+
+/* Buffer of the thread for the payloads of its copy queues */
+static void thread_alloc_payload(thread_data_t *data)
+{
+	int i, j, size = 0;
+
+	for (i = 0; i < data->nphases; i++) {
+		phase_prog_t *prog = &data->progs[i];
+
+		for (j = 0; j < prog->nbevents; j++) {
+			rtapp_resource_t *rdata = prog->ops[j].rdata;
+
+			if (rdata && rdata->type == rtapp_push &&
+			    rdata->res.queue.copy &&
+			    rdata->res.queue.size > size)
+				size = rdata->res.queue.size;
+		}
+	}
+
+	data->payload = NULL;
+	data->payload_size = size;
+	if (!size)
+		return;
+
+	data->payload = malloc(size);
+	if (!data->payload) {
+		log_error("Failed to allocate the payload buffer of %s",
+			  data->name);
+		exit(EXIT_FAILURE);
+	}
+	memset(data->payload, 0, size);
+}
+
+/*
+ * Initialize the buffers of the memory resources allocated with first_touch
+ * which the thread is the first one to use, from the CPUs and memory nodes of
+ * the first phase which uses each of them.
+ */
+static void thread_first_touch(thread_data_t *data)
+{
+	int i, j;
+
+	set_thread_membind(data, &data->numa_data);
+
+	for (i = 0; i < data->nphases; i++) {
+		phase_prog_t *prog = &data->progs[i];
+
+		for (j = 0; j < prog->nbevents; j++) {
+			rtapp_resource_t *rdata = prog->ops[j].rdata;
+
+			if (!rdata || rdata->alloc.node != MEM_NODE_FIRST_TOUCH ||
+			    __atomic_load_n(&rdata->alloc.touched,
+					    __ATOMIC_ACQUIRE) == 2)
+				continue;
+
+			set_thread_affinity(data, &data->phases[i].cpu_data);
+			set_thread_membind(data, &data->phases[i].numa_data);
+			mem_resource_touch(rdata);
+		}
+	}
+}
+
+/*
+ * Claim the faulting in, and the locking with @lock, of the buffers of
+ * @rdata. Returns 0 if another thread of the use case has already done it:
+ * the resources are shared by the instances of a task and with "ref", so
+ * their buffers are faulted in on the nodes of the first thread and
+ * accounted once.
+ */
+static int thread_claim_resource(rtapp_resource_t *rdata, int lock)
+{
+	int todo = PAGES_FAULTED | (lock ? PAGES_LOCKED : 0);
+	int done;
+
+	done = __atomic_fetch_or(&rdata->prepared, todo, __ATOMIC_RELAXED);
+	return (done & todo) != todo;
+}
+
+/*
+ * Fault in the memory that the thread uses while running its phases: its
+ * stack, only the stack_lock bytes at its top for the default stack of the
+ * libc, its timing buffer, the buffers of its memory events and the rings
+ * of its queues, and lock it
+ * with lock_pages. The thread does it itself before the use case starts so
+ * that the first loops don't take the page faults and that the pages are
+ * allocated on its memory nodes. The fair policies don't lock any page.
+ */
+static void thread_prepare_pages(thread_data_t *data, void *timings,
+				 size_t timings_len)
+{
+	policy_t policy = data->sched_data->policy;
+	int lock = data->lock_pages == LOCK_PAGES_THREAD &&
+		   policy != other && policy != batch && policy != idle;
+	size_t stack_len, len = 0;
+	void *stack;
+	int i, j;
+
+	if (!lock && !data->prefault)
+		return;
+
+	set_thread_membind(data, &data->numa_data);
+
+	if (!pages_stack(&stack, &stack_len)) {
+		/* the stack grows down from its top */
+		if (!data->stack_size && data->stack_lock < stack_len) {
+			stack = (char *)stack + stack_len - data->stack_lock;
+			stack_len = data->stack_lock;
+		}
+		len += thread_region(data, lock, stack, stack_len);
+	}
+	len += thread_region(data, lock, timings, timings_len);
+	len += thread_region(data, lock, data->payload, data->payload_size);
+
+	for (i = 0; i < data->nphases; i++) {
+		phase_prog_t *prog = &data->progs[i];
+
+		for (j = 0; j < prog->nbevents; j++) {
+			rtapp_resource_t *rdata = prog->ops[j].rdata;
+
+			if (!rdata || !thread_claim_resource(rdata, lock))
+				continue;
+
+			switch (rdata->type) {
+			case rtapp_mem:
+			case rtapp_mem_write:
+			case rtapp_mem_read:
+			case rtapp_iorun:
+				len += thread_region(data, lock, rdata->res.buf.ptr,
+						     rdata->res.buf.size);
+				break;
+			case rtapp_mem_chase:
+				len += thread_region(data, lock,
+						     rdata->res.chase.base,
+						     rdata->res.chase.len);
+				break;
+			case rtapp_mem_stream: {
+				struct _rtapp_mem_stream_buf *stream = &rdata->res.stream;
+
+				len += thread_region(data, lock, stream->a,
+						     stream->size);
+				len += thread_region(data, lock, stream->b,
+						     stream->size);
+				if (stream->c)
+					len += thread_region(data, lock,
+							     stream->c,
+							     stream->size);
+				break;
+			}
+			case rtapp_push: {
+				struct _rtapp_queue *queue = &rdata->res.queue;
+
+				len += thread_region(data, lock,
+						     queue->ring->slots,
+						     queue->capacity *
+						     sizeof(queue_slot_t));
+				len += thread_region(data, lock,
+						     queue->ring->payloads,
+						     (size_t)queue->capacity *
+						     queue->size);
+				break;
+			}
+			default:
+				break;
+			}
+		}
+	}
+
+	log_notice("[%d] %zu kB %s", data->ind, len >> 10,
+		   lock ? "locked in memory" : "faulted in");
+}
+
+/*
+ * Wait for the start of the use case @t: sleep until start_spin usec before
+ * it and poll the clock until it. Returns how late we are, in ns.
+ */
+static long wait_start(struct timespec *t)
+{
+	struct timespec t_now, t_wake = *t;
+
+	if (opts.start_spin) {
+		struct timespec spin = usec_to_timespec(opts.start_spin);
+
+		t_wake = timespec_sub(t, &spin);
+	}
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t_wake, NULL);
+
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &t_now);
+	} while (timespec_lower(&t_now, t));
+
+	return timespec_sub_to_ns(&t_now, t);
+}
+
+static void log_header(FILE *log)
+{
+	int i;
+
+	fprintf(log, "%s %8s %8s %8s %15s %15s %15s %10s %10s %10s %10s %10s %10s %10s",
+		"#idx", "perf", "run", "period",
+		"start", "end", "rel_st", "slack",
+		"c_duration", "c_period", "wu_lat", "ovr_ns", "mem_bw",
+		"chase_ns");
+	for (i = 0; i < pmu.nr; i++)
+		fprintf(log, " %14s", pmu_event_name(pmu.ids[i]));
+	fprintf(log, "\n");
+}
+
 void *thread_body(void *arg)
 {
 	thread_data_t *data = (thread_data_t*) arg;
 	phase_data_t *pdata;
+	phase_prog_t *prog;
 	log_data_t ldata;
 	struct sched_param param;
 	struct timespec t_start, t_end, t_first;
@@ -1246,8 +2503,16 @@ void *thread_body(void *arg)
 	timing_point_t *timings;
 	timing_point_t tmp_timing;
 	unsigned int timings_size, timing_loop;
+	unsigned long nr_timings = 0;
 	struct sched_attr attr;
-	int ret, phase, phase_loop, thread_loop, log_idx;
+	struct rusage usage;
+	long minflt, majflt;
+	pmu_thread_t pmu_thread;
+	timeline_t *tl = data->timeline;
+	int ret, phase, phase_loop, thread_loop, log_idx, i;
+
+	/* For the handler of the SIGXCPU sent to this thread */
+	self_data = data;
 
 	/* Set thread name */
 	ret = pthread_setname_np(pthread_self(), data->name);
@@ -1257,9 +2522,10 @@ void *thread_body(void *arg)
 
 	/* Get the 1st phase's data */
 	pdata = &data->phases[0];
+	prog = &data->progs[0];
 
-	/* Init timing buffer */
-	if (opts.logsize > 0) {
+	/* Init timing buffer, the binary log has its own */
+	if (opts.logsize > 0 && !data->binlog) {
 		timings = malloc(opts.logsize);
 		/*
 		 * If malloc return null ptr because it fails to alloc mem, we are
@@ -1272,33 +2538,41 @@ void *thread_body(void *arg)
 	}
 	timing_loop = 0;
 
-	if (data->ind == 0) {
-		/*
-		 * Only first thread sets t_zero. Other threads sync with this
-		 * timestamp.
-		 */
-		clock_gettime(CLOCK_MONOTONIC, &t_zero);
-		log_ftrace(ft_data.marker_fd, FTRACE_TASK,
-			   "rtapp_main: event=clock_ref data=%llu",
-			   timespec_to_usec_ull(&t_zero));
-	}
-
-	if (!data->forked)
+	thread_alloc_payload(data);
+	thread_first_touch(data);
+	thread_prepare_pages(data, timings,
+			     timings_size * sizeof(timing_point_t));
+
+	if (data->fork_pooled) {
+		/* nothing to run if the use case ends before a fork event */
+		if (!fork_pool_park(data))
+			data->loop = 0;
+	} else if (!data->forked) {
+		/* t_zero is set by the main thread before it enters the barrier */
 		pthread_barrier_wait(&threads_barrier);
+		data->start_skew = wait_start(&t_zero);
+		log_info("[%d] start skew %ld ns", data->ind, data->start_skew);
+	}
 
 	t_first = t_zero;
 
 	log_notice("[%d] starting thread ...\n", data->ind);
 
-	if (opts.logsize)
-		fprintf(data->log_handler, "%s %8s %8s %8s %15s %15s %15s %10s %10s %10s %10s\n",
-				   "#idx", "perf", "run", "period",
-				   "start", "end", "rel_st", "slack",
-				   "c_duration", "c_period", "wu_lat");
+	if (data->log_handler && data->log_handler != log_sink)
+		log_header(data->log_handler);
 
 	log_ftrace(ft_data.marker_fd, FTRACE_TASK,
 		   "rtapp_task: event=start");
 
+	if (ft_data.raw_fd >= 0 && (ftrace_level & FTRACE_EVENT)) {
+		for (i = 0; i < data->nphases; i++)
+			ftrace_event_desc(ft_data.marker_fd, data->ind,
+					  &data->progs[i]);
+	}
+
+	if (ft_data.raw_fd >= 0 && (ftrace_level & FTRACE_STATS))
+		ftrace_stats_desc(ft_data.marker_fd, data->ind);
+
 	if (data->delay > 0) {
 		struct timespec delay = usec_to_timespec(data->delay);
 
@@ -1321,8 +2595,16 @@ void *thread_body(void *arg)
 	set_thread_membind(data, &data->numa_data);
 	set_thread_taskgroup(data, data->taskgroup_data);
 
-	/* Lock pages */
-	if (data->lock_pages == 1)
+	/* slack of the sleeps and of the timeouts, see the timer backends */
+	if (data->timer_slack >= 0 &&
+	    prctl(PR_SET_TIMERSLACK, data->timer_slack, 0, 0, 0)) {
+		perror("prctl(PR_SET_TIMERSLACK)");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Lock pages, once for all the threads as mlockall() is per process */
+	if (data->lock_pages == LOCK_PAGES_PROCESS &&
+	    !__atomic_exchange_n(&pages_locked, 1, __ATOMIC_RELAXED))
 	{
 		log_notice("[%d] Locking pages in memory", data->ind);
 		ret = mlockall(MCL_CURRENT | MCL_FUTURE);
@@ -1342,8 +2624,21 @@ void *thread_body(void *arg)
 	 */
 	phase = phase_loop = thread_loop = log_idx = 0;
 
+	pmu_thread_open(&pmu_thread);
+
+	if (tl)
+		tl->tid = gettid();
+
+	/* Page faults taken by the phases, see report_faults() */
+	if (getrusage(RUSAGE_THREAD, &usage))
+		memset(&usage, 0, sizeof(usage));
+	minflt = usage.ru_minflt;
+	majflt = usage.ru_majflt;
+
+	__atomic_add_fetch(&threads_looping, 1, __ATOMIC_RELAXED);
+
 	/* The following is executed for each phase. */
-	while (continue_running && thread_loop != data->loop) {
+	while (continue_running && !stop_loops && thread_loop != data->loop) {
 		struct timespec t_diff, t_rel_start;
 
 		set_thread_affinity(data, &pdata->cpu_data);
@@ -1351,23 +2646,36 @@ void *thread_body(void *arg)
 		set_thread_membind(data, &pdata->numa_data);
 		set_thread_taskgroup(data, pdata->taskgroup_data);
 
-		log_ftrace(ft_data.marker_fd, FTRACE_LOOP,
-			   "rtapp_loop: event=start thread_loop=%d phase=%d phase_loop=%d",
-			   thread_loop, phase, phase_loop);
+		if (ftrace_level & FTRACE_LOOP)
+			ftrace_loop(ft_data.marker_fd, ft_data.raw_fd, data->ind,
+				    1, thread_loop, phase, phase_loop);
 
 		log_debug("[%d] begins thread_loop %d phase %d phase_loop %d",
 			  data->ind, thread_loop, phase, phase_loop);
 
 		memset(&ldata, 0, sizeof(ldata));
 		clock_gettime(CLOCK_MONOTONIC, &t_start);
-		ldata.perf = run(data, pdata, &t_first, &ldata);
+		if (data->fork_ts)
+			fork_latency(data, &t_start);
+		if (tl && !phase_loop) {
+			tl->phase_ts = timespec_to_nsec(&t_start);
+			tl->phase = phase;
+		}
+		ldata.perf = run(data, prog, &t_first, &ldata);
 		clock_gettime(CLOCK_MONOTONIC, &t_end);
 
+		if (tl)
+			timeline_rec(tl, TIMELINE_LOOP, phase, phase_loop,
+				     timespec_to_nsec(&t_start),
+				     timespec_to_nsec(&t_end));
+
 		if (timings)
 			curr_timing = &timings[log_idx];
 		else
 			curr_timing = &tmp_timing;
 
+		pmu_thread_read(&pmu_thread, curr_timing->pmu);
+
 		t_diff = timespec_sub(&t_end, &t_start);
 		t_rel_start = timespec_sub(&t_start, &data->main_app_start);
 
@@ -1382,27 +2690,43 @@ void *thread_body(void *arg)
 		curr_timing->slack = ldata.slack;
 		curr_timing->c_period = ldata.c_period;
 		curr_timing->c_duration = ldata.c_duration;
-
-		if (opts.logsize && !timings && continue_running)
-			log_timing(data->log_handler, curr_timing);
-
-		log_ftrace(ft_data.marker_fd, FTRACE_LOOP,
-			   "rtapp_loop: event=end thread_loop=%d phase=%d phase_loop=%d",
-			   thread_loop, phase, phase_loop);
-		log_ftrace(ft_data.marker_fd, FTRACE_STATS,
-			   "rtapp_stats: period=%d run=%d wu_lat=%d slack=%d c_period=%d c_run=%d",
-			   curr_timing->period,
-			   curr_timing->duration,
-			   curr_timing->wu_latency,
-			   curr_timing->slack,
-			   curr_timing->c_period,
-			   curr_timing->c_duration);
+		curr_timing->overshoot = ldata.overshoot;
+		curr_timing->mem_bw = 0;
+		if (ldata.mem_ns)
+			curr_timing->mem_bw = ldata.mem_bytes * 1000 / ldata.mem_ns;
+		curr_timing->chase_lat = 0;
+		if (ldata.chase_hops)
+			curr_timing->chase_lat = (ldata.chase_ns +
+				ldata.chase_hops / 2) / ldata.chase_hops;
+
+		if (data->hists && continue_running)
+			hist_thread_record(data, phase, curr_timing);
+
+		if (data->log_ring && continue_running)
+			log_ring_push(data->log_ring, curr_timing);
+		else if (data->binlog && continue_running)
+			binlog_write(data->binlog, curr_timing);
+		else if (data->log_handler && !timings && continue_running)
+			log_timing(data->log_handler, curr_timing, pmu.nr);
+
+		if (ftrace_level & FTRACE_LOOP)
+			ftrace_loop(ft_data.marker_fd, ft_data.raw_fd, data->ind,
+				    0, thread_loop, phase, phase_loop);
+		if (ftrace_level & FTRACE_STATS)
+			ftrace_stats(ft_data.marker_fd, ft_data.raw_fd,
+				     data->ind, curr_timing);
 
 		phase_loop++;
 		/* Reached the specified number of loops for this phase. */
 		if (phase_loop == pdata->loop) {
 			phase_loop = 0;
 
+			if (tl) {
+				timeline_rec(tl, TIMELINE_PHASE, phase, 0,
+					     tl->phase_ts, timespec_to_nsec(&t_end));
+				tl->phase_ts = 0;
+			}
+
 			phase++;
 			if (phase == data->nphases) {
 				/*
@@ -1419,8 +2743,10 @@ void *thread_body(void *arg)
 					thread_loop = 0;
 			}
 			pdata = &data->phases[phase];
+			prog = &data->progs[phase];
 		}
 
+		nr_timings++;
 		log_idx++;
 		if (log_idx >= timings_size) {
 			timing_loop = 1;
@@ -1428,6 +2754,16 @@ void *thread_body(void *arg)
 		}
 	}
 
+	__atomic_sub_fetch(&threads_looping, 1, __ATOMIC_RELAXED);
+	timer_waiter_close(&data->timer_waiter);
+
+	if (!getrusage(RUSAGE_THREAD, &usage)) {
+		data->minflt = usage.ru_minflt - minflt;
+		data->majflt = usage.ru_majflt - majflt;
+	}
+
+	pmu_thread_close(&pmu_thread);
+
 	param.sched_priority = 0;
 	pthread_setschedparam(pthread_self(),
 			      SCHED_OTHER,
@@ -1439,10 +2775,13 @@ void *thread_body(void *arg)
 	if (timings) {
 		int j;
 
+		if (timing_loop)
+			log_notice("[%d] %lu oldest log records overwritten, log_size is too small",
+				   data->ind, nr_timings - timings_size);
 		for (j = log_idx; timing_loop && (j < timings_size); j++)
-			log_timing(data->log_handler, &timings[j]);
+			log_timing(data->log_handler, &timings[j], pmu.nr);
 		for (j = 0; j < log_idx; j++)
-			log_timing(data->log_handler, &timings[j]);
+			log_timing(data->log_handler, &timings[j], pmu.nr);
 	}
 
 	log_ftrace(ft_data.marker_fd, FTRACE_TASK,
@@ -1452,8 +2791,18 @@ void *thread_body(void *arg)
 	setup_thread_gnuplot(data);
 
 	log_notice("[%d] Exiting.", data->ind);
-	if (opts.logsize)
+	free(data->payload);
+	data->payload = NULL;
+	if (data->log_ring) {
+		/* the logger thread closes the log */
+		logger_ring_close(data->log_ring);
+	} else if (data->log_handler && data->log_handler != log_sink) {
 		fclose(data->log_handler);
+	}
+	if (data->binlog && !data->log_ring) {
+		binlog_close(data->binlog);
+		data->binlog = NULL;
+	}
 
 	pthread_exit(NULL);
 }
@@ -1466,10 +2815,40 @@ void setup_thread_logging(thread_data_t *tdata)
 	tdata->main_app_start = t_start;
 	tdata->lock_pages = opts.lock_pages;
 
+	tdata->log_handler = NULL;
+	tdata->binlog = NULL;
+	tdata->log_ring = NULL;
+
+	tdata->hists = NULL;
+	if (opts.histogram)
+		hist_thread_init(tdata);
+
+	tdata->timeline = NULL;
+	if (opts.timeline)
+		timeline_thread_init(tdata, opts.timeline);
+
 	if (!opts.logsize)
 		return;
 
-	if (opts.logdir) {
+	if (opts.log_format == LOG_FORMAT_BINARY) {
+		if (!opts.logdir) {
+			log_error("Binary log needs a logdir");
+			exit(EXIT_FAILURE);
+		}
+		snprintf(tmp, PATH_LENGTH, "%s/%s-%s.rtlog",
+			 opts.logdir,
+			 opts.logbasename,
+			 tdata->name);
+		/* log_size in MB is the size of the ring buffer */
+		tdata->binlog = binlog_open(tmp, tdata->name, tdata->ind,
+					    opts.logsize > 0 ? opts.logsize : 0);
+		if (!tdata->binlog) {
+			log_error("Cannot open binary log %s", tmp);
+			exit(EXIT_FAILURE);
+		}
+	} else if (log_sink) {
+		tdata->log_handler = log_sink;
+	} else if (opts.logdir) {
 		snprintf(tmp, PATH_LENGTH, "%s/%s-%s.log",
 			 opts.logdir,
 			 opts.logbasename,
@@ -1482,6 +2861,12 @@ void setup_thread_logging(thread_data_t *tdata)
 	} else {
 		tdata->log_handler = stdout;
 	}
+
+	if (opts.logsize == LOG_SIZE_ASYNC)
+		tdata->log_ring = logger_ring_open(tdata->ind,
+						   tdata->log_handler,
+						   tdata->log_handler == log_sink,
+						   tdata->binlog);
 }
 
 void setup_thread_gnuplot(thread_data_t *tdata)
@@ -1489,7 +2874,8 @@ void setup_thread_gnuplot(thread_data_t *tdata)
 	FILE *gnuplot_script = NULL;
 	char tmp[PATH_LENGTH];
 
-	if (!opts.gnuplot || !opts.logdir)
+	/* the plots read the log of each thread */
+	if (!opts.gnuplot || !opts.logdir || log_sink)
 		return;
 
 	snprintf(tmp, PATH_LENGTH, "%s/%s-%s.plot",
@@ -1538,7 +2924,7 @@ static void setup_main_gnuplot(void)
 	char tmp[PATH_LENGTH];
 
 	/* Prepare gnuplot files before starting the use case */
-	if (opts.logdir && opts.gnuplot) {
+	if (opts.logdir && opts.gnuplot && !log_sink) {
 		/* gnuplot plot of the period */
 		snprintf(tmp, PATH_LENGTH, "%s/%s-period.plot",
 			 opts.logdir, opts.logbasename);
@@ -1561,9 +2947,9 @@ static void setup_main_gnuplot(void)
 			fprintf(gnuplot_script,
 				"\"%s-%s.log\" u ($5/1000):4 w l"
 				" title \"thread [%s] (%s)\"",
-				opts.logbasename, threads[i].data->name,
-				threads[i].data->name,
-				policy_to_string(threads[i].data->sched_data->policy));
+				opts.logbasename, thread_slot(i)->data->name,
+				thread_slot(i)->data->name,
+				policy_to_string(thread_slot(i)->data->sched_data->policy));
 
 			if ( i == nthreads-1)
 				fprintf(gnuplot_script, "\n");
@@ -1596,9 +2982,9 @@ static void setup_main_gnuplot(void)
 			fprintf(gnuplot_script,
 				"\"%s-%s.log\" u ($5/1000):3 w l"
 				" title \"thread [%s] (%s)\"",
-				opts.logbasename, threads[i].data->name,
-				threads[i].data->name,
-				policy_to_string(threads[i].data->sched_data->policy));
+				opts.logbasename, thread_slot(i)->data->name,
+				thread_slot(i)->data->name,
+				policy_to_string(thread_slot(i)->data->sched_data->policy));
 
 			if ( i == nthreads-1)
 				fprintf(gnuplot_script, "\n");
@@ -1611,11 +2997,152 @@ static void setup_main_gnuplot(void)
 	}
 }
 
+/* Resident memory of the process in kB, -1 if unknown */
+static long rss_kb(void)
+{
+	long pages = -1;
+	FILE *statm;
+
+	statm = fopen("/proc/self/statm", "r");
+	if (!statm)
+		return -1;
+	if (fscanf(statm, "%*s %ld", &pages) != 1)
+		pages = -1;
+	fclose(statm);
+
+	return pages < 0 ? -1 : pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Threads created by a startup thread: [first, last) of the tasks list */
+typedef struct _startup_data_t {
+	thread_data_t **tasks;
+	int first;
+	int last;
+	int ret;
+	pthread_t thread;
+} startup_data_t;
+
+static void *startup_body(void *arg)
+{
+	startup_data_t *sd = arg;
+	int i;
+
+	for (i = sd->first; i < sd->last && !sd->ret; i++)
+		sd->ret = create_thread(sd->tasks[i], i, NULL, 0, 0);
+
+	return NULL;
+}
+
+/*
+ * Create the threads of the tasks. Setting up tens of thousands of threads
+ * takes a while, so the work is split between several startup threads.
+ */
+static int create_tasks_threads(void)
+{
+	thread_data_t **tasks;
+	startup_data_t *sd;
+	struct timespec t_begin, t_end;
+	int i, j, ind = 0, nr, ret = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_begin);
+
+	/*
+	 * Duplicate thread data so that we can safely copy the
+	 * original thread data when forking.
+	 *
+	 * If we don't do that and try to fork a running thread, we
+	 * might have partially modified content of thread data since
+	 * thread_body() calls functions like set_thread_affinity()
+	 * that modifies thread data at runtime. Rather than introduce
+	 * complex locking ensure that the original parsed thread_data
+	 * are intact and duplicate them before forking or when we run
+	 * for the first time as in here.
+	 */
+	tasks = malloc(opts.nthreads * sizeof(*tasks));
+	if (!tasks) {
+		log_error("Cannot allocate threads");
+		return -1;
+	}
+	for (i = 0; i < opts.num_tasks; i++) {
+		thread_data_t *tdata_orig = &opts.threads_data[i];
+
+		if (tdata_orig->num_instances < 0) {
+			log_error("Invalid num_instances value: %d", tdata_orig->num_instances);
+			free(tasks);
+			return -1;
+		}
+
+		for (j = 0; j < tdata_orig->num_instances; j++)
+			tasks[ind++] = tdata_orig;
+	}
+
+	nr = opts.startup_threads;
+	if (!nr) {
+		nr = sysconf(_SC_NPROCESSORS_ONLN);
+		if (nr > STARTUP_THREADS_MAX)
+			nr = STARTUP_THREADS_MAX;
+		if (ind < STARTUP_PARALLEL_MIN)
+			nr = 1;
+	}
+	if (nr > ind)
+		nr = ind;
+	if (nr < 1)
+		nr = 1;
+
+	sd = calloc(nr, sizeof(*sd));
+	if (!sd) {
+		log_error("Cannot allocate startup threads");
+		free(tasks);
+		return -1;
+	}
+
+	for (i = 0; i < nr; i++) {
+		sd[i].tasks = tasks;
+		sd[i].first = (long)ind * i / nr;
+		sd[i].last = (long)ind * (i + 1) / nr;
+	}
+
+	if (nr == 1) {
+		startup_body(&sd[0]);
+	} else {
+		pthread_attr_t attr;
+
+		pthread_attr_init(&attr);
+		thread_attr_block_signals(&attr);
+
+		for (i = 0; i < nr; i++) {
+			if (pthread_create(&sd[i].thread, &attr, startup_body,
+					   &sd[i])) {
+				log_error("Cannot create startup thread %d", i);
+				sd[i].ret = -1;
+			}
+		}
+		pthread_attr_destroy(&attr);
+
+		for (i = 0; i < nr; i++) {
+			if (!sd[i].ret)
+				pthread_join(sd[i].thread, NULL);
+		}
+	}
+
+	for (i = 0; i < nr; i++)
+		ret |= sd[i].ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	t_end = timespec_sub(&t_end, &t_begin);
+	log_notice("%d threads created in %lu ms by %d startup threads, RSS %ld kB",
+		   ind, timespec_to_usec(&t_end) / 1000, nr, rss_kb());
+
+	free(sd);
+	free(tasks);
+
+	return ret;
+}
+
 int main(int argc, char* argv[])
 {
 	int i, res, nresources;
 	rtapp_resource_t *rdata;
-	static cpu_set_t orig_set;
 	struct stat sb;
 	char tmp[PATH_LENGTH];
 
@@ -1628,13 +3155,12 @@ int main(int argc, char* argv[])
 	}
 
 	/* allocated threads */
-	nthreads = opts.nthreads;
-	threads = malloc(nthreads * sizeof(*threads));
-	if (!threads) {
-		log_error("Cannot allocate threads");
-		exit(EXIT_FAILURE);
+	for (i = 0; i < opts.nthreads; i++) {
+		if (thread_reserve() < 0)
+			exit(EXIT_FAILURE);
 	}
-	pthread_barrier_init(&threads_barrier, NULL, nthreads);
+	/* the main thread sets the start of the use case in the barrier */
+	pthread_barrier_init(&threads_barrier, NULL, opts.nthreads + 1);
 	pthread_mutex_init(&joining_mutex, NULL);
 	pthread_mutex_init(&fork_mutex, NULL);
 
@@ -1643,6 +3169,7 @@ int main(int argc, char* argv[])
 	signal(SIGTERM, shutdown);
 	signal(SIGHUP, shutdown);
 	signal(SIGINT, shutdown);
+	signal(SIGXCPU, dl_overrun);
 
 	/* If using ftrace, open trace and marker fds */
 	if (ftrace_level != FTRACE_NONE) {
@@ -1670,6 +3197,15 @@ int main(int argc, char* argv[])
 			log_error("Cannot open trace_marker file %s", tmp);
 			exit(EXIT_FAILURE);
 		}
+		if (opts.ftrace_format == LOG_FORMAT_BINARY) {
+			strcpy(tmp, ft_data.tracefs);
+			strcat(tmp, "/trace_marker_raw");
+			ft_data.raw_fd = open(tmp, O_WRONLY);
+			if (ft_data.raw_fd < 0) {
+				log_error("Cannot open trace_marker_raw file %s", tmp);
+				exit(EXIT_FAILURE);
+			}
+		}
 	}
 	log_ftrace(ft_data.marker_fd, FTRACE_MAIN,
 		   "rtapp_main: event=start");
@@ -1677,66 +3213,85 @@ int main(int argc, char* argv[])
 	/* Init global running_variable */
 	continue_running = 1;
 
-	/* Needs to calibrate 'calib_cpu' core */
-	if (opts.calib_ns_per_loop == 0) {
-		log_notice("Calibrate ns per loop");
-		cpu_set_t calib_set;
-
-		CPU_ZERO(&calib_set);
-		CPU_SET(opts.calib_cpu, &calib_set);
-		sched_getaffinity(0, sizeof(cpu_set_t), &orig_set);
-		sched_setaffinity(0, sizeof(cpu_set_t), &calib_set);
-		p_load = calibrate_cpu_cycles(CLOCK_MONOTONIC);
-		sched_setaffinity(0, sizeof(cpu_set_t), &orig_set);
-		log_notice("pLoad = %dns : calib_cpu %d", p_load, opts.calib_cpu);
-	} else {
-		p_load = opts.calib_ns_per_loop;
-		log_notice("pLoad = %dns", p_load);
-	}
+	fastclock_init();
+	log_notice("runtime events use the %s clock", fastclock_name());
+
+	pmu_init(opts.pmu_events);
+
+	/* Needs to calibrate 'calib_cpu' core(s) */
+	calibrate(&opts);
+
+	numa_matrix(opts.numa_matrix, opts.numa_matrix_count);
 
 	initialize_cgroups();
 	add_cgroups();
 
+	logger_start(&opts);
+
+	if (opts.log_shared && opts.logsize && opts.logdir) {
+		snprintf(tmp, PATH_LENGTH, "%s/%s.log",
+			 opts.logdir, opts.logbasename);
+		log_sink = fopen(tmp, "w");
+		if (!log_sink) {
+			log_error("Cannot open logfile %s", tmp);
+			exit(EXIT_FAILURE);
+		}
+		setvbuf(log_sink, NULL, _IOFBF, LOGGER_BUFFER_SIZE);
+		log_header(log_sink);
+	}
+
 	/* Take the beginning time for everything */
 	clock_gettime(CLOCK_MONOTONIC, &t_start);
 
+	/* The parked threads take the slots after the ones of the tasks */
+	if (fork_pools_create())
+		goto exit_err;
+
 	/* Start the use case */
-	int ind = 0;
-	for (i = 0; i < opts.num_tasks; i++) {
-		/*
-		 * Duplicate thread data so that we can safely copy the
-		 * original thread data when forking.
-		 *
-		 * If we don't do that and try to fork a running thread, we
-		 * might have partially modified content of thread data since
-		 * thread_body() calls functions like set_thread_affinity()
-		 * that modifies thread data at runtime. Rather than introduce
-		 * complex locking ensure that the original parsed thread_data
-		 * are intact and duplicate them before forking or when we run
-		 * for the first time as in here.
-		 */
-		thread_data_t *tdata_orig = &opts.threads_data[i];
-		int j;
+	if (create_tasks_threads())
+		goto exit_err;
 
-		if (tdata_orig->num_instances < 0) {
-			log_error("Invalid num_instances value: %d", tdata_orig->num_instances);
-			goto exit_err;
-		}
+	running_threads = nthreads;
 
-		for (j = 0; j < tdata_orig->num_instances; j++) {
-			int ret = create_thread(tdata_orig, ind++, 0, 0);
-			if (ret) {
-				goto exit_err;
-			}
-		}
+	if (opts.histogram && opts.hist_interval > 0) {
+		pthread_attr_t attr;
+
+		pthread_attr_init(&attr);
+		thread_attr_block_signals(&attr);
+		if (pthread_create(&hist_thread, &attr, hist_thread_body, NULL))
+			log_error("Cannot create the histograms thread");
+		else
+			hist_thread_started = 1;
+		pthread_attr_destroy(&attr);
 	}
-	running_threads = nthreads;
+
+	/*
+	 * All the threads are created: start the use case start_margin usec
+	 * from now, the threads wait for this instant.
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &t_zero);
+	if (opts.start_margin) {
+		struct timespec margin = usec_to_timespec(opts.start_margin);
+
+		t_zero = timespec_add(&t_zero, &margin);
+	}
+	log_ftrace(ft_data.marker_fd, FTRACE_MAIN,
+		   "rtapp_main: event=clock_ref data=%llu",
+		   timespec_to_usec_ull(&t_zero));
+	pthread_barrier_wait(&threads_barrier);
 
 	if (opts.duration > 0) {
-		sleep(opts.duration);
+		struct timespec t_stop = {
+			.tv_sec = (time_t)opts.duration,
+			.tv_nsec = (opts.duration - (time_t)opts.duration) * 1E9,
+		};
+
+		/* the end is relative to the start, not to the creation */
+		t_stop = timespec_add(&t_zero, &t_stop);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t_stop, NULL);
 		log_ftrace(ft_data.marker_fd, FTRACE_MAIN,
 			   "rtapp_main: event=shutdown");
-		__shutdown(true);
+		__shutdown(!(opts.graceful_stop && stop_gracefully()));
 	}
 
 	__shutdown(false);
@@ -0,0 +1,219 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "rt-app_utils.h"
+#include "rt-app_pmu.h"
+#include "rt-app_binlog.h"
+
+/* Size of the chunks of a log which grows with the records */
+#define BINLOG_CHUNK_SIZE	(1 << 20)
+
+/* Columns of the text log, in the same order */
+static const binlog_column_t binlog_columns[] = {
+	{ "idx",	BINLOG_S64,	4 },
+	{ "perf",	BINLOG_U64,	8 },
+	{ "run",	BINLOG_U64,	8 },
+	{ "period",	BINLOG_U64,	8 },
+	{ "start",	BINLOG_U64,	15 },
+	{ "end",	BINLOG_U64,	15 },
+	{ "rel_st",	BINLOG_U64,	15 },
+	{ "slack",	BINLOG_S64,	10 },
+	{ "c_duration",	BINLOG_U64,	10 },
+	{ "c_period",	BINLOG_U64,	10 },
+	{ "wu_lat",	BINLOG_U64,	10 },
+	{ "ovr_ns",	BINLOG_S64,	10 },
+	{ "mem_bw",	BINLOG_U64,	10 },
+	{ "chase_ns",	BINLOG_U64,	10 },
+};
+
+#define BINLOG_NR_COLUMNS (sizeof(binlog_columns) / sizeof(binlog_columns[0]))
+
+static int binlog_map_chunk(binlog_t *log, uint64_t idx)
+{
+	off_t offset = log->hdr->header_size + idx * log->hdr->chunk_size;
+	void *chunk;
+
+	if (log->chunk)
+		munmap(log->chunk, log->hdr->chunk_size);
+	log->chunk = NULL;
+
+	if (!log->hdr->capacity &&
+	    ftruncate(log->fd, offset + log->hdr->chunk_size)) {
+		log_error("Cannot extend binary log: %s", strerror(errno));
+		return -1;
+	}
+
+	/* Populate the pages now rather than faulting on the records */
+	chunk = mmap(NULL, log->hdr->chunk_size, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_POPULATE, log->fd, offset);
+	if (chunk == MAP_FAILED) {
+		log_error("Cannot map binary log: %s", strerror(errno));
+		return -1;
+	}
+
+	log->chunk = chunk;
+	log->chunk_idx = idx;
+
+	return 0;
+}
+
+binlog_t *binlog_open(const char *path, const char *task, int ind,
+		      long ring_size)
+{
+	binlog_header_t *hdr;
+	binlog_t *log;
+	long page_size = sysconf(_SC_PAGESIZE);
+	int i, nr_columns = BINLOG_NR_COLUMNS + pmu.nr;
+
+	log = calloc(1, sizeof(*log));
+	if (!log)
+		return NULL;
+
+	log->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (log->fd < 0) {
+		log_error("Cannot open binary log %s: %s", path, strerror(errno));
+		goto free_log;
+	}
+
+	if (ftruncate(log->fd, BINLOG_HEADER_SIZE))
+		goto close_fd;
+
+	hdr = mmap(NULL, BINLOG_HEADER_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_SHARED, log->fd, 0);
+	if (hdr == MAP_FAILED)
+		goto close_fd;
+
+	log->hdr = hdr;
+	memcpy(hdr->magic, BINLOG_MAGIC, sizeof(hdr->magic));
+	hdr->version = BINLOG_VERSION;
+	hdr->header_size = BINLOG_HEADER_SIZE;
+	hdr->nr_columns = nr_columns;
+	hdr->record_size = nr_columns * sizeof(uint64_t);
+	hdr->ind = ind;
+	strncpy(hdr->task, task, BINLOG_TASK_LENGTH - 1);
+
+	memcpy(hdr->columns, binlog_columns, sizeof(binlog_columns));
+	for (i = 0; i < pmu.nr; i++) {
+		binlog_column_t *col = &hdr->columns[BINLOG_NR_COLUMNS + i];
+
+		strncpy(col->name, pmu_event_name(pmu.ids[i]),
+			BINLOG_NAME_LENGTH - 1);
+		col->type = BINLOG_U64;
+		col->width = 14;
+	}
+	log->nr_pmu = pmu.nr;
+
+	if (ring_size > 0) {
+		/* One chunk which holds the whole ring */
+		hdr->chunk_size = (ring_size + page_size - 1) / page_size * page_size;
+		hdr->capacity = hdr->chunk_size / hdr->record_size;
+		if (!hdr->capacity)
+			goto unmap_hdr;
+		if (ftruncate(log->fd, BINLOG_HEADER_SIZE + hdr->chunk_size))
+			goto unmap_hdr;
+	} else {
+		hdr->chunk_size = BINLOG_CHUNK_SIZE;
+		hdr->capacity = 0;
+	}
+	log->per_chunk = hdr->chunk_size / hdr->record_size;
+
+	if (binlog_map_chunk(log, 0))
+		goto unmap_hdr;
+
+	return log;
+
+unmap_hdr:
+	munmap(hdr, BINLOG_HEADER_SIZE);
+close_fd:
+	close(log->fd);
+free_log:
+	free(log);
+	return NULL;
+}
+
+void binlog_write(binlog_t *log, const timing_point_t *t)
+{
+	uint64_t slot = log->hdr->nr_records;
+	uint64_t *rec;
+	int i;
+
+	/* A ring is one chunk, only a log which grows maps the next one */
+	if (log->hdr->capacity)
+		slot %= log->hdr->capacity;
+
+	if (slot / log->per_chunk != log->chunk_idx &&
+	    binlog_map_chunk(log, slot / log->per_chunk))
+		return;
+
+	if (!log->chunk)
+		return;
+
+	rec = (uint64_t *)(log->chunk + (slot % log->per_chunk) * log->hdr->record_size);
+	rec[0] = (int64_t)t->ind;
+	rec[1] = t->perf;
+	rec[2] = t->duration;
+	rec[3] = t->period;
+	rec[4] = t->start_time;
+	rec[5] = t->end_time;
+	rec[6] = t->rel_start_time;
+	rec[7] = (int64_t)t->slack;
+	rec[8] = t->c_duration;
+	rec[9] = t->c_period;
+	rec[10] = t->wu_latency;
+	rec[11] = (int64_t)t->overshoot;
+	rec[12] = t->mem_bw;
+	rec[13] = t->chase_lat;
+	for (i = 0; i < log->nr_pmu; i++)
+		rec[BINLOG_NR_COLUMNS + i] = t->pmu[i];
+
+	/* Publish the record once it is complete */
+	__atomic_store_n(&log->hdr->nr_records, log->hdr->nr_records + 1,
+			 __ATOMIC_RELEASE);
+}
+
+void binlog_close(binlog_t *log)
+{
+	binlog_header_t *hdr = log->hdr;
+	off_t size;
+
+	if (log->chunk)
+		munmap(log->chunk, hdr->chunk_size);
+
+	/* Drop the unused end of the last chunk */
+	if (!hdr->capacity) {
+		size = binlog_slot_offset(hdr, hdr->nr_records);
+		if (ftruncate(log->fd, size))
+			log_error("Cannot truncate binary log: %s", strerror(errno));
+	}
+
+	munmap(hdr, BINLOG_HEADER_SIZE);
+	close(log->fd);
+	free(log);
+}
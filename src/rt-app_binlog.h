@@ -0,0 +1,111 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef _RTAPP_BINLOG_H_
+#define _RTAPP_BINLOG_H_
+
+#include <stdint.h>
+
+/*
+ * Binary log format
+ *
+ * A binary log file starts with a header page which describes the columns of
+ * the records, followed by fixed size records of 64 bits values, one per
+ * column. The records are stored in chunks of chunk_size bytes and don't
+ * straddle chunks so that the writer can map one chunk at a time.
+ *
+ * When capacity is not 0, the file is a ring of capacity records held in one
+ * chunk, mapped once when the log is created, and only the last capacity
+ * records of the nr_records written ones are available.
+ *
+ * The file is written in the native byte order; the magic is used to detect a
+ * log from a machine with another byte order.
+ */
+#define BINLOG_MAGIC		"RTAPPLOG"
+#define BINLOG_VERSION		1
+#define BINLOG_HEADER_SIZE	4096
+#define BINLOG_NAME_LENGTH	24
+#define BINLOG_TASK_LENGTH	64
+
+enum binlog_type {
+	BINLOG_U64 = 0,
+	BINLOG_S64,
+};
+
+typedef struct _binlog_column_t {
+	char name[BINLOG_NAME_LENGTH];
+	uint32_t type;		/* enum binlog_type */
+	uint32_t width;		/* width of the column in the text log */
+} binlog_column_t;
+
+typedef struct _binlog_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t record_size;
+	uint32_t nr_columns;
+	uint64_t chunk_size;
+	uint64_t capacity;	/* 0 if not a ring */
+	uint64_t nr_records;	/* number of records written */
+	int32_t ind;		/* index of the thread */
+	uint32_t reserved;
+	char task[BINLOG_TASK_LENGTH];
+	binlog_column_t columns[];
+} binlog_header_t;
+
+#define BINLOG_MAX_COLUMNS \
+	((BINLOG_HEADER_SIZE - sizeof(binlog_header_t)) / sizeof(binlog_column_t))
+
+/* Offset in the file of the record in @slot */
+static inline uint64_t binlog_slot_offset(const binlog_header_t *hdr,
+					  uint64_t slot)
+{
+	uint64_t per_chunk = hdr->chunk_size / hdr->record_size;
+
+	return hdr->header_size + (slot / per_chunk) * hdr->chunk_size +
+	       (slot % per_chunk) * hdr->record_size;
+}
+
+/* Writer side, used by rt-app */
+struct _timing_point_t;
+
+typedef struct _binlog_t {
+	int fd;
+	binlog_header_t *hdr;
+	char *chunk;		/* mapping of the current chunk */
+	uint64_t chunk_idx;	/* index of the mapped chunk */
+	uint64_t per_chunk;	/* records per chunk */
+	int nr_pmu;
+} binlog_t;
+
+/*
+ * Create the log @path of the thread @task. @ring_size is the size of the
+ * ring buffer in bytes, or 0 for a file which grows with the records.
+ */
+binlog_t *binlog_open(const char *path, const char *task, int ind,
+		      long ring_size);
+
+void binlog_write(binlog_t *log, const struct _timing_point_t *t);
+
+void binlog_close(binlog_t *log);
+
+#endif /* _RTAPP_BINLOG_H_ */
@@ -0,0 +1,326 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BURN_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "rt-app_burn.h"
+
+/* keeps the result of the kernels alive */
+static volatile uint64_t burn_sink;
+
+/* prevents the compiler from merging or if-converting the branches */
+#define BURN_BARRIER()	__asm__ __volatile__("" ::: "memory")
+
+/*
+ * Function: to do some useless operation.
+ * Default kernel: chains of ldexp() calls of the libm.
+ */
+void waste_cpu_cycles(unsigned long long load_loops)
+{
+	double param, result = 0;
+	double n;
+	unsigned long long i;
+
+	param = 0.95;
+	n = 4;
+	for (i = 0 ; i < load_loops ; i++) {
+		result = ldexp(param , (ldexp(param , ldexp(param , n))));
+		result = ldexp(param , (ldexp(param , ldexp(param , n))));
+		result = ldexp(param , (ldexp(param , ldexp(param , n))));
+		result = ldexp(param , (ldexp(param , ldexp(param , n))));
+	}
+	burn_sink = (uint64_t)result;
+}
+
+/* Integer ALU: 4 independent xorshift-multiply chains */
+static void burn_int(unsigned long long loops)
+{
+	uint64_t a = 1, b = 2, c = 3, d = 4;
+	unsigned long long i;
+	int j;
+
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < 8; j++) {
+			a ^= a << 13; a ^= a >> 7; a *= 0x9e3779b97f4a7c15ULL;
+			b ^= b << 13; b ^= b >> 7; b *= 0x9e3779b97f4a7c15ULL;
+			c ^= c << 13; c ^= c >> 7; c *= 0x9e3779b97f4a7c15ULL;
+			d ^= d << 13; d ^= d >> 7; d *= 0x9e3779b97f4a7c15ULL;
+		}
+	}
+	burn_sink = a + b + c + d;
+}
+
+/*
+ * Multiply-add kernels: 8 independent chains to cover the latency of the FMA
+ * units, kept in registers.
+ */
+#define BURN_FMA8(fma, m, c) do {					\
+	a0 = fma(a0, m, c); a1 = fma(a1, m, c);				\
+	a2 = fma(a2, m, c); a3 = fma(a3, m, c);				\
+	a4 = fma(a4, m, c); a5 = fma(a5, m, c);				\
+	a6 = fma(a6, m, c); a7 = fma(a7, m, c);				\
+} while (0)
+
+#ifdef BURN_X86
+#define BURN_TARGET_FMA	__attribute__((target("fma")))
+#else
+#define BURN_TARGET_FMA
+#endif
+
+/* Scalar floating point */
+static void BURN_TARGET_FMA burn_fma(unsigned long long loops)
+{
+	double a0 = 1, a1 = 2, a2 = 3, a3 = 4, a4 = 5, a5 = 6, a6 = 7, a7 = 8;
+	const double m = 0.999999, c = 1e-6;
+	unsigned long long i;
+	int j;
+
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < 4; j++) {
+			BURN_FMA8(__builtin_fma, m, c);
+			BURN_FMA8(__builtin_fma, m, c);
+			BURN_FMA8(__builtin_fma, m, c);
+			BURN_FMA8(__builtin_fma, m, c);
+		}
+	}
+
+	burn_sink = (uint64_t)(a0 + a1 + a2 + a3 + a4 + a5 + a6 + a7);
+}
+
+#ifdef BURN_X86
+static int fma_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("fma");
+}
+
+/* 256 bits FMA */
+static void __attribute__((target("avx2,fma"))) burn_avx2(unsigned long long loops)
+{
+	__m256 m = _mm256_set1_ps(0.999999f), c = _mm256_set1_ps(1e-6f);
+	__m256 a0 = _mm256_set1_ps(1), a1 = _mm256_set1_ps(2), a2 = _mm256_set1_ps(3), a3 = _mm256_set1_ps(4);
+	__m256 a4 = _mm256_set1_ps(5), a5 = _mm256_set1_ps(6), a6 = _mm256_set1_ps(7), a7 = _mm256_set1_ps(8);
+	float out[8];
+	unsigned long long i;
+	int j;
+
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < 4; j++) {
+			BURN_FMA8(_mm256_fmadd_ps, m, c);
+			BURN_FMA8(_mm256_fmadd_ps, m, c);
+			BURN_FMA8(_mm256_fmadd_ps, m, c);
+			BURN_FMA8(_mm256_fmadd_ps, m, c);
+		}
+	}
+
+	a0 = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(a0, a1), _mm256_add_ps(a2, a3)),
+			   _mm256_add_ps(_mm256_add_ps(a4, a5), _mm256_add_ps(a6, a7)));
+	_mm256_storeu_ps(out, a0);
+	burn_sink = (uint64_t)out[0];
+}
+
+static int avx2_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+/* 512 bits FMA, which triggers the AVX-512 frequency license on some CPUs */
+static void __attribute__((target("avx512f"))) burn_avx512(unsigned long long loops)
+{
+	__m512 m = _mm512_set1_ps(0.999999f), c = _mm512_set1_ps(1e-6f);
+	__m512 a0 = _mm512_set1_ps(1), a1 = _mm512_set1_ps(2), a2 = _mm512_set1_ps(3), a3 = _mm512_set1_ps(4);
+	__m512 a4 = _mm512_set1_ps(5), a5 = _mm512_set1_ps(6), a6 = _mm512_set1_ps(7), a7 = _mm512_set1_ps(8);
+	unsigned long long i;
+	int j;
+
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < 4; j++) {
+			BURN_FMA8(_mm512_fmadd_ps, m, c);
+			BURN_FMA8(_mm512_fmadd_ps, m, c);
+			BURN_FMA8(_mm512_fmadd_ps, m, c);
+			BURN_FMA8(_mm512_fmadd_ps, m, c);
+		}
+	}
+
+	a0 = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(a0, a1), _mm512_add_ps(a2, a3)),
+			   _mm512_add_ps(_mm512_add_ps(a4, a5), _mm512_add_ps(a6, a7)));
+	burn_sink = (uint64_t)_mm512_reduce_add_ps(a0);
+}
+
+static int avx512_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+#ifdef __aarch64__
+/* 128 bits NEON FMA */
+#define NEON_FMA(a, m, c)	vfmaq_f32(c, a, m)
+
+static void burn_neon(unsigned long long loops)
+{
+	float32x4_t m = vdupq_n_f32(0.999999f), c = vdupq_n_f32(1e-6f);
+	float32x4_t a0 = vdupq_n_f32(1), a1 = vdupq_n_f32(2), a2 = vdupq_n_f32(3), a3 = vdupq_n_f32(4);
+	float32x4_t a4 = vdupq_n_f32(5), a5 = vdupq_n_f32(6), a6 = vdupq_n_f32(7), a7 = vdupq_n_f32(8);
+	unsigned long long i;
+	int j;
+
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < 4; j++) {
+			BURN_FMA8(NEON_FMA, m, c);
+			BURN_FMA8(NEON_FMA, m, c);
+			BURN_FMA8(NEON_FMA, m, c);
+			BURN_FMA8(NEON_FMA, m, c);
+		}
+	}
+
+	a0 = vaddq_f32(vaddq_f32(vaddq_f32(a0, a1), vaddq_f32(a2, a3)),
+		       vaddq_f32(vaddq_f32(a4, a5), vaddq_f32(a6, a7)));
+	burn_sink = (uint64_t)vaddvq_f32(a0);
+}
+#endif
+
+/*
+ * Branch mispredictions: the direction of each branch depends on a pseudo
+ * random bit so it is taken half of the time without any pattern.
+ */
+static void burn_branchy(unsigned long long loops)
+{
+	uint64_t x = 0x2545f4914f6cdd1dULL, a = 0, b = 0;
+	unsigned long long i;
+	int j;
+
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < 8; j++) {
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			if (x & 0x100) {
+				a += x >> 3;
+				BURN_BARRIER();
+			} else {
+				b ^= x << 1;
+			}
+		}
+	}
+	burn_sink = a + b;
+}
+
+/*
+ * Table lookups in the style of a T-table AES round: 4 tables of 1KB which
+ * stay in the L1 data cache, indexed by the bytes of the state.
+ */
+static uint32_t burn_tables[4][256];
+
+static void burn_crypto_init(void)
+{
+	uint32_t seed = 0x9e3779b9;
+	int r;
+
+	for (r = 0; r < 4 * 256; r++) {
+		seed = seed * 1664525 + 1013904223;
+		burn_tables[r / 256][r % 256] = seed | 1;
+	}
+}
+
+static void burn_crypto(unsigned long long loops)
+{
+	uint32_t s0 = 0x01234567, s1 = 0x89abcdef, s2 = 0xfedcba98, s3 = 0x76543210;
+	uint32_t t0, t1, t2, t3;
+	unsigned long long i;
+	int r;
+
+	for (i = 0; i < loops; i++) {
+		for (r = 0; r < 4; r++) {
+			t0 = burn_tables[0][s0 & 0xff] ^ burn_tables[1][(s1 >> 8) & 0xff] ^
+			     burn_tables[2][(s2 >> 16) & 0xff] ^ burn_tables[3][s3 >> 24];
+			t1 = burn_tables[0][s1 & 0xff] ^ burn_tables[1][(s2 >> 8) & 0xff] ^
+			     burn_tables[2][(s3 >> 16) & 0xff] ^ burn_tables[3][s0 >> 24];
+			t2 = burn_tables[0][s2 & 0xff] ^ burn_tables[1][(s3 >> 8) & 0xff] ^
+			     burn_tables[2][(s0 >> 16) & 0xff] ^ burn_tables[3][s1 >> 24];
+			t3 = burn_tables[0][s3 & 0xff] ^ burn_tables[1][(s0 >> 8) & 0xff] ^
+			     burn_tables[2][(s1 >> 16) & 0xff] ^ burn_tables[3][s2 >> 24];
+			s0 = t0 ^ (uint32_t)i;
+			s1 = t1;
+			s2 = t2;
+			s3 = t3;
+		}
+	}
+	burn_sink = s0 ^ s1 ^ s2 ^ s3;
+}
+
+burn_kernel_t burn_kernels[] = {
+	/* BURN_DEFAULT_KERNEL */
+	{ .name = "ldexp",	.fn = waste_cpu_cycles },
+	{ .name = "int",	.fn = burn_int },
+#ifdef BURN_X86
+	{ .name = "fma",	.fn = burn_fma,		.supported = fma_supported },
+	{ .name = "avx2",	.fn = burn_avx2,	.supported = avx2_supported },
+	{ .name = "avx512",	.fn = burn_avx512,	.supported = avx512_supported },
+#else
+	{ .name = "fma",	.fn = burn_fma },
+#endif
+#ifdef __aarch64__
+	{ .name = "neon",	.fn = burn_neon },
+#endif
+	{ .name = "branchy",	.fn = burn_branchy },
+	{ .name = "crypto",	.fn = burn_crypto,	.init = burn_crypto_init },
+};
+
+const int nr_burn_kernels = sizeof(burn_kernels) / sizeof(burn_kernels[0]);
+
+int burn_kernel_index(const char *name)
+{
+	int i;
+
+	for (i = 0; i < nr_burn_kernels; i++)
+		if (!strcmp(burn_kernels[i].name, name))
+			return i;
+
+	return -1;
+}
+
+void burn_kernels_init(void)
+{
+	int i;
+
+	for (i = 0; i < nr_burn_kernels; i++)
+		if (burn_kernels[i].used && burn_kernels[i].init)
+			burn_kernels[i].init();
+}
+
+int burn_kernel_supported(const burn_kernel_t *kernel)
+{
+	return !kernel->supported || kernel->supported();
+}
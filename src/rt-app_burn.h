@@ -0,0 +1,68 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef _RTAPP_BURN_H_
+#define _RTAPP_BURN_H_
+
+/*
+ * Burn kernels: the busy loops executed by the run and runtime events.
+ *
+ * Each kernel stresses a different part of the core so that the IPC, power
+ * and frequency behaviour of the load can be chosen. A kernel is calibrated
+ * on its own, only if at least one event uses it.
+ */
+
+/* Execute @loops iterations of the kernel */
+typedef void (*burn_fn_t)(unsigned long long loops);
+
+typedef struct _burn_kernel_t {
+	const char *name;
+	burn_fn_t fn;
+	int (*supported)(void);	/* NULL if always supported */
+	void (*init)(void);	/* sets up the data of the kernel, or NULL */
+	int used;		/* referenced by at least one event */
+	int p_load;		/* reference ns per loop */
+	int *ns_per_loop;	/* ns per loop of each CPU */
+	double *stddev;		/* calibration stddev of each CPU */
+} burn_kernel_t;
+
+/* The default kernel, used by the events which don't select one */
+#define BURN_DEFAULT_KERNEL	0
+
+extern burn_kernel_t burn_kernels[];
+extern const int nr_burn_kernels;
+
+/* Return the index of the kernel @name or -1 if it doesn't exist */
+int burn_kernel_index(const char *name);
+
+/*
+ * Set up the data of the used kernels, once before they are calibrated and
+ * before the threads start.
+ */
+void burn_kernels_init(void);
+
+/* Return 1 if the kernel can run on this machine */
+int burn_kernel_supported(const burn_kernel_t *kernel);
+
+void waste_cpu_cycles(unsigned long long load_loops);
+
+#endif /* _RTAPP_BURN_H_ */
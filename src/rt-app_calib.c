@@ -0,0 +1,618 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/* for CPU_SET macro */
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/utsname.h>
+
+#include "rt-app_utils.h"
+#include "rt-app_calib.h"
+
+calib_data_t calib;
+
+/*
+ * Calibration samples
+ *
+ * The ns per loop values are measured with loops of various length and the
+ * estimate is the mean of the last CALIB_WINDOW samples so that the samples
+ * taken while cpufreq ramps up the frequency age out. Sampling stops once the
+ * 95% confidence interval of this mean is within calib.ci of the latter, or
+ * when the time budget of the method has elapsed.
+ */
+#define CALIB_WINDOW		16
+#define CALIB_MIN_SAMPLES	5
+#define CALIB_Z95		1.96
+
+struct calib_stats {
+	double samples[CALIB_WINDOW];
+	int nr_samples;
+	double mean;
+	double stddev;
+};
+
+static void calib_stats_add(struct calib_stats *st, double sample)
+{
+	int i, n;
+	double sum = 0, sq = 0;
+
+	st->samples[st->nr_samples % CALIB_WINDOW] = sample;
+	st->nr_samples++;
+
+	n = st->nr_samples < CALIB_WINDOW ? st->nr_samples : CALIB_WINDOW;
+	for (i = 0; i < n; i++)
+		sum += st->samples[i];
+	st->mean = sum / n;
+
+	for (i = 0; i < n; i++)
+		sq += (st->samples[i] - st->mean) * (st->samples[i] - st->mean);
+	st->stddev = n > 1 ? sqrt(sq / (n - 1)) : 0;
+}
+
+static int calib_stats_converged(struct calib_stats *st)
+{
+	int n = st->nr_samples < CALIB_WINDOW ? st->nr_samples : CALIB_WINDOW;
+
+	if (n < CALIB_MIN_SAMPLES)
+		return 0;
+
+	return CALIB_Z95 * st->stddev / sqrt(n) <= calib.ci * st->mean;
+}
+
+/*
+ * Sample the ns per loop value until convergence or until @budget_ns has
+ * elapsed. @idle_ns is the idle time inserted before each sample.
+ */
+static void calibrate_samples(int clock, burn_fn_t fn, int64_t idle_ns,
+			      int64_t budget_ns, calib_result_t *res)
+{
+	struct timespec begin, start, stop, now, sleep;
+	struct calib_stats st = { .nr_samples = 0 };
+	int max_load_loop = 10000;
+
+	sleep.tv_sec = idle_ns / 1000000000;
+	sleep.tv_nsec = idle_ns % 1000000000;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	while (1) {
+		if (idle_ns)
+			clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep, NULL);
+
+		clock_gettime(clock, &start);
+		fn(max_load_loop);
+		clock_gettime(clock, &stop);
+
+		calib_stats_add(&st, (double)timespec_sub_to_ns(&stop, &start) /
+				max_load_loop);
+
+		if (calib_stats_converged(&st)) {
+			res->converged = 1;
+			break;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (timespec_sub_to_ns(&now, &begin) >= budget_ns)
+			break;
+
+		/*
+		* use several loop duration in order to be sure to not
+		* fall into a specific platform loop duration
+		*(like the cpufreq period)
+		*/
+		max_load_loop += 33333;
+		max_load_loop %= 1000000;
+	}
+
+	res->ns_per_loop = lround(st.mean);
+	res->stddev = st.stddev;
+	res->nr_samples = st.nr_samples;
+}
+
+/*
+* calibrate_cpu_cycles_1()
+* 1st method to calibrate the ns per loop value
+* We alternate idle period and run period in order to not trig some hw
+* protection mechanism like thermal mitgation
+*/
+void calibrate_cpu_cycles_1(int clock, burn_fn_t fn, calib_result_t *res)
+{
+	int64_t budget = (int64_t)calib.budget_ms * 1000000 / 2;
+	int64_t idle = budget / (4 * CALIB_MIN_SAMPLES);
+
+	/* Up to 1 sec of idle time between 2 samples */
+	if (idle > 1000000000)
+		idle = 1000000000;
+
+	calibrate_samples(clock, fn, idle, budget, res);
+}
+
+/*
+* calibrate_cpu_cycles_2()
+* 2nd method to calibrate the ns per loop value
+* We continously runs something to ensure that CPU is set to max freq by the
+* governor
+*/
+void calibrate_cpu_cycles_2(int clock, burn_fn_t fn, calib_result_t *res)
+{
+	calibrate_samples(clock, fn, 0, (int64_t)calib.budget_ms * 1000000 / 2, res);
+}
+
+/*
+* calibrate_cpu_cycles()
+* Use several methods to calibrate the ns per loop and get the min value which
+* correspond to the highest achievable compute capacity.
+*/
+void calibrate_cpu_cycles(int clock, burn_kernel_t *kernel, calib_result_t *res)
+{
+	calib_result_t calib1 = { 0 }, calib2 = { 0 };
+
+	/* Run 1st method */
+	calibrate_cpu_cycles_1(clock, kernel->fn, &calib1);
+
+	/* Run 2nd method */
+	calibrate_cpu_cycles_2(clock, kernel->fn, &calib2);
+
+	if (calib1.ns_per_loop && calib1.ns_per_loop < calib2.ns_per_loop)
+		*res = calib1;
+	else
+		*res = calib2;
+}
+
+static void log_calib_result(burn_kernel_t *kernel, int cpu, calib_result_t *res)
+{
+	char what[64];
+
+	if (cpu < 0)
+		snprintf(what, sizeof(what), "pLoad");
+	else
+		snprintf(what, sizeof(what), "pLoad[CPU%d]", cpu);
+
+	if (kernel != &burn_kernels[BURN_DEFAULT_KERNEL])
+		snprintf(what + strlen(what), sizeof(what) - strlen(what),
+			 " %s", kernel->name);
+
+	log_notice("%s = %dns (stddev %.2fns, %d samples%s)", what,
+		   res->ns_per_loop, res->stddev, res->nr_samples,
+		   res->converged ? "" : ", budget exhausted");
+}
+
+struct calib_thread {
+	pthread_t thread;
+	int cpu;
+	const int *todo;	/* kernels to calibrate */
+};
+
+static void *calibrate_cpu_thread(void *arg)
+{
+	struct calib_thread *ct = arg;
+	calib_result_t res;
+	int i;
+
+	for (i = 0; i < nr_burn_kernels; i++) {
+		burn_kernel_t *kernel = &burn_kernels[i];
+
+		if (!ct->todo[i])
+			continue;
+
+		calibrate_cpu_cycles(CLOCK_MONOTONIC, kernel, &res);
+		/* Each thread only writes the entries of its CPU */
+		kernel->ns_per_loop[ct->cpu] = res.ns_per_loop;
+		kernel->stddev[ct->cpu] = res.stddev;
+		log_calib_result(kernel, ct->cpu, &res);
+	}
+
+	return NULL;
+}
+
+/*
+ * Calibrate the kernels set in @todo on all the CPUs the process is allowed to
+ * run on, in parallel, with one thread pinned on each CPU.
+ */
+static void calibrate_all_cpus(const int *todo)
+{
+	struct calib_thread *threads;
+	cpu_set_t allowed;
+	int cpu, nr_threads = 0, i;
+
+	threads = calloc(calib.nr_cpus, sizeof(*threads));
+	if (!threads) {
+		log_error("Cannot allocate calibration threads");
+		exit(EXIT_FAILURE);
+	}
+
+	sched_getaffinity(0, sizeof(cpu_set_t), &allowed);
+
+	for (cpu = 0; cpu < calib.nr_cpus && cpu < CPU_SETSIZE; cpu++) {
+		struct calib_thread *ct = &threads[nr_threads];
+		pthread_attr_t attr;
+		cpu_set_t cpuset;
+
+		if (!CPU_ISSET(cpu, &allowed))
+			continue;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu, &cpuset);
+		pthread_attr_init(&attr);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpuset);
+
+		ct->cpu = cpu;
+		ct->todo = todo;
+		if (pthread_create(&ct->thread, &attr, calibrate_cpu_thread, ct)) {
+			/* CPU probably went offline */
+			log_error("Cannot calibrate CPU%d", cpu);
+		} else {
+			nr_threads++;
+		}
+
+		pthread_attr_destroy(&attr);
+	}
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i].thread, NULL);
+
+	free(threads);
+}
+
+static int read_cpu_capacity(int cpu)
+{
+	char path[PATH_LENGTH];
+	FILE *f;
+	int capacity;
+
+	snprintf(path, PATH_LENGTH,
+		 "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+
+	f = fopen(path, "r");
+	if (!f)
+		return CALIB_CAPACITY_SCALE;
+
+	if (fscanf(f, "%d", &capacity) != 1 || capacity <= 0)
+		capacity = CALIB_CAPACITY_SCALE;
+
+	fclose(f);
+
+	return capacity;
+}
+
+/*
+ * Calibration cache
+ *
+ * The result of a calibration is only valid for a given platform state: CPU
+ * model and microcode, kernel, cpufreq policy and rt-app build. All of these
+ * are hashed, with the name of the burn kernel, into a key and the cache file
+ * contains one line per CPU:
+ *	<key> <cpu> <ns_per_loop> <stddev>
+ * Lines with other keys are kept so that a cache file can be shared between
+ * several platforms or configurations.
+ */
+#define CALIB_LINE_LENGTH	128
+
+static uint64_t fnv1a(uint64_t hash, const char *str)
+{
+	for (; *str; str++) {
+		hash ^= (unsigned char)*str;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static uint64_t hash_file(uint64_t hash, const char *path, const char **prefixes)
+{
+	char line[CALIB_LINE_LENGTH];
+	const char **prefix;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return fnv1a(hash, "-");
+
+	while (fgets(line, sizeof(line), f)) {
+		if (!prefixes) {
+			hash = fnv1a(hash, line);
+			continue;
+		}
+
+		for (prefix = prefixes; *prefix; prefix++) {
+			if (!strncmp(line, *prefix, strlen(*prefix))) {
+				hash = fnv1a(hash, line);
+				break;
+			}
+		}
+	}
+
+	fclose(f);
+
+	return hash;
+}
+
+static uint64_t calib_cache_key(rtapp_options_t *opts, burn_kernel_t *kernel)
+{
+	static const char *cpuinfo[] = { "model name", "microcode",
+		"CPU implementer", "CPU variant", "CPU part", "CPU revision", NULL };
+	static const char *cpufreq[] = { "scaling_governor", "scaling_min_freq",
+		"scaling_max_freq", NULL };
+	char path[PATH_LENGTH], tmp[32];
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	struct utsname uts;
+	const char **file;
+	int cpu;
+
+	hash = fnv1a(hash, PACKAGE " " VERSION);
+
+	if (!uname(&uts)) {
+		hash = fnv1a(hash, uts.release);
+		hash = fnv1a(hash, uts.version);
+		hash = fnv1a(hash, uts.machine);
+	}
+
+	hash = hash_file(hash, "/proc/cpuinfo", cpuinfo);
+
+	for (cpu = 0; cpu < calib.nr_cpus; cpu++) {
+		for (file = cpufreq; *file; file++) {
+			snprintf(path, PATH_LENGTH,
+				 "/sys/devices/system/cpu/cpu%d/cpufreq/%s", cpu, *file);
+			hash = hash_file(hash, path, NULL);
+		}
+	}
+
+	snprintf(tmp, sizeof(tmp), "calib_cpu %d", opts->calib_cpu);
+	hash = fnv1a(hash, tmp);
+	hash = fnv1a(hash, kernel->name);
+
+	return hash;
+}
+
+/*
+ * Load the values of @key from the cache. Return 1 if all the CPUs which have
+ * to be calibrated are in the cache.
+ */
+static int calib_cache_load(const char *path, uint64_t key, cpu_set_t *cpus,
+			    burn_kernel_t *kernel)
+{
+	char line[CALIB_LINE_LENGTH];
+	uint64_t line_key;
+	int cpu, ns_per_loop, found = 0;
+	double stddev;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%" SCNx64 " %d %d %lf", &line_key, &cpu,
+			   &ns_per_loop, &stddev) != 4)
+			continue;
+
+		if (line_key != key || cpu < 0 || cpu >= calib.nr_cpus ||
+		    !CPU_ISSET(cpu, cpus) || ns_per_loop <= 0)
+			continue;
+
+		if (!kernel->ns_per_loop[cpu])
+			found++;
+		kernel->ns_per_loop[cpu] = ns_per_loop;
+		kernel->stddev[cpu] = stddev;
+	}
+
+	fclose(f);
+
+	if (found == CPU_COUNT(cpus))
+		return 1;
+
+	/* Partial hit, calibrate everything again */
+	memset(kernel->ns_per_loop, 0, calib.nr_cpus * sizeof(int));
+	memset(kernel->stddev, 0, calib.nr_cpus * sizeof(double));
+
+	return 0;
+}
+
+static void calib_cache_store(const char *path, uint64_t key, cpu_set_t *cpus,
+			      burn_kernel_t *kernel)
+{
+	char line[CALIB_LINE_LENGTH], tmp_path[PATH_LENGTH];
+	uint64_t line_key;
+	FILE *in, *out;
+	int cpu;
+
+	snprintf(tmp_path, PATH_LENGTH, "%s.%d", path, getpid());
+	out = fopen(tmp_path, "w");
+	if (!out) {
+		log_error("Cannot write calibration cache %s: %s", tmp_path,
+			  strerror(errno));
+		return;
+	}
+
+	/* Keep the entries of other platforms */
+	in = fopen(path, "r");
+	if (in) {
+		while (fgets(line, sizeof(line), in)) {
+			if (sscanf(line, "%" SCNx64, &line_key) == 1 && line_key == key)
+				continue;
+			fputs(line, out);
+		}
+		fclose(in);
+	}
+
+	for (cpu = 0; cpu < calib.nr_cpus; cpu++) {
+		if (!CPU_ISSET(cpu, cpus) || !kernel->ns_per_loop[cpu])
+			continue;
+		fprintf(out, "%016" PRIx64 " %d %d %.3f\n", key, cpu,
+			kernel->ns_per_loop[cpu], kernel->stddev[cpu]);
+	}
+
+	if (fclose(out) || rename(tmp_path, path)) {
+		log_error("Cannot update calibration cache %s: %s", path,
+			  strerror(errno));
+		unlink(tmp_path);
+	}
+}
+
+/*
+ * calibrate()
+ * Fill the per CPU ns per loop tables of the burn kernels used by the run
+ * events, either with the value set in the configuration (default kernel
+ * only), with the values of the calibration cache, with the values measured
+ * on calib_cpu or with the values measured on each CPU.
+ */
+void calibrate(rtapp_options_t *opts)
+{
+	burn_kernel_t *kernel;
+	cpu_set_t calib_set;
+	uint64_t *keys;
+	int *todo;
+	int i, cpu, nr_todo = 0;
+
+	calib.nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	calib.capacity = calloc(calib.nr_cpus, sizeof(int));
+	keys = calloc(nr_burn_kernels, sizeof(uint64_t));
+	todo = calloc(nr_burn_kernels, sizeof(int));
+	if (!calib.capacity || !keys || !todo) {
+		log_error("Cannot allocate calibration table");
+		exit(EXIT_FAILURE);
+	}
+
+	for (cpu = 0; cpu < calib.nr_cpus; cpu++)
+		calib.capacity[cpu] = read_cpu_capacity(cpu);
+
+	calib.capacity_normalized = opts->capacity_normalized;
+	calib.ci = opts->calib_ci / 100.0;
+	calib.budget_ms = opts->calib_budget;
+	calib.per_cpu = (opts->calib_cpu == CALIB_ALL_CPUS);
+
+	if (calib.per_cpu) {
+		sched_getaffinity(0, sizeof(cpu_set_t), &calib_set);
+	} else {
+		CPU_ZERO(&calib_set);
+		CPU_SET(opts->calib_cpu, &calib_set);
+	}
+
+	/* The default kernel is always available for the run events */
+	burn_kernels[BURN_DEFAULT_KERNEL].used = 1;
+	burn_kernels_init();
+
+	for (i = 0; i < nr_burn_kernels; i++) {
+		kernel = &burn_kernels[i];
+		if (!kernel->used)
+			continue;
+
+		kernel->ns_per_loop = calloc(calib.nr_cpus, sizeof(int));
+		kernel->stddev = calloc(calib.nr_cpus, sizeof(double));
+		if (!kernel->ns_per_loop || !kernel->stddev) {
+			log_error("Cannot allocate calibration table");
+			exit(EXIT_FAILURE);
+		}
+
+		if (i == BURN_DEFAULT_KERNEL && opts->calib_ns_per_loop) {
+			kernel->p_load = opts->calib_ns_per_loop;
+			log_notice("pLoad = %dns", kernel->p_load);
+			continue;
+		}
+
+		if (opts->calib_cache) {
+			keys[i] = calib_cache_key(opts, kernel);
+			if (calib_cache_load(opts->calib_cache, keys[i],
+					     &calib_set, kernel)) {
+				log_notice("Calibration of %s loaded from %s (key %016" PRIx64 ")",
+					   kernel->name, opts->calib_cache, keys[i]);
+				continue;
+			}
+		}
+
+		todo[i] = 1;
+		nr_todo++;
+	}
+
+	if (nr_todo && calib.per_cpu) {
+		log_notice("Calibrate ns per loop on all CPUs");
+		calibrate_all_cpus(todo);
+	} else if (nr_todo) {
+		cpu_set_t orig_set;
+		calib_result_t res;
+
+		log_notice("Calibrate ns per loop");
+		sched_getaffinity(0, sizeof(cpu_set_t), &orig_set);
+		sched_setaffinity(0, sizeof(cpu_set_t), &calib_set);
+		for (i = 0; i < nr_burn_kernels; i++) {
+			if (!todo[i])
+				continue;
+			kernel = &burn_kernels[i];
+			calibrate_cpu_cycles(CLOCK_MONOTONIC, kernel, &res);
+			log_calib_result(kernel, -1, &res);
+			kernel->ns_per_loop[opts->calib_cpu] = res.ns_per_loop;
+			kernel->stddev[opts->calib_cpu] = res.stddev;
+		}
+		sched_setaffinity(0, sizeof(cpu_set_t), &orig_set);
+	}
+
+	for (i = 0; i < nr_burn_kernels; i++) {
+		kernel = &burn_kernels[i];
+		if (!kernel->used)
+			continue;
+
+		if (todo[i] && opts->calib_cache)
+			calib_cache_store(opts->calib_cache, keys[i], &calib_set,
+					  kernel);
+
+		/* The reference is the highest compute capacity */
+		for (cpu = 0; cpu < calib.nr_cpus; cpu++) {
+			if (!kernel->ns_per_loop[cpu])
+				continue;
+			if (!kernel->p_load || kernel->ns_per_loop[cpu] < kernel->p_load)
+				kernel->p_load = kernel->ns_per_loop[cpu];
+		}
+
+		if (!calib.per_cpu) {
+			/* Only the reference value is used by the run events */
+			memset(kernel->ns_per_loop, 0, calib.nr_cpus * sizeof(int));
+			if (i != BURN_DEFAULT_KERNEL)
+				log_notice("pLoad %s = %dns : calib_cpu %d",
+					   kernel->name, kernel->p_load,
+					   opts->calib_cpu);
+			else if (!opts->calib_ns_per_loop)
+				log_notice("pLoad = %dns : calib_cpu %d",
+					   kernel->p_load, opts->calib_cpu);
+		}
+
+		/* CPUs which have not been calibrated use the reference value */
+		for (cpu = 0; cpu < calib.nr_cpus; cpu++) {
+			if (!kernel->ns_per_loop[cpu])
+				kernel->ns_per_loop[cpu] = kernel->p_load;
+			if (calib.per_cpu)
+				log_notice("pLoad[CPU%d] %s = %dns capacity %d",
+					   cpu, kernel->name,
+					   kernel->ns_per_loop[cpu],
+					   calib.capacity[cpu]);
+		}
+	}
+
+	free(todo);
+	free(keys);
+}
@@ -0,0 +1,77 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _RTAPP_CALIB_H_
+#define _RTAPP_CALIB_H_
+
+#include "rt-app_types.h"
+#include "rt-app_burn.h"
+
+/* calib_cpu value asking to calibrate every CPU */
+#define CALIB_ALL_CPUS		-1
+
+/* capacity of the biggest CPU at max frequency, see cpu_capacity in sysfs */
+#define CALIB_CAPACITY_SCALE	1024
+
+/* Default relative half-width of the 95% confidence interval, in percent */
+#define CALIB_DEFAULT_CI	2
+/* Default time budget of a calibration, in ms */
+#define CALIB_DEFAULT_BUDGET	5000
+
+typedef struct _calib_result_t {
+	int ns_per_loop;	/* mean of the last samples */
+	double stddev;		/* standard deviation of these samples */
+	int nr_samples;		/* number of samples taken */
+	int converged;		/* 0 if the time budget has been exhausted */
+} calib_result_t;
+
+typedef struct _calib_data_t {
+	int per_cpu;		/* ns_per_loop differs between CPUs */
+	int capacity_normalized;/* run durations are given at max capacity */
+	int nr_cpus;		/* size of the per CPU tables */
+	int *capacity;		/* cpu_capacity of each CPU */
+	double ci;		/* target relative half-width of the 95% CI */
+	int budget_ms;		/* time budget of a calibration */
+} calib_data_t;
+
+extern calib_data_t calib;
+
+void calibrate_cpu_cycles(int clock, burn_kernel_t *kernel, calib_result_t *res);
+
+void calibrate(rtapp_options_t *opts);
+
+static inline int calib_cpu_ns_per_loop(const burn_kernel_t *kernel, int cpu)
+{
+	if (cpu < 0 || cpu >= calib.nr_cpus)
+		return kernel->p_load;
+
+	return kernel->ns_per_loop[cpu];
+}
+
+static inline int calib_cpu_capacity(int cpu)
+{
+	if (cpu < 0 || cpu >= calib.nr_cpus)
+		return CALIB_CAPACITY_SCALE;
+
+	return calib.capacity[cpu];
+}
+
+#endif /* _RTAPP_CALIB_H_ */
@@ -0,0 +1,227 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "rt-app_chase.h"
+
+/* Shift of the pointer from a page to the next with "tlb" */
+#define CHASE_LINE	64
+
+static const char *pattern_names[chase_patterns] = {
+	[chase_sequential] = "sequential",
+	[chase_random] = "random",
+	[chase_bitreverse] = "bitreverse",
+};
+
+const char *chase_pattern_name(chase_pattern_t pattern)
+{
+	return pattern_names[pattern];
+}
+
+int chase_pattern_index(const char *name)
+{
+	int i;
+
+	for (i = 0; i < chase_patterns; i++)
+		if (!strcmp(name, pattern_names[i]))
+			return i;
+
+	return -1;
+}
+
+/*
+ * Bit-reverse an integer across nbits.
+ * E.g., bitreverse(1, 3) = 4 (001 -> 100)
+ */
+static inline size_t bitreverse(size_t val, int nbits)
+{
+	size_t result = 0;
+	int j;
+
+	for (j = 0; j < nbits; j++)
+		if (val & ((size_t)1 << j))
+			result |= (size_t)1 << (nbits - j - 1);
+
+	return result;
+}
+
+/* floor(log2(@val)), @val > 0 */
+static int chase_log2(size_t val)
+{
+	int nbits = 0;
+
+	while (((size_t)1 << (nbits + 1)) <= val)
+		nbits++;
+
+	return nbits;
+}
+
+/* splitmix64, the seed only selects the permutation */
+static uint64_t chase_rand(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/*
+ * Address of the pointer of the i-th position of chain k. The chains are
+ * interleaved so that each one spans the whole buffer. With "tlb" the
+ * positions are pages and the pointer moves by a cache line from a page to
+ * the next so that the positions don't all fall in the same cache sets.
+ */
+static char *chase_slot(const struct _rtapp_mem_chase_buf *chase, int k,
+			size_t i)
+{
+	size_t pos = k + i * chase->chains;
+	char *slot = chase->base + pos * chase->stride;
+
+	if (chase->tlb)
+		slot += (pos * CHASE_LINE) % chase->stride;
+
+	return slot;
+}
+
+#define CHASE_NEXT(chase, k, i)	(*(size_t *)chase_slot(chase, k, i))
+
+int chase_layout(struct _rtapp_mem_chase_buf *chase)
+{
+	size_t m;
+
+	chase->base = NULL;
+	chase->len = 0;
+
+	if (chase->tlb)
+		chase->stride = sysconf(_SC_PAGESIZE);
+
+	/* Positions of each chain, a power of 2 for the bit reversal */
+	m = chase->size / chase->stride / chase->chains;
+	if (chase->pattern == chase_bitreverse && m)
+		m = (size_t)1 << chase_log2(m);
+
+	if (m < 2)
+		return -1;
+
+	chase->len = m * chase->chains * chase->stride;
+	return 0;
+}
+
+void chase_build(struct _rtapp_mem_chase_buf *chase)
+{
+	size_t m = chase->len / chase->stride / chase->chains;
+	int nbits = chase_log2(m);
+	uint64_t state = chase->seed;
+	size_t i, j, tmp;
+	int k;
+
+	/*
+	 * The index of the successor of each position in its chain is written
+	 * in the position first and then replaced by the address of the
+	 * successor.
+	 */
+	for (k = 0; k < chase->chains; k++) {
+		switch (chase->pattern) {
+		case chase_sequential:
+			for (i = 0; i < m; i++)
+				CHASE_NEXT(chase, k, i) = (i + 1) % m;
+			break;
+		case chase_random:
+			/*
+			 * Sattolo's algorithm: a permutation drawn uniformly
+			 * among those with a single cycle, which visits every
+			 * position in a random order.
+			 */
+			for (i = 0; i < m; i++)
+				CHASE_NEXT(chase, k, i) = i;
+			for (i = m - 1; i > 0; i--) {
+				j = chase_rand(&state) % i;
+				tmp = CHASE_NEXT(chase, k, i);
+				CHASE_NEXT(chase, k, i) = CHASE_NEXT(chase, k, j);
+				CHASE_NEXT(chase, k, j) = tmp;
+			}
+			break;
+		default:
+			for (i = 0; i < m; i++)
+				CHASE_NEXT(chase, k, bitreverse(i, nbits)) =
+					bitreverse((i + 1) % m, nbits);
+			break;
+		}
+
+		for (i = 0; i < m; i++)
+			*(char **)chase_slot(chase, k, i) =
+				chase_slot(chase, k, CHASE_NEXT(chase, k, i));
+
+		chase->heads[k] = chase_slot(chase, k, 0);
+	}
+}
+
+/* Follow @hops pointers of each of the @n chains, kept in registers */
+static inline __attribute__((always_inline))
+void chase_hops(char **heads, unsigned long hops, const int n)
+{
+	char *p[CHASE_MAX_CHAINS];
+	unsigned long i;
+	int k;
+
+	for (k = 0; k < n; k++)
+		p[k] = heads[k];
+
+	for (i = 0; i < hops; i++)
+		for (k = 0; k < n; k++)
+			p[k] = *(char **)p[k];
+
+	for (k = 0; k < n; k++)
+		heads[k] = p[k];
+}
+
+#define CHASE_HOPS(n)	case n: chase_hops(chase->heads, hops, n); break
+
+unsigned long chase_run(struct _rtapp_mem_chase_buf *chase,
+			unsigned long count)
+{
+	unsigned long hops;
+
+	if (!chase->base)
+		return 0;
+
+	/*
+	 * The positions reached are stored back in the resource, which keeps
+	 * the chases alive and is where the next event goes on.
+	 */
+	hops = count / chase->chains;
+	switch (chase->chains) {
+	CHASE_HOPS(1); CHASE_HOPS(2); CHASE_HOPS(3); CHASE_HOPS(4);
+	CHASE_HOPS(5); CHASE_HOPS(6); CHASE_HOPS(7); CHASE_HOPS(8);
+	CHASE_HOPS(9); CHASE_HOPS(10); CHASE_HOPS(11); CHASE_HOPS(12);
+	CHASE_HOPS(13); CHASE_HOPS(14); CHASE_HOPS(15); CHASE_HOPS(16);
+	}
+
+	return hops * chase->chains;
+}
@@ -0,0 +1,58 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+
+#ifndef _RTAPP_CHASE_H_
+#define _RTAPP_CHASE_H_
+
+#include "rt-app_types.h"
+
+/*
+ * Pointer chasing of the memrun events: the buffer holds one pointer every
+ * stride bytes and each pointer holds the address of the next position of
+ * its chain, so every access depends on the previous one and costs the full
+ * latency of the level of the memory hierarchy which holds the buffer. The
+ * positions are split between the chains, which are followed together to
+ * have as many accesses in flight.
+ */
+
+/* Name of a pattern and pattern of a name, -1 if unknown */
+const char *chase_pattern_name(chase_pattern_t pattern);
+int chase_pattern_index(const char *name);
+
+/*
+ * Set the bytes of the buffer of @chase needed by its parameters in
+ * chase->len, -1 if the buffer is too small for 2 positions per chain.
+ */
+int chase_layout(struct _rtapp_mem_chase_buf *chase);
+
+/* Build the chains in chase->base, of chase->len bytes */
+void chase_build(struct _rtapp_mem_chase_buf *chase);
+
+/*
+ * Follow @count pointers, shared between the chains, from where the last
+ * call stopped. Returns the pointers followed.
+ */
+unsigned long chase_run(struct _rtapp_mem_chase_buf *chase,
+			unsigned long count);
+
+#endif /* _RTAPP_CHASE_H_ */
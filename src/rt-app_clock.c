@@ -0,0 +1,124 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "rt-app_utils.h"
+#include "rt-app_clock.h"
+
+fastclock_t fastclock;
+
+/* Duration of the measurement of the counter frequency */
+#define FASTCLOCK_CALIB_NS	20000000
+
+#if defined(__x86_64__) || defined(__i386__)
+/* The TSC must be invariant: constant rate and running in deep C-states */
+static int fastclock_counter_usable(void)
+{
+	char line[4096];
+	int constant = 0, nonstop = 0;
+	FILE *f;
+
+	f = fopen("/proc/cpuinfo", "r");
+	if (!f)
+		return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (strncmp(line, "flags", strlen("flags")))
+			continue;
+		constant = strstr(line, " constant_tsc") != NULL;
+		nonstop = strstr(line, " nonstop_tsc") != NULL;
+		break;
+	}
+
+	fclose(f);
+
+	return constant && nonstop;
+}
+
+static double fastclock_counter_freq(void)
+{
+	struct timespec t0, t1;
+	uint64_t c0, c1;
+	int64_t ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	c0 = fastclock_ticks();
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		ns = timespec_sub_to_ns(&t1, &t0);
+	} while (ns < FASTCLOCK_CALIB_NS);
+	c1 = fastclock_ticks();
+
+	return (double)(c1 - c0) / ns * 1000000000.0;
+}
+#elif defined(__aarch64__)
+/* The generic timer is always-on and has a constant frequency */
+static int fastclock_counter_usable(void)
+{
+	return 1;
+}
+
+static double fastclock_counter_freq(void)
+{
+	uint64_t freq;
+
+	__asm__ __volatile__("mrs %0, cntfrq_el0" : "=r" (freq));
+	return (double)freq;
+}
+#else
+static int fastclock_counter_usable(void)
+{
+	return 0;
+}
+
+static double fastclock_counter_freq(void)
+{
+	return 0;
+}
+#endif
+
+void fastclock_init(void)
+{
+	double freq;
+
+	fastclock.type = FASTCLOCK_MONOTONIC;
+
+	if (!fastclock_counter_usable())
+		return;
+
+	freq = fastclock_counter_freq();
+	/* Not precise enough to time short runtime events */
+	if (freq < 10000000.0)
+		return;
+
+	fastclock.ns_per_tick = 1000000000.0 / freq;
+	fastclock.base = fastclock_ticks();
+	fastclock.type = FASTCLOCK_COUNTER;
+	log_info("runtime clock: cycle counter at %.0fHz", freq);
+}
+
+const char *fastclock_name(void)
+{
+	return fastclock.type == FASTCLOCK_COUNTER ? "counter" : "monotonic";
+}
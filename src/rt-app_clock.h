@@ -0,0 +1,83 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef _RTAPP_CLOCK_H_
+#define _RTAPP_CLOCK_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Cheap monotonic clock used to time the busy loops of the runtime events.
+ *
+ * The CPU cycle counter is used when it ticks at a constant rate and doesn't
+ * stop in idle states (invariant TSC on x86, generic timer on aarch64),
+ * CLOCK_MONOTONIC otherwise.
+ */
+enum fastclock_type {
+	FASTCLOCK_MONOTONIC = 0,
+	FASTCLOCK_COUNTER,
+};
+
+typedef struct _fastclock_t {
+	enum fastclock_type type;
+	double ns_per_tick;
+	uint64_t base;
+} fastclock_t;
+
+extern fastclock_t fastclock;
+
+void fastclock_init(void);
+
+const char *fastclock_name(void);
+
+static inline uint64_t fastclock_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	uint32_t lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+	uint64_t val;
+
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (val));
+	return val;
+#else
+	return 0;
+#endif
+}
+
+/* Current time in ns, with an arbitrary origin */
+static inline int64_t fastclock_ns(void)
+{
+	struct timespec ts;
+
+	if (fastclock.type == FASTCLOCK_COUNTER)
+		return (int64_t)((fastclock_ticks() - fastclock.base) *
+				 fastclock.ns_per_tick);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#endif /* _RTAPP_CLOCK_H_ */
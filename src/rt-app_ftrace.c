@@ -0,0 +1,228 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rt-app_ftrace.h"
+#include "rt-app_pmu.h"
+
+static char *fmt_str(char *p, const char *s)
+{
+	while (*s)
+		*p++ = *s++;
+
+	return p;
+}
+
+static char *fmt_long(char *p, long long v)
+{
+	unsigned long long u = v;
+	char tmp[24];
+	int n = 0;
+
+	if (v < 0) {
+		*p++ = '-';
+		u = -u;
+	}
+	do {
+		tmp[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u);
+	while (n)
+		*p++ = tmp[--n];
+
+	return p;
+}
+
+ftrace_marker_t *ftrace_event_markers(const phase_prog_t *prog)
+{
+	ftrace_marker_t *markers;
+	int i, n;
+
+	if (!(ftrace_level & FTRACE_EVENT) || !prog->nbevents)
+		return NULL;
+
+	markers = malloc(prog->nbevents * sizeof(*markers));
+	if (!markers) {
+		log_error("Cannot allocate ftrace markers");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < prog->nbevents; i++) {
+		n = snprintf(markers[i].str, FTRACE_MARKER_LENGTH,
+			     "rtapp_event: id=%d type=%d desc=%s",
+			     i, prog->events[i].type, prog->events[i].name);
+		if (n >= FTRACE_MARKER_LENGTH)
+			n = FTRACE_MARKER_LENGTH - 1;
+		markers[i].len = n;
+	}
+
+	return markers;
+}
+
+void ftrace_event_desc(int mark_fd, int ind, const phase_prog_t *prog)
+{
+	int i;
+
+	for (i = 0; i < prog->nbevents; i++)
+		ftrace_write(mark_fd,
+			     "rtapp_event_desc: ind=%d phase=%d id=%d type=%d desc=%s",
+			     ind, prog->phase, i, prog->events[i].type,
+			     prog->events[i].name);
+}
+
+void ftrace_stats_desc(int mark_fd, int ind)
+{
+	char names[FTRACE_BUF_SIZE], *p = names;
+	int i;
+
+	if (!pmu.nr)
+		return;
+
+	for (i = 0; i < pmu.nr; i++) {
+		if (i)
+			*p++ = ',';
+		p = fmt_str(p, pmu_event_name(pmu.ids[i]));
+	}
+	*p = '\0';
+
+	ftrace_write(mark_fd, "rtapp_stats_desc: ind=%d pmu=%s", ind, names);
+}
+
+void ftrace_loop(int mark_fd, int raw_fd, int ind, int start,
+		 int thread_loop, int phase, int phase_loop)
+{
+	char buf[FTRACE_BUF_SIZE], *p = buf;
+
+	if (raw_fd >= 0) {
+		struct ftrace_raw_loop raw;
+
+		ftrace_raw_hdr(&raw.hdr, start ? FTRACE_RAW_LOOP_START :
+				FTRACE_RAW_LOOP_END, ind);
+		raw.thread_loop = thread_loop;
+		raw.phase = phase;
+		raw.phase_loop = phase_loop;
+		raw.reserved = 0;
+		ftrace_write_buf(raw_fd, &raw, sizeof(raw));
+		return;
+	}
+
+	p = fmt_str(p, start ? "rtapp_loop: event=start thread_loop=" :
+			       "rtapp_loop: event=end thread_loop=");
+	p = fmt_long(p, thread_loop);
+	p = fmt_str(p, " phase=");
+	p = fmt_long(p, phase);
+	p = fmt_str(p, " phase_loop=");
+	p = fmt_long(p, phase_loop);
+	ftrace_write_buf(mark_fd, buf, p - buf);
+}
+
+void ftrace_stats(int mark_fd, int raw_fd, int ind, const timing_point_t *t)
+{
+	char buf[FTRACE_BUF_SIZE], *p = buf;
+	int i;
+
+	if (raw_fd >= 0) {
+		struct ftrace_raw_stats raw;
+
+		ftrace_raw_hdr(&raw.hdr, FTRACE_RAW_STATS, ind);
+		raw.period = t->period;
+		raw.run = t->duration;
+		raw.wu_lat = t->wu_latency;
+		raw.slack = t->slack;
+		raw.c_period = t->c_period;
+		raw.c_run = t->c_duration;
+		raw.ovr = t->overshoot;
+		raw.nr_pmu = pmu.nr;
+		raw.reserved = 0;
+		for (i = 0; i < pmu.nr; i++)
+			raw.pmu[i] = t->pmu[i];
+		ftrace_write_buf(raw_fd, &raw, sizeof(raw) -
+				 (PMU_MAX_EVENTS - pmu.nr) * sizeof(raw.pmu[0]));
+		return;
+	}
+
+	p = fmt_str(p, "rtapp_stats: period=");
+	p = fmt_long(p, t->period);
+	p = fmt_str(p, " run=");
+	p = fmt_long(p, t->duration);
+	p = fmt_str(p, " wu_lat=");
+	p = fmt_long(p, t->wu_latency);
+	p = fmt_str(p, " slack=");
+	p = fmt_long(p, t->slack);
+	p = fmt_str(p, " c_period=");
+	p = fmt_long(p, t->c_period);
+	p = fmt_str(p, " c_run=");
+	p = fmt_long(p, t->c_duration);
+	p = fmt_str(p, " ovr=");
+	p = fmt_long(p, t->overshoot);
+	/* the counter names are short, PMU_MAX_EVENTS of them fit in buf */
+	for (i = 0; i < pmu.nr; i++) {
+		*p++ = ' ';
+		p = fmt_str(p, pmu_event_name(pmu.ids[i]));
+		*p++ = '=';
+		p = fmt_long(p, t->pmu[i]);
+	}
+	ftrace_write_buf(mark_fd, buf, p - buf);
+}
+
+void ftrace_dmiss(int mark_fd, int raw_fd, int ind, const rtapp_resource_t *rdata,
+		  long overrun, unsigned long consecutive)
+{
+	if (raw_fd >= 0) {
+		struct ftrace_raw_dmiss raw;
+
+		ftrace_raw_hdr(&raw.hdr, FTRACE_RAW_DMISS, ind);
+		raw.overrun = overrun;
+		raw.consecutive = consecutive;
+		raw.res = rdata->index;
+		raw.reserved = 0;
+		ftrace_write_buf(raw_fd, &raw, sizeof(raw));
+		return;
+	}
+
+	ftrace_write(mark_fd, "rtapp_dmiss: timer=%s overrun=%ld consecutive=%lu",
+		     rdata->name, overrun, consecutive);
+}
+
+void ftrace_wakeup(int mark_fd, int raw_fd, int ind,
+		   const rtapp_resource_t *rdata, long lat, unsigned int seq,
+		   unsigned int rank)
+{
+	if (raw_fd >= 0) {
+		struct ftrace_raw_wakeup raw;
+
+		ftrace_raw_hdr(&raw.hdr, FTRACE_RAW_WAKEUP, ind);
+		raw.lat = lat;
+		raw.seq = seq;
+		raw.rank = rank;
+		raw.res = rdata->index;
+		raw.reserved = 0;
+		ftrace_write_buf(raw_fd, &raw, sizeof(raw));
+		return;
+	}
+
+	ftrace_write(mark_fd, "rtapp_wakeup: res=%s seq=%u rank=%u lat_ns=%ld",
+		     rdata->name, seq, rank, lat);
+}
@@ -0,0 +1,169 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef _RTAPP_FTRACE_H_
+#define _RTAPP_FTRACE_H_
+
+#include <stdint.h>
+
+#include "rt-app_types.h"
+#include "rt-app_utils.h"
+
+/*
+ * Markers written on the path of the tasks: the text markers are built
+ * without printf and the rtapp_event ones are formatted once when the phases
+ * are compiled.
+ *
+ * With the binary ftrace_format, the same markers are written as the structs
+ * below in trace_marker_raw. The kernel stores the first 32 bits as the id of
+ * the raw_data event; doc/decode_ftrace_raw.py turns them back into the text
+ * markers. The structs are in the native byte order.
+ */
+#define FTRACE_RAW_ID		0x72746170	/* "rtap" */
+#define FTRACE_RAW_VERSION	1
+
+#define FTRACE_MARKER_LENGTH	96
+
+enum ftrace_raw_type {
+	FTRACE_RAW_EVENT = 1,
+	FTRACE_RAW_LOOP_START,
+	FTRACE_RAW_LOOP_END,
+	FTRACE_RAW_STATS,
+	FTRACE_RAW_DMISS,
+	FTRACE_RAW_WAKEUP,
+};
+
+struct ftrace_raw_hdr {
+	uint32_t id;		/* FTRACE_RAW_ID */
+	uint16_t type;		/* enum ftrace_raw_type */
+	uint16_t version;
+	int32_t ind;		/* index of the thread */
+	uint32_t reserved;
+};
+
+struct ftrace_raw_event {
+	struct ftrace_raw_hdr hdr;
+	int32_t phase;
+	int32_t event;		/* index of the event in the phase */
+	int32_t type;		/* resource_t */
+	uint32_t reserved;
+};
+
+struct ftrace_raw_loop {
+	struct ftrace_raw_hdr hdr;
+	int32_t thread_loop;
+	int32_t phase;
+	int32_t phase_loop;
+	uint32_t reserved;
+};
+
+struct ftrace_raw_stats {
+	struct ftrace_raw_hdr hdr;
+	int64_t period;
+	int64_t run;
+	int64_t wu_lat;
+	int64_t slack;
+	int64_t c_period;
+	int64_t c_run;
+	int64_t ovr;
+	uint32_t nr_pmu;
+	uint32_t reserved;
+	uint64_t pmu[PMU_MAX_EVENTS];	/* only nr_pmu are written */
+};
+
+struct ftrace_raw_dmiss {
+	struct ftrace_raw_hdr hdr;
+	int64_t overrun;	/* usec */
+	uint64_t consecutive;
+	int32_t res;		/* index of the timer resource */
+	uint32_t reserved;
+};
+
+struct ftrace_raw_wakeup {
+	struct ftrace_raw_hdr hdr;
+	int64_t lat;		/* nsec since the wake up */
+	uint32_t seq;		/* sequence number of the wake up */
+	uint32_t rank;		/* wakees which returned before this one */
+	int32_t res;		/* index of the wait or semaphore resource */
+	uint32_t reserved;
+};
+
+typedef struct _ftrace_marker_t {
+	char str[FTRACE_MARKER_LENGTH];
+	int len;
+} ftrace_marker_t;
+
+static inline void ftrace_raw_hdr(struct ftrace_raw_hdr *hdr, int type, int ind)
+{
+	hdr->id = FTRACE_RAW_ID;
+	hdr->type = type;
+	hdr->version = FTRACE_RAW_VERSION;
+	hdr->ind = ind;
+	hdr->reserved = 0;
+}
+
+/* Preformat the rtapp_event markers of @prog, NULL if not traced */
+ftrace_marker_t *ftrace_event_markers(const phase_prog_t *prog);
+
+/* rtapp_event_desc markers which give the name of the raw events */
+void ftrace_event_desc(int mark_fd, int ind, const phase_prog_t *prog);
+
+static inline void ftrace_event(const event_ctx_t *ctx,
+				const phase_prog_t *prog, int id)
+{
+	const event_data_t *ev = &prog->events[id];
+
+	if (ctx->raw_fd >= 0) {
+		struct ftrace_raw_event raw;
+
+		ftrace_raw_hdr(&raw.hdr, FTRACE_RAW_EVENT,
+			       ctx->tdata ? ctx->tdata->ind : -1);
+		raw.phase = prog->phase;
+		raw.event = id;
+		raw.type = ev->type;
+		raw.reserved = 0;
+		ftrace_write_buf(ctx->raw_fd, &raw, sizeof(raw));
+	} else if (prog->markers) {
+		ftrace_write_buf(ctx->marker_fd, prog->markers[id].str,
+				 prog->markers[id].len);
+	} else {
+		ftrace_write(ctx->marker_fd, "rtapp_event: id=%d type=%d desc=%s",
+			     id, ev->type, ev->name);
+	}
+}
+
+/* rtapp_stats_desc marker which gives the name of the raw stats counters */
+void ftrace_stats_desc(int mark_fd, int ind);
+
+void ftrace_loop(int mark_fd, int raw_fd, int ind, int start,
+		 int thread_loop, int phase, int phase_loop);
+
+void ftrace_stats(int mark_fd, int raw_fd, int ind, const timing_point_t *t);
+
+void ftrace_dmiss(int mark_fd, int raw_fd, int ind, const rtapp_resource_t *rdata,
+		  long overrun, unsigned long consecutive);
+
+void ftrace_wakeup(int mark_fd, int raw_fd, int ind,
+		   const rtapp_resource_t *rdata, long lat, unsigned int seq,
+		   unsigned int rank);
+
+#endif /* _RTAPP_FTRACE_H_ */
@@ -0,0 +1,290 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rt-app_utils.h"
+#include "rt-app_hist.h"
+
+static const char *hist_metric_names[HIST_NR_METRICS] = {
+	[HIST_WU_LAT] = "wu_lat",
+	[HIST_SLACK] = "slack",
+	[HIST_PERIOD] = "period",
+};
+
+static const double hist_pct[] = { 50, 90, 99, 99.9, 99.99 };
+static const char *hist_pct_names[] = { "p50", "p90", "p99", "p99.9", "p99.99" };
+#define HIST_NR_PCT	(sizeof(hist_pct) / sizeof(hist_pct[0]))
+
+static unsigned long long *hist_alloc_buckets(void)
+{
+	unsigned long long *b;
+
+	b = malloc(HIST_NR_BUCKETS * sizeof(*b));
+	if (!b) {
+		log_error("Cannot allocate histogram");
+		exit(EXIT_FAILURE);
+	}
+	/* fault the buckets in now rather than in the loop of the task */
+	memset(b, 0, HIST_NR_BUCKETS * sizeof(*b));
+
+	return b;
+}
+
+void hist_init(hist_t *h, int is_signed)
+{
+	memset(h, 0, sizeof(*h));
+	h->counts = hist_alloc_buckets();
+	if (is_signed)
+		h->neg = hist_alloc_buckets();
+}
+
+void hist_free(hist_t *h)
+{
+	free(h->counts);
+	free(h->neg);
+	h->counts = h->neg = NULL;
+}
+
+void hist_merge(hist_t *dst, const hist_t *src)
+{
+	int i;
+
+	if (!src->count)
+		return;
+
+	for (i = 0; i < HIST_NR_BUCKETS; i++)
+		dst->counts[i] += src->counts[i];
+	if (src->neg) {
+		if (!dst->neg)
+			dst->neg = hist_alloc_buckets();
+		for (i = 0; i < HIST_NR_BUCKETS; i++)
+			dst->neg[i] += src->neg[i];
+	}
+
+	if (!dst->count || src->min < dst->min)
+		dst->min = src->min;
+	if (!dst->count || src->max > dst->max)
+		dst->max = src->max;
+	dst->sum += src->sum;
+	dst->count += src->count;
+}
+
+/* Lowest value counted in bucket @idx */
+static unsigned long long hist_bucket_value(int idx)
+{
+	int e;
+
+	if (idx < HIST_SUB_COUNT)
+		return idx;
+
+	e = idx / HIST_HALF_COUNT - 1;
+	return (unsigned long long)(idx - e * HIST_HALF_COUNT) << e;
+}
+
+long long hist_percentile(const hist_t *h, double pct)
+{
+	unsigned long long rank, seen = 0;
+	long long v = h->max;
+	int i;
+
+	if (!h->count)
+		return 0;
+
+	rank = (unsigned long long)(pct / 100.0 * h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	/* the most negative values first */
+	for (i = HIST_NR_BUCKETS - 1; h->neg && i >= 0; i--) {
+		seen += h->neg[i];
+		if (seen >= rank) {
+			v = -(long long)hist_bucket_value(i);
+			goto found;
+		}
+	}
+
+	for (i = 0; i < HIST_NR_BUCKETS; i++) {
+		seen += h->counts[i];
+		if (seen >= rank) {
+			/* highest value counted in the bucket */
+			v = hist_bucket_value(i + 1) - 1;
+			goto found;
+		}
+	}
+
+found:
+	if (v < h->min)
+		v = h->min;
+	if (v > h->max)
+		v = h->max;
+
+	return v;
+}
+
+void hist_thread_init(thread_data_t *tdata)
+{
+	int i;
+
+	tdata->hists = malloc(tdata->nphases * HIST_NR_METRICS * sizeof(hist_t));
+	if (!tdata->hists) {
+		log_error("Cannot allocate histograms of %s", tdata->name);
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < tdata->nphases * HIST_NR_METRICS; i++)
+		hist_init(&tdata->hists[i], (i % HIST_NR_METRICS) == HIST_SLACK);
+}
+
+void hist_thread_free(thread_data_t *tdata)
+{
+	int i;
+
+	if (!tdata->hists)
+		return;
+
+	for (i = 0; i < tdata->nphases * HIST_NR_METRICS; i++)
+		hist_free(&tdata->hists[i]);
+	free(tdata->hists);
+	tdata->hists = NULL;
+}
+
+static void hist_report_text(FILE *out, const char *task, const char *phase,
+			     const hist_t *h)
+{
+	int m, p;
+
+	for (m = 0; m < HIST_NR_METRICS; m++) {
+		fprintf(out, "%-16s %5s %-7s %10llu %9lld %9lld",
+			task, phase, hist_metric_names[m], h[m].count,
+			h[m].min, h[m].count ? h[m].sum / (long long)h[m].count : 0);
+		for (p = 0; p < HIST_NR_PCT; p++)
+			fprintf(out, " %9lld", hist_percentile(&h[m], hist_pct[p]));
+		fprintf(out, " %9lld\n", h[m].max);
+	}
+}
+
+static void hist_report_json(FILE *out, const hist_t *h, const char *indent)
+{
+	int m, p;
+
+	fprintf(out, "{\n");
+	for (m = 0; m < HIST_NR_METRICS; m++) {
+		fprintf(out, "%s  \"%s\" : { \"count\" : %llu, \"min\" : %lld, "
+			"\"mean\" : %.1f",
+			indent, hist_metric_names[m], h[m].count, h[m].min,
+			h[m].count ? (double)h[m].sum / h[m].count : 0.0);
+		for (p = 0; p < HIST_NR_PCT; p++)
+			fprintf(out, ", \"%s\" : %lld", hist_pct_names[p],
+				hist_percentile(&h[m], hist_pct[p]));
+		fprintf(out, ", \"max\" : %lld }%s\n", h[m].max,
+			m < HIST_NR_METRICS - 1 ? "," : "");
+	}
+	fprintf(out, "%s}", indent);
+}
+
+static void hist_metrics_init(hist_t *h)
+{
+	int m;
+
+	for (m = 0; m < HIST_NR_METRICS; m++)
+		hist_init(&h[m], m == HIST_SLACK);
+}
+
+static void hist_metrics_free(hist_t *h)
+{
+	int m;
+
+	for (m = 0; m < HIST_NR_METRICS; m++)
+		hist_free(&h[m]);
+}
+
+void hist_report(thread_data_t **tdata, int nr, FILE *text, FILE *json)
+{
+	hist_t all[HIST_NR_METRICS], task[HIST_NR_METRICS];
+	char phase[16];
+	int i, j, m, p;
+
+	hist_metrics_init(all);
+
+	if (text) {
+		fprintf(text, "%-16s %5s %-7s %10s %9s %9s", "#task", "phase",
+			"metric", "count", "min", "mean");
+		for (p = 0; p < HIST_NR_PCT; p++)
+			fprintf(text, " %9s", hist_pct_names[p]);
+		fprintf(text, " %9s\n", "max");
+	}
+	if (json)
+		fprintf(json, "{\n  \"unit\" : \"usec\",\n  \"tasks\" : {\n");
+
+	for (i = 0; i < nr; i++) {
+		thread_data_t *td = tdata[i];
+
+		if (!td->hists)
+			continue;
+
+		hist_metrics_init(task);
+		if (json)
+			fprintf(json, "    \"%s\" : {\n      \"phases\" : [ ",
+				td->name);
+
+		for (j = 0; j < td->nphases; j++) {
+			hist_t *h = &td->hists[j * HIST_NR_METRICS];
+
+			for (m = 0; m < HIST_NR_METRICS; m++)
+				hist_merge(&task[m], &h[m]);
+
+			if (text && td->nphases > 1) {
+				snprintf(phase, sizeof(phase), "%d", j);
+				hist_report_text(text, td->name, phase, h);
+			}
+			if (json) {
+				hist_report_json(json, h, "      ");
+				fprintf(json, "%s", j < td->nphases - 1 ? ", " : " ],\n");
+			}
+		}
+
+		if (text)
+			hist_report_text(text, td->name, "all", task);
+		if (json) {
+			fprintf(json, "      \"all\" : ");
+			hist_report_json(json, task, "      ");
+			fprintf(json, "\n    }%s\n", i < nr - 1 ? "," : "");
+		}
+
+		for (m = 0; m < HIST_NR_METRICS; m++)
+			hist_merge(&all[m], &task[m]);
+		hist_metrics_free(task);
+	}
+
+	if (text)
+		hist_report_text(text, "all", "all", all);
+	if (json) {
+		fprintf(json, "  },\n  \"all\" : ");
+		hist_report_json(json, all, "  ");
+		fprintf(json, "\n}\n");
+	}
+
+	hist_metrics_free(all);
+}
@@ -0,0 +1,114 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef _RTAPP_HIST_H_
+#define _RTAPP_HIST_H_
+
+#include <stdio.h>
+#include "rt-app_types.h"
+
+/*
+ * Log-linear (HDR) histogram: values below 2^HIST_SUB_BITS have their own
+ * bucket, bigger values are counted in 2^(HIST_SUB_BITS - 1) buckets per power
+ * of 2, which bounds the relative error to 1/2^(HIST_SUB_BITS - 1) with a
+ * constant memory whatever the number of values.
+ */
+#define HIST_SUB_BITS	7
+#define HIST_SUB_COUNT	(1 << HIST_SUB_BITS)
+#define HIST_HALF_COUNT	(HIST_SUB_COUNT / 2)
+/* values above 2^HIST_MAX_BITS are counted in the last bucket */
+#define HIST_MAX_BITS	40
+#define HIST_NR_BUCKETS	((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_HALF_COUNT + \
+			 HIST_HALF_COUNT)
+
+/* Metrics recorded for each loop of a phase, in usec */
+enum hist_metric {
+	HIST_WU_LAT = 0,
+	HIST_SLACK,
+	HIST_PERIOD,
+	HIST_NR_METRICS
+};
+
+typedef struct _hist_t {
+	unsigned long long count;
+	long long min;
+	long long max;
+	long long sum;
+	unsigned long long *counts;	/* values >= 0 */
+	unsigned long long *neg;	/* absolute values < 0, NULL if unsigned */
+} hist_t;
+
+void hist_init(hist_t *h, int is_signed);
+void hist_free(hist_t *h);
+void hist_merge(hist_t *dst, const hist_t *src);
+/* value below which @pct percent of the values are */
+long long hist_percentile(const hist_t *h, double pct);
+
+static inline int hist_index(unsigned long long v)
+{
+	int e;
+
+	if (v < HIST_SUB_COUNT)
+		return v;
+	if (v >> HIST_MAX_BITS)
+		return HIST_NR_BUCKETS - 1;
+
+	e = 63 - __builtin_clzll(v) - HIST_SUB_BITS + 1;
+	return e * HIST_HALF_COUNT + (v >> e);
+}
+
+static inline void hist_record(hist_t *h, long long v)
+{
+	if (v < 0 && h->neg)
+		h->neg[hist_index(-v)]++;
+	else
+		h->counts[hist_index(v < 0 ? 0 : v)]++;
+
+	if (!h->count || v < h->min)
+		h->min = v;
+	if (!h->count || v > h->max)
+		h->max = v;
+	h->sum += v;
+	h->count++;
+}
+
+/* Histograms of each metric of each phase of @tdata */
+void hist_thread_init(thread_data_t *tdata);
+void hist_thread_free(thread_data_t *tdata);
+
+static inline void hist_thread_record(thread_data_t *tdata, int phase,
+				      const timing_point_t *t)
+{
+	hist_t *h = &tdata->hists[phase * HIST_NR_METRICS];
+
+	hist_record(&h[HIST_WU_LAT], t->wu_latency);
+	hist_record(&h[HIST_SLACK], t->slack);
+	hist_record(&h[HIST_PERIOD], t->period);
+}
+
+/*
+ * Print the summary of the histograms of the @nr threads in @tdata in @text
+ * and in @json, which can be NULL.
+ */
+void hist_report(thread_data_t **tdata, int nr, FILE *text, FILE *json);
+
+#endif /* _RTAPP_HIST_H_ */
@@ -0,0 +1,240 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+/*
+ * Asynchronous logger: the tasks push their timing points in per task rings
+ * and a dedicated thread drains them to the log files, so no I/O is done on
+ * the path of the tasks.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+
+#include "rt-app_utils.h"
+#include "rt-app_pmu.h"
+#include "rt-app_binlog.h"
+#include "rt-app_logger.h"
+
+/* records drained before giving room back to the task */
+#define LOGGER_BATCH		64
+
+static log_ring_t *rings;
+static pthread_t logger_thread;
+static volatile int logger_running;
+static int logger_started;
+static unsigned long ring_size = LOGGER_DEFAULT_RING;
+static int logger_period = LOGGER_DEFAULT_PERIOD;
+
+log_ring_t *logger_ring_open(int ind, FILE *log, int shared,
+			     struct _binlog_t *binlog)
+{
+	log_ring_t *ring;
+
+	if (posix_memalign((void **)&ring, LOGGER_CACHELINE, sizeof(*ring))) {
+		log_error("Cannot allocate log ring");
+		exit(EXIT_FAILURE);
+	}
+	memset(ring, 0, sizeof(*ring));
+
+	ring->slots = malloc(ring_size * sizeof(timing_point_t));
+	if (!ring->slots) {
+		log_error("Cannot allocate log ring of %lu records", ring_size);
+		exit(EXIT_FAILURE);
+	}
+	/* touch the ring now instead of faulting in the loop of the task */
+	memset(ring->slots, 0, ring_size * sizeof(timing_point_t));
+	ring->mask = ring_size - 1;
+	ring->ind = ind;
+	ring->nr_pmu = pmu.nr;
+	ring->log = log;
+	ring->own_log = log && log != stdout && !shared;
+	ring->binlog = binlog;
+
+	/* the logger writes big blocks instead of a line per record */
+	if (ring->own_log)
+		setvbuf(log, NULL, _IOFBF, LOGGER_BUFFER_SIZE);
+
+	/* Forked tasks register while the logger walks the list */
+	ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+
+	return ring;
+}
+
+void logger_ring_close(log_ring_t *ring)
+{
+	__atomic_store_n(&ring->done, 1, __ATOMIC_RELEASE);
+}
+
+static void logger_ring_release(log_ring_t *ring)
+{
+	unsigned long drops = __atomic_load_n(&ring->drops, __ATOMIC_RELAXED);
+
+	if (ring->log) {
+		if (ring->own_log)
+			fclose(ring->log);
+		else
+			fflush(ring->log);
+	}
+	if (ring->binlog)
+		binlog_close(ring->binlog);
+
+	if (drops)
+		log_error("[%d] %lu log records dropped, the log ring is full",
+			  ring->ind, drops);
+	else
+		log_notice("[%d] %lu log records written", ring->ind, ring->tail);
+
+	ring->closed = 1;
+}
+
+/* Returns the number of records written */
+static unsigned long logger_ring_drain(log_ring_t *ring)
+{
+	unsigned long head, tail, nr;
+	int done;
+
+	if (ring->closed)
+		return 0;
+
+	done = __atomic_load_n(&ring->done, __ATOMIC_ACQUIRE);
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	tail = ring->tail;
+	nr = head - tail;
+
+	while (tail != head) {
+		timing_point_t *t = &ring->slots[tail & ring->mask];
+
+		if (ring->binlog)
+			binlog_write(ring->binlog, t);
+		else
+			log_timing(ring->log, t, ring->nr_pmu);
+
+		tail++;
+		if (!(tail % LOGGER_BATCH))
+			__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+	if (done)
+		logger_ring_release(ring);
+
+	return nr;
+}
+
+static unsigned long logger_drain(void)
+{
+	log_ring_t *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+	unsigned long nr = 0;
+
+	for (; ring; ring = ring->next)
+		nr += logger_ring_drain(ring);
+
+	return nr;
+}
+
+static void *logger_body(void *arg)
+{
+	struct timespec period = usec_to_timespec(logger_period);
+
+	pthread_setname_np(pthread_self(), "rt-app-logger");
+
+	while (logger_running) {
+		if (!logger_drain())
+			nanosleep(&period, NULL);
+	}
+
+	return NULL;
+}
+
+void logger_start(rtapp_options_t *opts)
+{
+	pthread_attr_t attr;
+	struct sched_param param;
+
+	if (opts->logsize != LOG_SIZE_ASYNC)
+		return;
+
+	ring_size = opts->logger_ring;
+	logger_period = opts->logger_period;
+
+	pthread_attr_init(&attr);
+	thread_attr_block_signals(&attr);
+	if (opts->logger_prio > 0) {
+		param.sched_priority = opts->logger_prio;
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+	}
+	if (opts->logger_cpu_data.cpuset)
+		pthread_attr_setaffinity_np(&attr,
+					    opts->logger_cpu_data.cpusetsize,
+					    opts->logger_cpu_data.cpuset);
+
+	logger_running = 1;
+	if (pthread_create(&logger_thread, &attr, logger_body, NULL)) {
+		log_error("Cannot create the logger thread");
+		exit(EXIT_FAILURE);
+	}
+	pthread_attr_destroy(&attr);
+	logger_started = 1;
+
+	log_notice("logger thread started: priority %d cpus %s ring %lu records",
+		   opts->logger_prio, opts->logger_cpu_data.cpuset_str,
+		   ring_size);
+}
+
+void logger_stop(void)
+{
+	log_ring_t *ring;
+
+	if (!logger_started)
+		return;
+
+	logger_running = 0;
+	pthread_join(logger_thread, NULL);
+	logger_started = 0;
+
+	/*
+	 * The tasks are gone, possibly cancelled before closing their ring:
+	 * write what is left and close all the logs.
+	 */
+	for (ring = rings; ring; ring = ring->next) {
+		ring->done = 1;
+		logger_ring_drain(ring);
+	}
+
+	while (rings) {
+		ring = rings;
+		rings = ring->next;
+		free(ring->slots);
+		free(ring);
+	}
+}
@@ -0,0 +1,99 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef _RTAPP_LOGGER_H_
+#define _RTAPP_LOGGER_H_
+
+#include <stdio.h>
+#include "rt-app_types.h"
+
+/* Default number of records of a ring */
+#define LOGGER_DEFAULT_RING	4096
+/* Default polling period of the logger when the rings are empty, in usec */
+#define LOGGER_DEFAULT_PERIOD	1000
+
+#define LOGGER_CACHELINE	64
+/* stdio buffer of a log file */
+#define LOGGER_BUFFER_SIZE	(1 << 20)
+
+/*
+ * Single producer, single consumer ring of timing points. The task only
+ * writes head and drops, the logger thread only writes tail: each side
+ * publishes its index with a release store so no lock is needed.
+ */
+typedef struct _log_ring_t {
+	/* task side */
+	unsigned long head __attribute__((aligned(LOGGER_CACHELINE)));
+	unsigned long tail_cache;	/* last tail seen by the task */
+	unsigned long drops;		/* records lost because the ring was full */
+	int done;			/* the task won't push anymore */
+
+	/* logger side */
+	unsigned long tail __attribute__((aligned(LOGGER_CACHELINE)));
+	int closed;
+
+	/* read only */
+	timing_point_t *slots __attribute__((aligned(LOGGER_CACHELINE)));
+	unsigned long mask;
+	int ind;
+	int nr_pmu;
+	FILE *log;
+	int own_log;		/* closed with the ring */
+	struct _binlog_t *binlog;
+	struct _log_ring_t *next;
+} log_ring_t;
+
+/*
+ * Hand the text log @log or the binary log @binlog of the thread @ind over to
+ * the logger thread, which will close it once the thread is done unless
+ * @shared is set: the log is then shared by several threads.
+ */
+log_ring_t *logger_ring_open(int ind, FILE *log, int shared,
+			     struct _binlog_t *binlog);
+
+/* The task won't push anymore records in @ring */
+void logger_ring_close(log_ring_t *ring);
+
+void logger_start(rtapp_options_t *opts);
+
+/* Drain all the rings, close the logs and stop the logger thread */
+void logger_stop(void);
+
+/* Only cost on the RT path: copy @t in the ring, or count it as dropped */
+static inline void log_ring_push(log_ring_t *ring, const timing_point_t *t)
+{
+	unsigned long head = ring->head;
+
+	if (head - ring->tail_cache > ring->mask) {
+		ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		if (head - ring->tail_cache > ring->mask) {
+			__atomic_store_n(&ring->drops, ring->drops + 1,
+					 __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	ring->slots[head & ring->mask] = *t;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* _RTAPP_LOGGER_H_ */
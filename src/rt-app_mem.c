@@ -0,0 +1,301 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rt-app_mem.h"
+#include "rt-app_pages.h"
+#include "rt-app_chase.h"
+#include "rt-app_stream.h"
+#include "rt-app_utils.h"
+
+/* Buffers of a memory resource and nodes of the placement report */
+#define MEM_MAX_REGIONS	3
+#define MEM_MAX_NODES	64
+
+typedef struct _mem_region_t {
+	void *addr;
+	size_t len;
+} mem_region_t;
+
+static const char *pages_names[mem_pages_kinds] = {
+	[mem_pages_normal] = "normal",
+	[mem_pages_thp] = "thp",
+	[mem_pages_hugetlb] = "hugetlb",
+};
+
+const char *mem_pages_name(mem_pages_t pages)
+{
+	return pages_names[pages];
+}
+
+int mem_pages_index(const char *name)
+{
+	int i;
+
+	for (i = 0; i < mem_pages_kinds; i++)
+		if (!strcmp(name, pages_names[i]))
+			return i;
+
+	return -1;
+}
+
+/* Buffers of @data in @r, returns their number */
+static int mem_regions(rtapp_resource_t *data, mem_region_t *r)
+{
+	struct _rtapp_mem_stream_buf *stream = &data->res.stream;
+
+	switch (data->type) {
+	case rtapp_mem:
+	case rtapp_mem_read:
+	case rtapp_mem_write:
+		r[0].addr = data->res.buf.ptr;
+		r[0].len = data->res.buf.size;
+		return 1;
+	case rtapp_mem_chase:
+		r[0].addr = data->res.chase.base;
+		r[0].len = data->res.chase.len;
+		return 1;
+	case rtapp_mem_stream:
+		r[0].addr = stream->a;
+		r[1].addr = stream->b;
+		r[2].addr = stream->c;
+		r[0].len = r[1].len = r[2].len = stream->size;
+		return stream->c ? 3 : 2;
+	default:
+		return 0;
+	}
+}
+
+static void mem_fill(rtapp_resource_t *data)
+{
+	switch (data->type) {
+	case rtapp_mem_read:
+	case rtapp_mem_write:
+		memset(data->res.buf.ptr, 0xAA, data->res.buf.size);
+		break;
+	case rtapp_mem_chase:
+		chase_build(&data->res.chase);
+		break;
+	case rtapp_mem_stream:
+		stream_fill(&data->res.stream);
+		break;
+	default:
+		/* the buffer of the mem and iorun events is not initialized */
+		break;
+	}
+}
+
+int mem_resource_alloc(rtapp_resource_t *data)
+{
+	struct _rtapp_mem_stream_buf *stream = &data->res.stream;
+	const mem_alloc_t *alloc = &data->alloc;
+
+	switch (data->type) {
+	case rtapp_mem:
+	case rtapp_mem_read:
+	case rtapp_mem_write:
+		data->res.buf.ptr = pages_alloc(data->res.buf.size, alloc);
+		if (!data->res.buf.ptr)
+			return -1;
+		break;
+	case rtapp_mem_chase:
+		data->res.chase.base = pages_alloc(data->res.chase.len, alloc);
+		if (!data->res.chase.base)
+			return -1;
+		break;
+	case rtapp_mem_stream:
+		stream->a = pages_alloc(stream->size, alloc);
+		stream->b = pages_alloc(stream->size, alloc);
+		stream->c = NULL;
+		if (stream->kernel >= stream_add)
+			stream->c = pages_alloc(stream->size, alloc);
+		if (!stream->a || !stream->b ||
+		    (stream->kernel >= stream_add && !stream->c))
+			return -1;
+		break;
+	default:
+		return 0;
+	}
+
+	if (alloc->node != MEM_NODE_FIRST_TOUCH) {
+		mem_fill(data);
+		mem_resource_report(data);
+	}
+
+	return 0;
+}
+
+void mem_resource_touch(rtapp_resource_t *data)
+{
+	mem_region_t r[MEM_MAX_REGIONS];
+	int i, n, todo = 0;
+
+	if (data->alloc.node != MEM_NODE_FIRST_TOUCH)
+		return;
+
+	/* The threads sharing the resource wait for the first one */
+	if (!__atomic_compare_exchange_n(&data->alloc.touched, &todo, 1, 0,
+					 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		while (__atomic_load_n(&data->alloc.touched,
+				       __ATOMIC_ACQUIRE) != 2)
+			sched_yield();
+		return;
+	}
+
+	mem_fill(data);
+	if (data->alloc.populate) {
+		n = mem_regions(data, r);
+		for (i = 0; i < n; i++)
+			pages_prefault(r[i].addr, r[i].len);
+	}
+
+	__atomic_store_n(&data->alloc.touched, 2, __ATOMIC_RELEASE);
+	mem_resource_report(data);
+}
+
+/*
+ * Estimate from a sample of the pages of the @n regions of @r the bytes on
+ * @node, with one query per region.
+ */
+static size_t mem_on_node(mem_region_t *r, int n, int node)
+{
+	int count[MEM_MAX_NODES];
+	size_t bytes = 0;
+	int i, ret;
+
+	if (node < 0 || node >= MEM_MAX_NODES)
+		return 0;
+
+	for (i = 0; i < n; i++) {
+		ret = pages_nodes(r[i].addr, r[i].len, count, MEM_MAX_NODES);
+		if (ret > 0)
+			bytes += r[i].len / ret * count[node] +
+				 r[i].len % ret * count[node] / ret;
+	}
+
+	return bytes;
+}
+
+int mem_resource_migrate(rtapp_resource_t *data, int node)
+{
+	mem_migrate_t *migrate = &data->migrate;
+	mem_region_t r[MEM_MAX_REGIONS];
+	struct timespec t_start, t_end;
+	unsigned long long ns, max;
+	int i, n, ret = 0, err = 0;
+	size_t before, after, len = 0;
+
+	n = mem_regions(data, r);
+
+	/* the pages already on the node are not moved */
+	before = mem_on_node(r, n, node);
+
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	for (i = 0; i < n; i++) {
+		if (pages_migrate(r[i].addr, r[i].len, node) < 0) {
+			ret = -1;
+			err = errno;
+		}
+		len += r[i].len;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+	ns = timespec_to_nsec(&t_end) - timespec_to_nsec(&t_start);
+
+	after = mem_on_node(r, n, node);
+
+	/* The resource may be migrated by several threads at a time */
+	__atomic_add_fetch(&migrate->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&migrate->bytes, len, __ATOMIC_RELAXED);
+	if (after > before)
+		__atomic_add_fetch(&migrate->moved, after - before,
+				   __ATOMIC_RELAXED);
+	__atomic_add_fetch(&migrate->ns, ns, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&migrate->max_ns, __ATOMIC_RELAXED);
+	while (ns > max &&
+	       !__atomic_compare_exchange_n(&migrate->max_ns, &max, ns, 1,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+
+	if (ret < 0) {
+		__atomic_add_fetch(&migrate->failed, 1, __ATOMIC_RELAXED);
+		errno = err;
+	}
+
+	return ret;
+}
+
+void mem_resource_report(rtapp_resource_t *data)
+{
+	mem_region_t r[MEM_MAX_REGIONS];
+	int count[MEM_MAX_NODES], nodes[MEM_MAX_NODES] = { 0 };
+	int i, n, node, ret, sampled = 0, placed = 0;
+	size_t len = 0;
+	char buf[256];
+	char *p = buf, *end = buf + sizeof(buf);
+
+	n = mem_regions(data, r);
+	for (i = 0; i < n; i++)
+		len += r[i].len;
+
+	for (i = 0; i < n; i++) {
+		ret = pages_nodes(r[i].addr, r[i].len, count, MEM_MAX_NODES);
+		if (ret < 0) {
+			log_notice("%s: %zu kB of %s pages, placement unknown",
+				   data->name, len >> 10,
+				   mem_pages_name(data->alloc.pages));
+			return;
+		}
+
+		sampled += ret;
+		for (node = 0; node < MEM_MAX_NODES; node++)
+			nodes[node] += count[node];
+	}
+
+	if (!sampled)
+		return;
+
+	*p = '\0';
+	for (node = 0; node < MEM_MAX_NODES; node++) {
+		if (!nodes[node])
+			continue;
+		placed += nodes[node];
+		p += snprintf(p, end - p, " node%d %d%%", node,
+			      nodes[node] * 100 / sampled);
+		if (p >= end)
+			p = end - 1;
+	}
+	if (placed < sampled)
+		snprintf(p, end - p, " not faulted %d%%",
+			 (sampled - placed) * 100 / sampled);
+
+	log_notice("%s: %zu kB of %s pages,%s", data->name, len >> 10,
+		   mem_pages_name(data->alloc.pages), buf);
+}
@@ -0,0 +1,65 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+
+#ifndef _RTAPP_MEM_H_
+#define _RTAPP_MEM_H_
+
+#include "rt-app_types.h"
+
+/*
+ * Buffers of the memory resources: the mem, iorun and memrun events. They
+ * are mapped with the pages, node and population of their mem_alloc_t when
+ * the configuration is parsed, and initialized either then or, with
+ * MEM_NODE_FIRST_TOUCH, by the first thread which uses them before the use
+ * case starts so that their pages are allocated on the nodes of that thread.
+ */
+
+/* Name of a kind of pages and kind of a name, -1 if unknown */
+const char *mem_pages_name(mem_pages_t pages);
+int mem_pages_index(const char *name);
+
+/*
+ * Allocate the buffers of @data, whose sizes are set, with data->alloc and
+ * initialize them unless they are first touched. Returns -1 and errno on
+ * failure.
+ */
+int mem_resource_alloc(rtapp_resource_t *data);
+
+/*
+ * Initialize the buffers of @data if they are first touched and the calling
+ * thread is the first one to use them, or wait for the thread which does.
+ */
+void mem_resource_touch(rtapp_resource_t *data);
+
+/*
+ * Move the pages of @data to @node and account in data->migrate the time it
+ * took and the bytes of the pages which were not on @node before, estimated
+ * from a sample of the pages. Returns 0, or -1 and errno if some pages
+ * couldn't be moved.
+ */
+int mem_resource_migrate(rtapp_resource_t *data, int node);
+
+/* Log the nodes on which the pages of @data are */
+void mem_resource_report(rtapp_resource_t *data);
+
+#endif /* _RTAPP_MEM_H_ */
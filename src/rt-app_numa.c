@@ -0,0 +1,197 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "rt-app_numa.h"
+#include "rt-app_pages.h"
+#include "rt-app_chase.h"
+#include "rt-app_stream.h"
+#include "rt-app_utils.h"
+
+#if HAVE_LIBNUMA
+
+/* Nodes of the matrices */
+#define NUMA_MAX_NODES	64
+
+static unsigned long long numa_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return timespec_to_nsec(&ts);
+}
+
+/* ns per access of a random chain in @size bytes allocated with @alloc */
+static double numa_latency(long size, int count, const mem_alloc_t *alloc)
+{
+	struct _rtapp_mem_chase_buf chase;
+	unsigned long long start;
+	unsigned long hops;
+
+	memset(&chase, 0, sizeof(chase));
+	chase.size = size;
+	chase.stride = 64;
+	chase.pattern = chase_random;
+	chase.chains = 1;
+	chase.seed = 1;
+	if (chase_layout(&chase) < 0)
+		return -1;
+
+	chase.base = pages_alloc(chase.len, alloc);
+	if (!chase.base)
+		return -1;
+	chase_build(&chase);
+
+	/* the first pass loads the TLB and the caches as far as they can */
+	chase_run(&chase, chase.len / chase.stride);
+
+	start = numa_now();
+	hops = chase_run(&chase, count);
+	start = numa_now() - start;
+
+	pages_free(chase.base, chase.len, alloc);
+
+	return hops ? (double)start / hops : -1;
+}
+
+/* MB/s of the triad kernel over 3 arrays of @size bytes */
+static double numa_bandwidth(long size, const mem_alloc_t *alloc)
+{
+	struct _rtapp_mem_stream_buf stream;
+	unsigned long long start;
+	unsigned long bytes;
+	double ret = -1;
+
+	memset(&stream, 0, sizeof(stream));
+	stream.size = size;
+	stream.kernel = stream_triad;
+	stream.a = pages_alloc(size, alloc);
+	stream.b = pages_alloc(size, alloc);
+	stream.c = pages_alloc(size, alloc);
+	if (!stream.a || !stream.b || !stream.c)
+		goto out;
+	stream_fill(&stream);
+
+	stream_run(&stream, size);
+
+	start = numa_now();
+	bytes = stream_run(&stream, 4 * size);
+	start = numa_now() - start;
+
+	if (start)
+		ret = (double)bytes * 1000 / start;
+
+out:
+	pages_free(stream.a, size, alloc);
+	pages_free(stream.b, size, alloc);
+	pages_free(stream.c, size, alloc);
+	return ret;
+}
+
+static void log_matrix(const char *what, double m[][NUMA_MAX_NODES],
+		       const int *cpu_nodes, int nr_cpu,
+		       const int *mem_nodes, int nr_mem)
+{
+	char buf[1024], name[16];
+	int i, j, len;
+
+	/* a row per node of the CPUs, a column per node of the memory */
+	len = snprintf(buf, sizeof(buf), "numa %-12s", what);
+	for (j = 0; j < nr_mem && len < (int)sizeof(buf); j++) {
+		snprintf(name, sizeof(name), "node%d", mem_nodes[j]);
+		len += snprintf(buf + len, sizeof(buf) - len, " %12s", name);
+	}
+	log_notice("%s", buf);
+
+	for (i = 0; i < nr_cpu; i++) {
+		len = snprintf(buf, sizeof(buf), "numa cpus node%-3d",
+			       cpu_nodes[i]);
+		for (j = 0; j < nr_mem && len < (int)sizeof(buf); j++)
+			len += snprintf(buf + len, sizeof(buf) - len,
+					" %12.1f", m[i][j]);
+		log_notice("%s", buf);
+	}
+}
+
+void numa_matrix(long size, int count)
+{
+	static double lat[NUMA_MAX_NODES][NUMA_MAX_NODES];
+	static double bw[NUMA_MAX_NODES][NUMA_MAX_NODES];
+	int cpu_nodes[NUMA_MAX_NODES], mem_nodes[NUMA_MAX_NODES];
+	int i, j, nr_cpu = 0, nr_mem = 0, max_node;
+	mem_alloc_t alloc = { .pages = mem_pages_normal, .populate = 1 };
+	struct bitmask *cpus;
+	cpu_set_t affinity;
+
+	if (!size || numa_available() == -1)
+		return;
+
+	max_node = numa_max_node();
+	if (max_node >= NUMA_MAX_NODES)
+		max_node = NUMA_MAX_NODES - 1;
+
+	cpus = numa_allocate_cpumask();
+	for (i = 0; i <= max_node; i++) {
+		if (!numa_node_to_cpus(i, cpus) && numa_bitmask_weight(cpus))
+			cpu_nodes[nr_cpu++] = i;
+		if (numa_node_size64(i, NULL) > 0)
+			mem_nodes[nr_mem++] = i;
+	}
+	numa_bitmask_free(cpus);
+
+	log_notice("numa matrix of %ld kB buffers, %s triad", size >> 10,
+		   stream_isa());
+
+	sched_getaffinity(0, sizeof(affinity), &affinity);
+
+	for (i = 0; i < nr_cpu; i++) {
+		if (numa_run_on_node(cpu_nodes[i]) < 0) {
+			log_error("numa matrix: can't run on node %d",
+				  cpu_nodes[i]);
+			continue;
+		}
+
+		for (j = 0; j < nr_mem; j++) {
+			alloc.node = mem_nodes[j];
+			lat[i][j] = numa_latency(size, count, &alloc);
+			bw[i][j] = numa_bandwidth(size, &alloc);
+		}
+	}
+
+	sched_setaffinity(0, sizeof(affinity), &affinity);
+
+	log_matrix("ns", lat, cpu_nodes, nr_cpu, mem_nodes, nr_mem);
+	log_matrix("MB/s", bw, cpu_nodes, nr_cpu, mem_nodes, nr_mem);
+}
+
+#else
+
+void numa_matrix(long size, int count)
+{
+}
+
+#endif
@@ -0,0 +1,41 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef _RTAPP_NUMA_H_
+#define _RTAPP_NUMA_H_
+
+#include "rt-app_types.h"
+
+/* Default bytes of the buffers and accesses of the latency measurements */
+#define NUMA_MATRIX_SIZE	(64L << 20)
+#define NUMA_MATRIX_COUNT	1000000
+
+/*
+ * Measure, from the CPUs of every node, the latency of dependent accesses
+ * with the random pointer chasing of the memrun events and the bandwidth of
+ * the triad STREAM kernel, in buffers of @size bytes allocated on every
+ * node with memory, and log the two matrices. The latency is the mean of
+ * @count accesses.
+ */
+void numa_matrix(long size, int count);
+
+#endif /* _RTAPP_NUMA_H_ */
@@ -0,0 +1,251 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "rt-app_pages.h"
+
+#if HAVE_LIBNUMA
+#include <numaif.h>
+#endif
+
+/* When /proc/meminfo doesn't tell */
+#define PAGES_HUGE_SIZE	(2UL << 20)
+
+/* Nodes of the masks of mbind() */
+#define PAGES_MAX_NODES	1024
+
+static size_t page_size(void)
+{
+	static size_t size;
+
+	if (!size)
+		size = sysconf(_SC_PAGESIZE);
+	return size;
+}
+
+/* Size of the huge pages of the hugetlb pool and of THP */
+static size_t huge_page_size(void)
+{
+	static size_t size;
+	unsigned long kb;
+	char line[128];
+	FILE *f;
+
+	if (size)
+		return size;
+
+	size = PAGES_HUGE_SIZE;
+	f = fopen("/proc/meminfo", "r");
+	if (!f)
+		return size;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+			size = kb << 10;
+			break;
+		}
+	}
+	fclose(f);
+
+	return size;
+}
+
+void pages_prefault(void *addr, size_t len)
+{
+	size_t psize = page_size();
+	uintptr_t p, end = (uintptr_t)addr + len;
+
+	if (!len)
+		return;
+
+	/*
+	 * A read would map the zero page: or 0 each page instead. It is a
+	 * single instruction so it doesn't race with a signal frame when
+	 * touching the free part of our stack.
+	 */
+	for (p = (uintptr_t)addr & ~(psize - 1); p < end; p += psize) {
+		char *c = (char *)(p < (uintptr_t)addr ? (uintptr_t)addr : p);
+
+		__atomic_fetch_or(c, 0, __ATOMIC_RELAXED);
+	}
+}
+
+int pages_lock(void *addr, size_t len)
+{
+	uintptr_t start = (uintptr_t)addr & ~(page_size() - 1);
+
+	if (!len)
+		return 0;
+
+	return mlock((void *)start, (uintptr_t)addr + len - start);
+}
+
+int pages_stack(void **addr, size_t *len)
+{
+	pthread_attr_t attr;
+	int ret;
+
+	if (pthread_getattr_np(pthread_self(), &attr))
+		return -1;
+
+	/* the guard page is not part of the stack returned here */
+	ret = pthread_attr_getstack(&attr, addr, len);
+	pthread_attr_destroy(&attr);
+
+	return ret ? -1 : 0;
+}
+
+/* @len rounded up to the size of the pages of @alloc */
+static size_t pages_len(size_t len, const mem_alloc_t *alloc)
+{
+	size_t align = page_size();
+
+	if (alloc->pages != mem_pages_normal)
+		align = huge_page_size();
+
+	return (len + align - 1) & ~(align - 1);
+}
+
+void *pages_alloc(size_t len, const mem_alloc_t *alloc)
+{
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	size_t align = page_size(), map_len;
+	char *addr, *start;
+
+	if (alloc->pages != mem_pages_normal)
+		align = huge_page_size();
+	len = pages_len(len, alloc);
+	map_len = len;
+
+	if (alloc->pages == mem_pages_hugetlb)
+		flags |= MAP_HUGETLB;
+
+	/* Populate at once, unless the pages must first be bound to a node */
+	if (alloc->populate && alloc->node == MEM_NODE_ANY)
+		flags |= MAP_POPULATE;
+
+	/* THP need a region aligned on the huge page size */
+	if (alloc->pages == mem_pages_thp) {
+		map_len += align;
+		flags &= ~MAP_POPULATE;
+	}
+
+	addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (addr == MAP_FAILED)
+		return NULL;
+
+	start = addr;
+	if (alloc->pages == mem_pages_thp) {
+		start = (char *)(((uintptr_t)addr + align - 1) & ~(align - 1));
+		if (start > addr)
+			munmap(addr, start - addr);
+		munmap(start + len, addr + map_len - (start + len));
+
+		if (madvise(start, len, MADV_HUGEPAGE)) {
+			int err = errno;
+
+			munmap(start, len);
+			errno = err;
+			return NULL;
+		}
+	}
+
+#if HAVE_LIBNUMA
+	if (alloc->node >= 0)
+		numa_tonode_memory(start, len, alloc->node);
+#endif
+
+	if (alloc->populate && !(flags & MAP_POPULATE) &&
+	    alloc->node != MEM_NODE_FIRST_TOUCH)
+		pages_prefault(start, len);
+
+	return start;
+}
+
+void pages_free(void *addr, size_t len, const mem_alloc_t *alloc)
+{
+	if (addr)
+		munmap(addr, pages_len(len, alloc));
+}
+
+int pages_migrate(void *addr, size_t len, int node)
+{
+#if HAVE_LIBNUMA
+	unsigned long mask[PAGES_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+	uintptr_t start = (uintptr_t)addr & ~(page_size() - 1);
+
+	if (node < 0 || node >= PAGES_MAX_NODES) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	mask[node / (8 * sizeof(unsigned long))] =
+		1UL << (node % (8 * sizeof(unsigned long)));
+
+	return mbind((void *)start, (uintptr_t)addr + len - start, MPOL_BIND,
+		     mask, PAGES_MAX_NODES + 1, MPOL_MF_MOVE | MPOL_MF_STRICT);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+int pages_nodes(void *addr, size_t len, int *count, int nr_nodes)
+{
+#if HAVE_LIBNUMA
+	void *pages[PAGES_SAMPLES];
+	int status[PAGES_SAMPLES];
+	size_t psize = page_size(), npages, step;
+	uintptr_t start = (uintptr_t)addr & ~(psize - 1);
+	int i, n;
+
+	npages = ((uintptr_t)addr + len - start + psize - 1) / psize;
+	step = (npages + PAGES_SAMPLES - 1) / PAGES_SAMPLES;
+	if (!step)
+		return 0;
+
+	for (n = 0; n < PAGES_SAMPLES && n * step < npages; n++)
+		pages[n] = (void *)(start + n * step * psize);
+
+	/* With no nodes, the pages are only queried */
+	if (numa_move_pages(0, n, pages, NULL, status, 0))
+		return -1;
+
+	for (i = 0; i < nr_nodes; i++)
+		count[i] = 0;
+
+	for (i = 0; i < n; i++)
+		if (status[i] >= 0 && status[i] < nr_nodes)
+			count[status[i]]++;
+
+	return n;
+#else
+	return -1;
+#endif
+}
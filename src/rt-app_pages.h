@@ -0,0 +1,73 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef _RTAPP_PAGES_H_
+#define _RTAPP_PAGES_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "rt-app_types.h"
+
+/*
+ * Memory of a thread faulted in, and optionally locked, before the use case
+ * starts so that the first loops don't take the page faults of its stack and
+ * buffers, and only the memory that the thread uses is locked.
+ */
+
+/* Write fault every page of [addr, addr + len) without changing its content */
+void pages_prefault(void *addr, size_t len);
+
+/* mlock() the pages of [addr, addr + len), returns 0 or -1 and errno */
+int pages_lock(void *addr, size_t len);
+
+/* Usable part of the stack of the calling thread, returns 0 or -1 */
+int pages_stack(void **addr, size_t *len);
+
+/*
+ * Map @len bytes of anonymous memory with the pages of @alloc, bound to its
+ * node and populated if requested. Returns NULL and errno on failure.
+ */
+void *pages_alloc(size_t len, const mem_alloc_t *alloc);
+
+/* What has been done to the buffers of a resource shared by threads */
+#define PAGES_FAULTED	0x1
+#define PAGES_LOCKED	0x2
+
+/* Unmap a region returned by pages_alloc() for @len bytes with @alloc */
+void pages_free(void *addr, size_t len, const mem_alloc_t *alloc);
+
+/*
+ * Bind [addr, addr + len) to @node and move its pages there. Returns 0, or
+ * -1 and errno, EIO if some pages couldn't be moved.
+ */
+int pages_migrate(void *addr, size_t len, int node);
+
+/*
+ * Count in @count, of @nr_nodes entries, the pages of [addr, addr + len) on
+ * each node, sampling at most PAGES_SAMPLES pages. Returns the pages which
+ * were sampled or -1 if the placement can't be queried.
+ */
+#define PAGES_SAMPLES	1024
+int pages_nodes(void *addr, size_t len, int *count, int nr_nodes);
+
+#endif /* _RTAPP_PAGES_H_ */
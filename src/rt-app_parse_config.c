@@ -27,11 +27,23 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <stdbool.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
 #include <json-c/json.h>
 
 #include "rt-app_utils.h"
 #include "rt-app_taskgroups.h"
 #include "rt-app_parse_config.h"
+#include "rt-app_calib.h"
+#include "rt-app_pmu.h"
+#include "rt-app_logger.h"
+#include "rt-app_timeline.h"
+#include "rt-app_timer.h"
+#include "rt-app_sync.h"
+#include "rt-app_queue.h"
+#include "rt-app_stream.h"
+#include "rt-app_chase.h"
+#include "rt-app_mem.h"
+#include "rt-app_numa.h"
 
 #define PFX "[json] "
 #define PFL "         "PFX
@@ -40,6 +52,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define PIN3 PIN2"    "
 #define JSON_FILE_BUF_SIZE 4096
 #define DEFAULT_MEM_BUF_SIZE (4 * 1024 * 1024)
+#define DEFAULT_STACK_LOCK (256 * 1024)
 
 #ifndef TRUE
 #define TRUE true
@@ -156,6 +169,31 @@ get_int_value_from(struct json_object *where,
 	return i_value;
 }
 
+/* an integer is accepted as well for a double value */
+static inline double
+get_double_value_from(struct json_object *where,
+		      const char *key,
+		      int have_def,
+		      double def_value)
+{
+	struct json_object *value;
+	double d_value;
+	value = get_in_object(where, key, have_def);
+	if (!value) {
+		if (have_def) {
+			log_info(PIN "key: %s <default> %f", key, def_value);
+			return def_value;
+		}
+		log_critical(PFX "Key %s not found", key);
+		exit(EXIT_INV_CONFIG);
+	}
+	if (!json_object_is_type(value, json_type_int))
+		assure_type_is(value, where, key, json_type_double);
+	d_value = json_object_get_double(value);
+	log_info(PIN "key: %s, value: %f, type <double>", key, d_value);
+	return d_value;
+}
+
 static inline int
 get_bool_value_from(struct json_object *where,
 		    const char *key,
@@ -211,6 +249,11 @@ static void init_timer_resource(rtapp_resource_t *data, const rtapp_options_t *o
 	log_info(PIN3 "Init: %s timer", data->name);
 	data->res.timer.init = 0;
 	data->res.timer.relative = 1;
+	data->res.timer.overrun = timer_reset_relative;
+	data->res.timer.backend = timer_nanosleep;
+	data->res.timer.spin = TIMER_DEFAULT_SPIN;
+	memset(&data->res.timer.lat, 0, sizeof(data->res.timer.lat));
+	memset(&data->res.timer.dmiss, 0, sizeof(data->res.timer.dmiss));
 }
 
 static void init_cond_resource(rtapp_resource_t *data, const rtapp_options_t *opts)
@@ -220,14 +263,27 @@ static void init_cond_resource(rtapp_resource_t *data, const rtapp_options_t *op
 	pthread_condattr_init(&data->res.cond.attr);
 	pthread_cond_init(&data->res.cond.obj,
 			&data->res.cond.attr);
+	memset(&data->res.cond.wake, 0, sizeof(data->res.cond.wake));
+	sync_wait_init(&data->res.cond.sync);
+}
+
+/* Allocate the buffers of a memory resource with data->alloc */
+static void init_mem_buffers(rtapp_resource_t *data)
+{
+	if (mem_resource_alloc(data)) {
+		log_error("Failed to allocate %s with %s pages: %s", data->name,
+			  mem_pages_name(data->alloc.pages), strerror(errno));
+		exit(EXIT_FAILURE);
+	}
 }
 
 static void init_membuf_resource(rtapp_resource_t *data, const rtapp_options_t *opts)
 {
 	log_info(PIN3 "Init: %s membuf", data->name);
 
-	data->res.buf.ptr = malloc(opts->mem_buffer_size);
 	data->res.buf.size = opts->mem_buffer_size;
+	data->alloc = opts->mem_alloc;
+	init_mem_buffers(data);
 }
 
 /*
@@ -241,92 +297,80 @@ union init_args {
 	struct {
 		int size;
 		int stride;
-		int random;
+		int pattern;
+		int chains;
+		unsigned int seed;
+		int tlb;
+		mem_alloc_t alloc;
 	} chase;
 	struct {
 		int size;
+		mem_alloc_t alloc;
 	} membuf;
+	struct {
+		int size;
+		int kernel;
+		int nontemporal;
+		mem_alloc_t alloc;
+	} stream;
 };
 
-static void init_membuf_resource_sized(rtapp_resource_t *data, int size)
+static void init_membuf_resource_sized(rtapp_resource_t *data,
+				       const union init_args *args)
 {
-	log_info(PIN3 "Init: %s membuf (size %d)", data->name, size);
+	log_info(PIN3 "Init: %s membuf (size %d)", data->name,
+		 args->membuf.size);
 
-	data->res.buf.ptr = malloc(size);
-	data->res.buf.size = size;
-	if (data->res.buf.ptr)
-		memset(data->res.buf.ptr, 0xAA, size);
+	data->res.buf.size = args->membuf.size;
+	data->alloc = args->membuf.alloc;
+	init_mem_buffers(data);
 }
 
 /*
- * Bit-reverse an integer across nbits.
- * E.g., bitreverse(1, 3) = 4 (001 -> 100)
+ * Allocate the chase buffer and build its chains of pointers, or let its
+ * first thread build them.
  */
-static inline unsigned int bitreverse(unsigned int val, int nbits)
-{
-	unsigned int result = 0;
-	int j;
-
-	for (j = 0; j < nbits; j++)
-		if (val & (1u << j))
-			result |= (1u << (nbits - j - 1));
-
-	return result;
-}
-
-/*
- * Allocate the chase buffer and build its pointer chain.
- *
- * random=1: bit-reversed order to defeat hardware prefetchers.
- * random=0: sequential stride.
- */
-static void init_memchase_resource(rtapp_resource_t *data, int size, int stride, int random)
+static void init_memchase_resource(rtapp_resource_t *data,
+				   const union init_args *args)
 {
 	struct _rtapp_mem_chase_buf *chase = &data->res.chase;
-	size_t npos;
-	int nbits;
-	size_t i;
-	char *base;
-
-	log_info(PIN3 "Init: %s mem_chase (size %d, stride %d, %s)", data->name,
-		 size, stride, random ? "random" : "sequential");
-
-	chase->size = size;
-	chase->stride = stride;
-	chase->random = random;
-
-	npos = (size_t)size / (size_t)stride;
-	/* Round down to power of 2 for bit-reversal */
-	for (nbits = 0; (1u << (nbits + 1)) <= npos; nbits++)
-		;
-	npos = 1u << nbits;
-
-	if (npos < 2) {
-		log_error("mem_chase buffer too small (need at least 2 * stride)");
-		return;
-	}
 
-	base = malloc(npos * (size_t)stride);
-	if (!base) {
-		log_error("Failed to allocate mem_chase buffer (%zu bytes)",
-			  npos * (size_t)stride);
+	log_info(PIN3 "Init: %s mem_chase (size %d, stride %d, %s, %d chains%s)",
+		 data->name, args->chase.size, args->chase.stride,
+		 chase_pattern_name(args->chase.pattern), args->chase.chains,
+		 args->chase.tlb ? ", tlb" : "");
+
+	chase->size = args->chase.size;
+	chase->stride = args->chase.stride;
+	chase->pattern = args->chase.pattern;
+	chase->chains = args->chase.chains;
+	chase->seed = args->chase.seed;
+	chase->tlb = args->chase.tlb;
+	data->alloc = args->chase.alloc;
+
+	if (chase_layout(chase)) {
+		log_error("mem_chase buffer too small "
+			  "(need at least 2 * chains * stride)");
 		return;
 	}
-	chase->base = base;
+	init_mem_buffers(data);
+}
 
-	if (random) {
-		/* Bit-reversed pointer chain */
-		for (i = 0; i < npos; i++) {
-			size_t src_off = (size_t)bitreverse(i, nbits) * stride;
-			size_t dst_off = (size_t)bitreverse((i + 1) % npos, nbits) * stride;
-			*(char **)(base + src_off) = base + dst_off;
-		}
-	} else {
-		/* Sequential pointer chain */
-		for (i = 0; i < npos - 1; i++)
-			*(char **)(base + i * stride) = base + (i + 1) * stride;
-		*(char **)(base + (npos - 1) * stride) = base;
-	}
+static void init_memstream_resource(rtapp_resource_t *data,
+				    const union init_args *args)
+{
+	struct _rtapp_mem_stream_buf *stream = &data->res.stream;
+	const char *isa = stream_isa();
+
+	log_info(PIN3 "Init: %s mem_stream (size %d, %s%s, %s)", data->name,
+		 args->stream.size, stream_kernel_name(args->stream.kernel),
+		 args->stream.nontemporal ? " non-temporal" : "", isa);
+
+	stream->size = args->stream.size;
+	stream->kernel = args->stream.kernel;
+	stream->nontemporal = args->stream.nontemporal;
+	data->alloc = args->stream.alloc;
+	init_mem_buffers(data);
 }
 
 static void init_iodev_resource(rtapp_resource_t *data, const rtapp_options_t *opts)
@@ -355,12 +399,31 @@ static void init_barrier_resource(rtapp_resource_t *data, const rtapp_options_t
 			&data->res.barrier.m_attr);
 
 	pthread_cond_init(&data->res.barrier.c_obj, NULL);
+	data->res.barrier.arrived = 0;
+	sync_wait_init(&data->res.barrier.sync);
 }
 
 static void init_sem_resource(rtapp_resource_t *data, const rtapp_options_t *opts)
 {
 	log_info(PIN3 "Init: %s semaphore", data->name);
 	sem_init(&data->res.sem.obj, 0, 0);
+	memset(&data->res.sem.wake, 0, sizeof(data->res.sem.wake));
+	sync_wait_init(&data->res.sem.sync);
+}
+
+static void init_queue_resource(rtapp_resource_t *data, const rtapp_options_t *opts)
+{
+	struct _rtapp_queue *queue = &data->res.queue;
+
+	log_info(PIN3 "Init: %s queue", data->name);
+
+	memset(queue, 0, sizeof(*queue));
+	queue->capacity = QUEUE_DEFAULT_CAPACITY;
+	queue->size = QUEUE_DEFAULT_SIZE;
+	if (queue_init(queue)) {
+		log_error("Failed to allocate queue %s", data->name);
+		exit(EXIT_FAILURE);
+	}
 }
 
 static void
@@ -374,6 +437,10 @@ init_resource_data(const char *name, int type, rtapp_resources_t *resources_tabl
 	data->index = idx;
 	data->name = strdup(name);
 	data->type = type;
+	memset(&data->alloc, 0, sizeof(data->alloc));
+	data->alloc.node = MEM_NODE_ANY;
+	memset(&data->migrate, 0, sizeof(data->migrate));
+	data->prepared = 0;
 
 	switch (data->type) {
 		case rtapp_mutex:
@@ -391,12 +458,13 @@ init_resource_data(const char *name, int type, rtapp_resources_t *resources_tabl
 			break;
 		case rtapp_mem_write:
 		case rtapp_mem_read:
-			init_membuf_resource_sized(data, args->membuf.size);
+			init_membuf_resource_sized(data, args);
 			break;
 		case rtapp_mem_chase:
-			init_memchase_resource(data, args->chase.size,
-					       args->chase.stride,
-					       args->chase.random);
+			init_memchase_resource(data, args);
+			break;
+		case rtapp_mem_stream:
+			init_memstream_resource(data, args);
 			break;
 		case rtapp_iorun:
 			init_iodev_resource(data, opts);
@@ -408,6 +476,13 @@ init_resource_data(const char *name, int type, rtapp_resources_t *resources_tabl
 		case rtapp_sem_post:
 			init_sem_resource(data, opts);
 			break;
+		case rtapp_push:
+			init_queue_resource(data, opts);
+			break;
+		case rtapp_fork:
+			memset(&data->res.fork, 0, sizeof(data->res.fork));
+			data->res.fork.stats.lat_min = ~0ULL;
+			break;
 		default:
 			break;
 	}
@@ -522,11 +597,17 @@ parse_resources(struct json_object *resources, rtapp_options_t *opts)
 	}
 }
 
+static int mem_alloc_equal(const mem_alloc_t *a, const mem_alloc_t *b)
+{
+	return a->pages == b->pages && a->populate == b->populate &&
+	       a->node == b->node;
+}
+
 /*
  * Verify that a previously-created resource was initialized with the
  * same params the current caller is asking for. Mismatches happen when
  * two memrun events share a name (typically via "ref") but disagree on
- * size/stride/pattern. Returns 1 on match, 0 on mismatch. For
+ * their size, stride, pattern or kernel. Returns 1 on match, 0 on mismatch. For
  * param-free types, or when no args are passed, always matches.
  */
 static int validate_init_args(const rtapp_resource_t *r,
@@ -537,12 +618,23 @@ static int validate_init_args(const rtapp_resource_t *r,
 
 	switch (r->type) {
 	case rtapp_mem_chase:
-		return r->res.chase.size == (size_t)args->chase.size &&
-		       r->res.chase.stride == (size_t)args->chase.stride &&
-		       r->res.chase.random == args->chase.random;
+		return mem_alloc_equal(&r->alloc, &args->chase.alloc) &&
+		       r->res.chase.size == (size_t)args->chase.size &&
+		       (r->res.chase.tlb ||
+			r->res.chase.stride == (size_t)args->chase.stride) &&
+		       r->res.chase.pattern == args->chase.pattern &&
+		       r->res.chase.chains == args->chase.chains &&
+		       r->res.chase.seed == args->chase.seed &&
+		       r->res.chase.tlb == args->chase.tlb;
 	case rtapp_mem_read:
 	case rtapp_mem_write:
-		return r->res.buf.size == args->membuf.size;
+		return mem_alloc_equal(&r->alloc, &args->membuf.alloc) &&
+		       r->res.buf.size == args->membuf.size;
+	case rtapp_mem_stream:
+		return mem_alloc_equal(&r->alloc, &args->stream.alloc) &&
+		       r->res.stream.size == (size_t)args->stream.size &&
+		       r->res.stream.kernel == args->stream.kernel &&
+		       r->res.stream.nontemporal == args->stream.nontemporal;
 	default:
 		return 1;
 	}
@@ -572,7 +664,7 @@ static int get_resource_index(const char *name, int type,
 	if (!validate_init_args(&resources[i], args)) {
 		log_critical(PFX "Resource '%s' shared with mismatched params. "
 		             "Multiple memrun events using the same name (or "
-		             "\"ref\") must agree on size/stride/pattern.", name);
+		             "\"ref\") must agree on their parameters.", name);
 		exit(EXIT_INV_CONFIG);
 	}
 
@@ -585,34 +677,249 @@ static char* create_unique_name(char *tmp, int size, const char* ref, long tag)
 	return tmp;
 }
 
+
+/* Exit if @node isn't a NUMA node of the system */
+static void check_mem_node(int node)
+{
+	int max_node = -1;
+
+#if HAVE_LIBNUMA
+	if (numa_available() != -1)
+		max_node = numa_max_node();
+#endif
+	if (node < 0 || node > max_node) {
+		log_critical(PIN2 "Invalid node %d, NUMA nodes are 0 to %d",
+			     node, max_node);
+		exit(EXIT_INV_CONFIG);
+	}
+}
+
+/*
+ * "pages", "populate" and "node" keys of the allocation of a memory
+ * resource, the values not set are kept.
+ */
+static void
+parse_mem_alloc(struct json_object *obj, mem_alloc_t *alloc)
+{
+	struct json_object *node;
+	char *tmp;
+
+	if (!obj)
+		return;
+
+	tmp = get_string_value_from(obj, "pages", TRUE,
+				    mem_pages_name(alloc->pages));
+	if (mem_pages_index(tmp) < 0) {
+		log_critical(PIN2 "Invalid pages %s", tmp);
+		exit(EXIT_INV_CONFIG);
+	}
+	alloc->pages = mem_pages_index(tmp);
+	free(tmp);
+
+	alloc->populate = get_bool_value_from(obj, "populate", TRUE,
+					      alloc->populate);
+
+	node = get_in_object(obj, "node", TRUE);
+	if (!node)
+		return;
+
+	if (json_object_is_type(node, json_type_string)) {
+		if (strcmp(json_object_get_string(node), "first_touch")) {
+			log_critical(PIN2 "Invalid node %s",
+				     json_object_get_string(node));
+			exit(EXIT_INV_CONFIG);
+		}
+		alloc->node = MEM_NODE_FIRST_TOUCH;
+		return;
+	}
+
+	assure_type_is(node, obj, "node", json_type_int);
+	alloc->node = json_object_get_int(node);
+	check_mem_node(alloc->node);
+}
+
+/* "numa_matrix": true or { "size" : bytes, "count" : accesses } */
+static void
+parse_numa_matrix(struct json_object *global, rtapp_options_t *opts)
+{
+	struct json_object *obj = get_in_object(global, "numa_matrix", TRUE);
+
+	opts->numa_matrix = 0;
+	opts->numa_matrix_count = NUMA_MATRIX_COUNT;
+	if (!obj)
+		return;
+
+	if (json_object_is_type(obj, json_type_object)) {
+		opts->numa_matrix = get_int_value_from(obj, "size", TRUE,
+						       NUMA_MATRIX_SIZE);
+		opts->numa_matrix_count = get_int_value_from(obj, "count", TRUE,
+							     NUMA_MATRIX_COUNT);
+	} else if (get_bool_value_from(global, "numa_matrix", TRUE, 0)) {
+		opts->numa_matrix = NUMA_MATRIX_SIZE;
+	}
+
+	if (opts->numa_matrix < 0 || opts->numa_matrix % STREAM_ALIGN ||
+	    opts->numa_matrix_count <= 0) {
+		log_critical(PFX "Invalid numa_matrix size %ld count %d, the size"
+			     " must be a multiple of %d", opts->numa_matrix,
+			     opts->numa_matrix_count, STREAM_ALIGN);
+		exit(EXIT_INV_CONFIG);
+	}
+
+	if (!opts->numa_matrix)
+		return;
+#if HAVE_LIBNUMA
+	if (numa_available() != -1)
+		return;
+#endif
+	log_error(PFX "NUMA is not available, no numa_matrix");
+	opts->numa_matrix = 0;
+}
+
+/* Suffix of the name of the per-thread memrun buffers, empty by default */
+static void mem_alloc_name(const mem_alloc_t *alloc, char *buf, int size)
+{
+	buf[0] = '\0';
+	if (alloc->pages == mem_pages_normal && !alloc->populate &&
+	    alloc->node == MEM_NODE_ANY)
+		return;
+
+	snprintf(buf, size, "_%s%s_%d", mem_pages_name(alloc->pages),
+		 alloc->populate ? "_pop" : "", alloc->node);
+}
+
+/* "strategy" and "spin" keys of a wait, suspend, barrier or sem_wait event */
+static void
+parse_sync_wait(struct json_object *obj, sync_wait_t *sync)
+{
+	char *tmp;
+	int i;
+
+	if (!json_object_is_type(obj, json_type_object))
+		return;
+
+	tmp = get_string_value_from(obj, "strategy", TRUE,
+				    sync_strategy_name(sync->strategy));
+	i = sync_strategy_index(tmp);
+	if (i < 0) {
+		log_critical(PIN2 "Invalid wait strategy %s", tmp);
+		exit(EXIT_INV_CONFIG);
+	}
+	sync->strategy = i;
+	free(tmp);
+
+	sync->spin = get_int_value_from(obj, "spin", TRUE, sync->spin);
+	if (sync->spin < 0) {
+		log_critical(PIN2 "Invalid wait spin %d", sync->spin);
+		exit(EXIT_INV_CONFIG);
+	}
+}
+
+/*
+ * "capacity", "size", "mpmc" and "copy" keys of a push or pop event. The first
+ * event which sets them allocates the ring again, the next ones must agree.
+ */
+static void
+parse_queue(struct json_object *obj, rtapp_resource_t *rdata)
+{
+	static const char *keys[] = { "capacity", "size", "mpmc", "copy", NULL };
+	struct _rtapp_queue *queue = &rdata->res.queue;
+	struct _rtapp_queue conf = *queue;
+	const char **key;
+
+	if (!json_object_is_type(obj, json_type_object))
+		return;
+
+	for (key = keys; *key; key++)
+		if (json_object_object_get_ex(obj, *key, NULL))
+			break;
+	if (!*key)
+		return;
+
+	conf.capacity = get_int_value_from(obj, "capacity", TRUE, queue->capacity);
+	conf.size = get_int_value_from(obj, "size", TRUE, queue->size);
+	conf.mpmc = get_bool_value_from(obj, "mpmc", TRUE, queue->mpmc);
+	conf.copy = get_bool_value_from(obj, "copy", TRUE, queue->copy);
+
+	if (conf.capacity < 1 || (conf.capacity & (conf.capacity - 1)) ||
+	    conf.size < 0) {
+		log_critical(PIN2 "Queue %s: capacity must be a power of 2 and"
+			     " size can't be negative", rdata->name);
+		exit(EXIT_INV_CONFIG);
+	}
+
+	if (queue->configured) {
+		if (conf.capacity != queue->capacity ||
+		    conf.size != queue->size || conf.mpmc != queue->mpmc ||
+		    conf.copy != queue->copy) {
+			log_critical(PIN2 "Queue %s shared with mismatched params."
+				     " The push and pop events of a queue must"
+				     " agree on capacity/size/mpmc/copy",
+				     rdata->name);
+			exit(EXIT_INV_CONFIG);
+		}
+		return;
+	}
+
+	queue_free(queue);
+	*queue = conf;
+	queue->configured = 1;
+	if (queue_init(queue)) {
+		log_error("Failed to allocate queue %s", rdata->name);
+		exit(EXIT_FAILURE);
+	}
+}
+
 static void
 parse_task_event_data(char *name, struct json_object *obj,
 		  event_data_t *data, thread_data_t *tdata, rtapp_options_t *opts)
 {
 	rtapp_resources_t **resources_table = tdata->global_resources;
 	rtapp_resource_t *rdata, *ddata;
-	char unique_name[64];
+	char unique_name[96];
 	const char *ref;
 	char *tmp;
 	long tag = (long)tdata;
 	int i;
 
 	if (!strncmp(name, "run", strlen("run")) ||
+			!strncmp(name, "cputime", strlen("cputime")) ||
 			!strncmp(name, "sleep", strlen("sleep"))) {
 
-		if (!json_object_is_type(obj, json_type_int))
+		if (json_object_is_type(obj, json_type_object) &&
+				strncmp(name, "sleep", strlen("sleep"))) {
+			/* run with a burn kernel: { "duration" : , "kernel" : } */
+			data->duration = get_int_value_from(obj, "duration", FALSE, 0);
+			tmp = get_string_value_from(obj, "kernel", TRUE,
+					burn_kernels[BURN_DEFAULT_KERNEL].name);
+			data->kernel = burn_kernel_index(tmp);
+			if (data->kernel < 0) {
+				log_critical(PIN2 "Unknown burn kernel %s", tmp);
+				exit(EXIT_INV_CONFIG);
+			}
+			if (!burn_kernel_supported(&burn_kernels[data->kernel])) {
+				log_critical(PIN2 "Burn kernel %s is not supported by this CPU", tmp);
+				exit(EXIT_INV_CONFIG);
+			}
+			burn_kernels[data->kernel].used = 1;
+			free(tmp);
+		} else if (json_object_is_type(obj, json_type_int)) {
+			data->duration = json_object_get_int(obj);
+		} else {
 			goto unknown_event;
-
-		data->duration = json_object_get_int(obj);
+		}
 
 		if (!strncmp(name, "sleep", strlen("sleep")))
 			data->type = rtapp_sleep;
 		else if (!strncmp(name, "runtime", strlen("runtime")))
 			data->type = rtapp_runtime;
+		else if (!strncmp(name, "cputime", strlen("cputime")))
+			data->type = rtapp_cputime;
 		else
 			data->type = rtapp_run;
 
-		log_info(PIN2 "type %d duration %d", data->type, data->duration);
+		log_info(PIN2 "type %d duration %d kernel %s", data->type,
+			 data->duration, burn_kernels[data->kernel].name);
 		strncpy(data->name, name, sizeof(data->name)-1);
 		return;
 	}
@@ -622,6 +929,8 @@ parse_task_event_data(char *name, struct json_object *obj,
 			goto unknown_event;
 
 		char *mem_type = get_string_value_from(obj, "type", FALSE, NULL);
+		char alloc_name[32];
+		mem_alloc_t alloc;
 		int mem_size = get_int_value_from(obj, "size", FALSE, 0);
 		int mem_count = get_int_value_from(obj, "count", FALSE, 0);
 		/*
@@ -632,24 +941,58 @@ parse_task_event_data(char *name, struct json_object *obj,
 		 * isolation via encoded params + tag.
 		 */
 		tmp = get_string_value_from(obj, "ref", TRUE, NULL);
+		alloc = opts->mem_alloc;
+		parse_mem_alloc(get_in_object(obj, "alloc", TRUE), &alloc);
+		mem_alloc_name(&alloc, alloc_name, sizeof(alloc_name));
 
 		if (!strcmp(mem_type, "chase")) {
 			char *pattern = get_string_value_from(obj, "pattern", TRUE, "random");
-			int is_random = strcmp(pattern, "sequential") != 0;
 			int stride = get_int_value_from(obj, "stride", TRUE, 64);
-			char encoded[48];
-			union init_args ia = { .chase = { mem_size, stride, is_random } };
+			int chains = get_int_value_from(obj, "chains", TRUE, 1);
+			int seed = get_int_value_from(obj, "seed", TRUE, 0);
+			int tlb = get_bool_value_from(obj, "tlb", TRUE, 0);
+			int pat = chase_pattern_index(pattern);
+			char encoded[80];
+			union init_args ia;
+
+			if (pat < 0) {
+				log_critical(PIN2 "Unknown chase pattern: %s", pattern);
+				exit(EXIT_INV_CONFIG);
+			}
+
+			if (chains < 1 || chains > CHASE_MAX_CHAINS) {
+				log_critical(PIN2 "chase chains must be between 1 and %d",
+					     CHASE_MAX_CHAINS);
+				exit(EXIT_INV_CONFIG);
+			}
+
+			if (!tlb && (stride < (int)sizeof(char *) ||
+				     stride % sizeof(char *))) {
+				log_critical(PIN2 "chase stride %d must be a multiple of %zu",
+					     stride, sizeof(char *));
+				exit(EXIT_INV_CONFIG);
+			}
+
+			ia.chase.size = mem_size;
+			ia.chase.stride = stride;
+			ia.chase.pattern = pat;
+			ia.chase.chains = chains;
+			ia.chase.seed = seed;
+			ia.chase.tlb = tlb;
+			ia.chase.alloc = alloc;
 
 			if (tmp) {
 				ref = tmp;
 			} else {
 				/*
 				 * Encode chase params into the resource name so distinct
-				 * (size, stride, pattern) combos get distinct buffers
-				 * within one task, while identical configs share one.
+				 * (size, stride, pattern, chains, seed) combos get
+				 * distinct buffers within one task, while identical
+				 * configs share one.
 				 */
-				snprintf(encoded, sizeof(encoded), "memrun_%c_%d_%d",
-				         is_random ? 'r' : 's', stride, mem_size);
+				snprintf(encoded, sizeof(encoded), "memrun_%c%d%s_%d_%d_%u%s",
+				         pattern[0], chains, tlb ? "t" : "",
+				         tlb ? 0 : stride, mem_size, seed, alloc_name);
 				ref = create_unique_name(unique_name, sizeof(unique_name),
 				                         encoded, tag);
 			}
@@ -660,13 +1003,14 @@ parse_task_event_data(char *name, struct json_object *obj,
 			data->type = rtapp_mem_chase;
 			free(pattern);
 		} else if (!strcmp(mem_type, "read")) {
-			char encoded[48];
-			union init_args ia = { .membuf = { mem_size } };
+			char encoded[80];
+			union init_args ia = { .membuf = { mem_size, alloc } };
 
 			if (tmp) {
 				ref = tmp;
 			} else {
-				snprintf(encoded, sizeof(encoded), "memrun_read_%d", mem_size);
+				snprintf(encoded, sizeof(encoded), "memrun_read_%d%s",
+					 mem_size, alloc_name);
 				ref = create_unique_name(unique_name, sizeof(unique_name),
 				                         encoded, tag);
 			}
@@ -675,13 +1019,14 @@ parse_task_event_data(char *name, struct json_object *obj,
 			data->count = mem_count;
 			data->type = rtapp_mem_read;
 		} else if (!strcmp(mem_type, "write")) {
-			char encoded[48];
-			union init_args ia = { .membuf = { mem_size } };
+			char encoded[80];
+			union init_args ia = { .membuf = { mem_size, alloc } };
 
 			if (tmp) {
 				ref = tmp;
 			} else {
-				snprintf(encoded, sizeof(encoded), "memrun_write_%d", mem_size);
+				snprintf(encoded, sizeof(encoded), "memrun_write_%d%s",
+					 mem_size, alloc_name);
 				ref = create_unique_name(unique_name, sizeof(unique_name),
 				                         encoded, tag);
 			}
@@ -689,6 +1034,38 @@ parse_task_event_data(char *name, struct json_object *obj,
 			                               resources_table, opts);
 			data->count = mem_count;
 			data->type = rtapp_mem_write;
+		} else if (stream_kernel_index(mem_type) >= 0) {
+			int kernel = stream_kernel_index(mem_type);
+			int nt = get_bool_value_from(obj, "nontemporal", TRUE, 0);
+			char encoded[80];
+			union init_args ia = { .stream = { mem_size, kernel, nt, alloc } };
+
+			if (mem_size < STREAM_ALIGN || mem_size % STREAM_ALIGN) {
+				log_critical(PIN2 "memrun %s size %d must be a multiple of %d",
+					     mem_type, mem_size, STREAM_ALIGN);
+				exit(EXIT_INV_CONFIG);
+			}
+
+			/* stream_run() processes whole blocks of STREAM_ALIGN */
+			if (mem_count < STREAM_ALIGN) {
+				log_critical(PIN2 "memrun %s count %d must be at least %d",
+					     mem_type, mem_count, STREAM_ALIGN);
+				exit(EXIT_INV_CONFIG);
+			}
+
+			if (tmp) {
+				ref = tmp;
+			} else {
+				snprintf(encoded, sizeof(encoded), "memrun_%s%s_%d%s",
+					 mem_type, nt ? "_nt" : "", mem_size,
+					 alloc_name);
+				ref = create_unique_name(unique_name, sizeof(unique_name),
+				                         encoded, tag);
+			}
+			data->res = get_resource_index(ref, rtapp_mem_stream, &ia,
+			                               resources_table, opts);
+			data->count = mem_count;
+			data->type = rtapp_mem_stream;
 		} else {
 			log_critical(PIN2 "Unknown memrun type: %s", mem_type);
 			goto unknown_event;
@@ -806,6 +1183,7 @@ parse_task_event_data(char *name, struct json_object *obj,
 
 		rdata = &((*resources_table)->resources[data->res]);
 		ddata = &((*resources_table)->resources[data->dep]);
+		parse_sync_wait(obj, &rdata->res.cond.sync);
 
 		log_info(PIN2 "type %d target %s [%d] mutex %s [%d]", data->type, rdata->name, rdata->index, ddata->name, ddata->index);
 		snprintf(data->name, sizeof(data->name)-1, "%s:%s:%s",
@@ -815,17 +1193,23 @@ parse_task_event_data(char *name, struct json_object *obj,
 
 	if (!strncmp(name, "barrier", strlen("barrier"))) {
 
-		if (!json_object_is_type(obj, json_type_string))
+		/* "barrier" : "name" or { "ref" : "name", "strategy" : ... } */
+		if (json_object_is_type(obj, json_type_object))
+			tmp = get_string_value_from(obj, "ref", FALSE, NULL);
+		else if (json_object_is_type(obj, json_type_string))
+			tmp = strdup(json_object_get_string(obj));
+		else
 			goto unknown_event;
 
 		data->type = rtapp_barrier;
 
-		ref = json_object_get_string(obj);
-		i = get_resource_index(ref, rtapp_barrier, NULL, resources_table, opts);
+		i = get_resource_index(tmp, rtapp_barrier, NULL, resources_table, opts);
+		free(tmp);
 
 		data->res = i;
 		rdata = &((*resources_table)->resources[data->res]);
 		rdata->res.barrier.waiting += tdata->num_instances;
+		parse_sync_wait(obj, &rdata->res.barrier.sync);
 
 		log_info(PIN2 "type %d target %s [%d] %d users so far", data->type, rdata->name, rdata->index, rdata->res.barrier.waiting);
 		snprintf(data->name, sizeof(data->name)-1, "%s:%s",
@@ -863,6 +1247,41 @@ parse_task_event_data(char *name, struct json_object *obj,
 			rdata->res.timer.relative = 0;
 		free(tmp);
 
+		/* The mode sets the default behavior on a missed activation */
+		tmp = get_string_value_from(obj, "overrun", TRUE,
+				rdata->res.timer.relative ? "reset_relative" : "catch_up");
+		if (!strcmp(tmp, "reset_relative")) {
+			rdata->res.timer.overrun = timer_reset_relative;
+		} else if (!strcmp(tmp, "catch_up")) {
+			rdata->res.timer.overrun = timer_catch_up;
+		} else if (!strcmp(tmp, "skip_to_next")) {
+			rdata->res.timer.overrun = timer_skip_to_next;
+		} else if (!strcmp(tmp, "abort")) {
+			rdata->res.timer.overrun = timer_abort;
+		} else {
+			log_critical(PIN2 "Invalid timer overrun policy %s", tmp);
+			exit(EXIT_INV_CONFIG);
+		}
+		free(tmp);
+
+		tmp = get_string_value_from(obj, "backend", TRUE,
+				timer_backend_name(rdata->res.timer.backend));
+		i = timer_backend_index(tmp);
+		if (i < 0) {
+			log_critical(PIN2 "Invalid timer backend %s", tmp);
+			exit(EXIT_INV_CONFIG);
+		}
+		rdata->res.timer.backend = i;
+		free(tmp);
+
+		rdata->res.timer.spin = get_int_value_from(obj, "spin", TRUE,
+						rdata->res.timer.spin);
+		if (rdata->res.timer.spin < 0) {
+			log_critical(PIN2 "Invalid timer spin %d",
+				     rdata->res.timer.spin);
+			exit(EXIT_INV_CONFIG);
+		}
+
 		log_info(PIN2 "type %d target %s [%d] period %d", data->type, rdata->name, rdata->index, data->duration);
 		snprintf(data->name, sizeof(data->name)-1, "%s:%s",
 			 name, rdata->name);
@@ -888,6 +1307,7 @@ parse_task_event_data(char *name, struct json_object *obj,
 
 		rdata = &((*resources_table)->resources[data->res]);
 		ddata = &((*resources_table)->resources[data->dep]);
+		parse_sync_wait(obj, &rdata->res.cond.sync);
 
 		log_info(PIN2 "type %d target %s [%d] mutex %s [%d]", data->type, rdata->name, rdata->index, ddata->name, ddata->index);
 		snprintf(data->name, sizeof(data->name)-1, "%s:%s:%s",
@@ -927,22 +1347,39 @@ parse_task_event_data(char *name, struct json_object *obj,
 
 	if (!strncmp(name, "fork", strlen("fork"))) {
 
+		int pool = 0;
+
 		data->type = rtapp_fork;
 
-		if (!json_object_is_type(obj, json_type_string))
+		/* "fork" : "task" or { "ref" : "task", "pool" : N } */
+		if (json_object_is_type(obj, json_type_object)) {
+			tmp = get_string_value_from(obj, "ref", FALSE, NULL);
+			pool = get_int_value_from(obj, "pool", TRUE, 0);
+			if (pool < 0 || pool > FORKS_LIMIT) {
+				log_critical(PIN2 "Invalid fork pool %d of %s",
+					     pool, tmp);
+				exit(EXIT_INV_CONFIG);
+			}
+		} else if (json_object_is_type(obj, json_type_string)) {
+			tmp = strdup(json_object_get_string(obj));
+		} else {
 			goto unknown_event;
+		}
 
-		ref = json_object_get_string(obj);
-
-		i = get_resource_index(ref, rtapp_fork, NULL, resources_table, opts);
+		i = get_resource_index(tmp, rtapp_fork, NULL, resources_table, opts);
 
 		data->res = i;
 
 		rdata = &((*resources_table)->resources[data->res]);
 
-		rdata->res.fork.ref = strdup(ref);
-		rdata->res.fork.tdata = NULL;
-		rdata->res.fork.nforks = 0;
+		/* the fork events of a task share its pool, the biggest one */
+		if (pool > rdata->res.fork.pool)
+			rdata->res.fork.pool = pool;
+
+		if (!rdata->res.fork.ref)
+			rdata->res.fork.ref = tmp;
+		else
+			free(tmp);
 
 		if (!rdata->res.fork.ref) {
 			log_error("Failed to duplicate ref");
@@ -979,15 +1416,21 @@ parse_task_event_data(char *name, struct json_object *obj,
 
 		data->type = rtapp_sem_wait;
 
-		if (!json_object_is_type(obj, json_type_string))
+		/* "sem_wait" : "name" or { "ref" : "name", "strategy" : ... } */
+		if (json_object_is_type(obj, json_type_object))
+			tmp = get_string_value_from(obj, "ref", FALSE, NULL);
+		else if (json_object_is_type(obj, json_type_string))
+			tmp = strdup(json_object_get_string(obj));
+		else
 			goto unknown_event;
 
-		ref = json_object_get_string(obj);
-		i = get_resource_index(ref, rtapp_sem_post, NULL, resources_table, opts);
+		i = get_resource_index(tmp, rtapp_sem_post, NULL, resources_table, opts);
+		free(tmp);
 
 		data->res = i;
 
 		rdata = &((*resources_table)->resources[data->res]);
+		parse_sync_wait(obj, &rdata->res.sem.sync);
 
 		log_info(PIN2 "type %d target %s [%d]", data->type, rdata->name, rdata->index);
 		snprintf(data->name, sizeof(data->name)-1, "%s:%s",
@@ -995,6 +1438,97 @@ parse_task_event_data(char *name, struct json_object *obj,
 		return;
 	}
 
+	if (!strncmp(name, "push", strlen("push")) ||
+	    !strncmp(name, "pop", strlen("pop"))) {
+		struct _rtapp_queue *queue;
+		int push = !strncmp(name, "push", strlen("push"));
+		int policy = queue_block;
+
+		data->type = push ? rtapp_push : rtapp_pop;
+
+		/* "push" : "name" or { "ref" : "name", "full" : ... } */
+		if (json_object_is_type(obj, json_type_object))
+			tmp = get_string_value_from(obj, "ref", FALSE, NULL);
+		else if (json_object_is_type(obj, json_type_string))
+			tmp = strdup(json_object_get_string(obj));
+		else
+			goto unknown_event;
+
+		i = get_resource_index(tmp, rtapp_push, NULL, resources_table, opts);
+		free(tmp);
+
+		data->res = i;
+		rdata = &((*resources_table)->resources[data->res]);
+		queue = &rdata->res.queue;
+		parse_queue(obj, rdata);
+
+		/* what to do on a full or empty queue, kept in count */
+		if (json_object_is_type(obj, json_type_object)) {
+			tmp = get_string_value_from(obj, push ? "full" : "empty",
+						    TRUE, "block");
+			policy = queue_policy_index(tmp);
+			if (policy < 0) {
+				log_critical(PIN2 "Invalid %s policy %s",
+					     push ? "full" : "empty", tmp);
+				exit(EXIT_INV_CONFIG);
+			}
+			free(tmp);
+		}
+		data->count = policy;
+
+		/* the events of a task count once, see check_queues() */
+		if (push && queue->last_producer != tdata) {
+			queue->producers += tdata->num_instances;
+			queue->last_producer = tdata;
+		} else if (!push && queue->last_consumer != tdata) {
+			queue->consumers += tdata->num_instances;
+			queue->last_consumer = tdata;
+		}
+
+		log_info(PIN2 "type %d target %s [%d] %s", data->type,
+			 rdata->name, rdata->index, queue_policy_name(policy));
+		snprintf(data->name, sizeof(data->name)-1, "%s:%s",
+			 name, rdata->name);
+		return;
+	}
+
+	if (!strncmp(name, "migrate_pages", strlen("migrate_pages"))) {
+		rtapp_resources_t *table = *resources_table;
+
+		if (!json_object_is_type(obj, json_type_object))
+			goto unknown_event;
+
+		/* the buffer of a memrun event with a "ref", set before */
+		tmp = get_string_value_from(obj, "ref", FALSE, NULL);
+		for (i = 0; i < table->nresources; i++) {
+			rdata = &table->resources[i];
+			if (!strcmp(rdata->name, tmp) &&
+			    (rdata->type == rtapp_mem_read ||
+			     rdata->type == rtapp_mem_write ||
+			     rdata->type == rtapp_mem_chase ||
+			     rdata->type == rtapp_mem_stream))
+				break;
+		}
+		if (i >= table->nresources) {
+			log_critical(PIN2 "migrate_pages: no memrun buffer %s, "
+				     "it must be set by a previous memrun "
+				     "\"ref\"", tmp);
+			exit(EXIT_INV_CONFIG);
+		}
+		free(tmp);
+
+		data->type = rtapp_migrate_pages;
+		data->res = i;
+		data->count = get_int_value_from(obj, "node", FALSE, 0);
+		check_mem_node(data->count);
+
+		log_info(PIN2 "type %d target %s [%d] node %d", data->type,
+			 rdata->name, rdata->index, data->count);
+		snprintf(data->name, sizeof(data->name)-1, "%s:%s",
+			 name, rdata->name);
+		return;
+	}
+
 	log_error(PIN2 "Resource %s not found in the resource section !!!", ref);
 	log_error(PIN2 "Please check the resource name or the resource section");
 
@@ -1012,6 +1546,7 @@ static char *events[] = {
 	"sync",
 	"sleep",
 	"runtime",
+	"cputime",
 	"run",
 	"timer",
 	"suspend",
@@ -1024,6 +1559,9 @@ static char *events[] = {
 	"fork",
 	"sem_post",
 	"sem_wait",
+	"push",
+	"pop",
+	"migrate_pages",
 	NULL
 };
 
@@ -1167,6 +1705,7 @@ static sched_data_t *parse_sched_data(struct json_object *obj, int def_policy)
 	tmp_data.runtime = get_int_value_from(obj, "dl-runtime", TRUE, 0);
 	tmp_data.period = get_int_value_from(obj, "dl-period", TRUE, tmp_data.runtime);
 	tmp_data.deadline = get_int_value_from(obj, "dl-deadline", TRUE, tmp_data.period);
+	tmp_data.dl_overrun = get_bool_value_from(obj, "dl-overrun", TRUE, 0);
 
 	/* clamping params (-1: no changes ) */
 	tmp_data.util_min = get_int_value_from(obj, "util_min", TRUE, -1);
@@ -1297,13 +1836,20 @@ parse_task_phase_data(struct json_object *obj,
 
 	log_info(PIN "Found %d events", data->nbevents);
 
-	data->events = malloc(data->nbevents * sizeof(event_data_t));
+	data->events = calloc(data->nbevents, sizeof(event_data_t));
+	if (!data->events) {
+		log_critical(PIN "Cannot allocate events");
+		exit(EXIT_FAILURE);
+	}
 
 	/* Parse events */
 	i = 0;
 	foreach(obj, entry, key, val, idx) {
 		if (obj_is_event(key)) {
 			log_info(PIN "Parsing event %s", key);
+			/* No resource until the event sets one */
+			data->events[i].res = -1;
+			data->events[i].dep = -1;
 			parse_task_event_data(key, val, &data->events[i], tdata, opts);
 			i++;
 		}
@@ -1314,6 +1860,35 @@ parse_task_phase_data(struct json_object *obj,
 	data->taskgroup_data = parse_taskgroup_data(obj);
 }
 
+/* stack_size of a task or of the global object, in bytes, 0 for default */
+static size_t
+parse_stack_size(struct json_object *obj, size_t def)
+{
+	int size = get_int_value_from(obj, "stack_size", TRUE, def);
+
+	if (size && size < (int)PTHREAD_STACK_MIN) {
+		log_critical(PFX "Invalid stack_size %d, the minimum is %d",
+			     size, (int)PTHREAD_STACK_MIN);
+		exit(EXIT_INV_CONFIG);
+	}
+
+	return size;
+}
+
+/* stack_lock of a task or of the global object, in bytes */
+static size_t
+parse_stack_lock(struct json_object *obj, size_t def)
+{
+	int size = get_int_value_from(obj, "stack_lock", TRUE, def);
+
+	if (size < 0) {
+		log_critical(PFX "Invalid stack_lock %d", size);
+		exit(EXIT_INV_CONFIG);
+	}
+
+	return size;
+}
+
 static void
 parse_task_data(char *name, struct json_object *obj, int index,
 		  thread_data_t *data, rtapp_options_t *opts)
@@ -1347,6 +1922,7 @@ parse_task_data(char *name, struct json_object *obj, int index,
 	data->cpu_data.cpuset = NULL;
 	data->cpu_data.cpuset_str = NULL;
 	data->curr_cpu_data = NULL;
+	data->run_cpu = -1;
 	data->def_cpu_data.cpuset = NULL;
 	data->def_cpu_data.cpuset_str = NULL;
 
@@ -1354,6 +1930,20 @@ parse_task_data(char *name, struct json_object *obj, int index,
 	data->numa_data.numaset_str = NULL;
 	data->curr_numa_data = NULL;
 
+	/* Phases are compiled for each thread when it is created */
+	data->progs = NULL;
+	data->progs_shared = 0;
+
+	data->stack_size = parse_stack_size(obj, opts->stack_size);
+	data->stack_lock = parse_stack_lock(obj, opts->stack_lock);
+	data->prefault = get_bool_value_from(obj, "prefault", TRUE,
+					     opts->prefault);
+	data->timer_slack = get_int_value_from(obj, "timer_slack", TRUE, -1);
+	if (data->timer_slack < -1) {
+		log_critical(PIN "Invalid timer_slack %ld", data->timer_slack);
+		exit(EXIT_INV_CONFIG);
+	}
+
 	/* cpuset */
 	parse_cpuset_data(obj, &data->cpu_data);
 	/* numa */
@@ -1447,6 +2037,30 @@ parse_task_data(char *name, struct json_object *obj, int index,
 	data->curr_taskgroup_data = NULL;
 }
 
+/* A queue which isn't mpmc has a single producer and a single consumer */
+static void
+check_queues(rtapp_options_t *opts)
+{
+	rtapp_resources_t *table = opts->resources;
+	int i;
+
+	for (i = 0; i < table->nresources; i++) {
+		rtapp_resource_t *rdata = &table->resources[i];
+		struct _rtapp_queue *queue = &rdata->res.queue;
+
+		if (rdata->type != rtapp_push || queue->mpmc)
+			continue;
+
+		if (queue->producers > 1 || queue->consumers > 1) {
+			log_critical(PFX "Queue %s has %d producers and %d"
+				     " consumers, set \"mpmc\" to true",
+				     rdata->name, queue->producers,
+				     queue->consumers);
+			exit(EXIT_INV_CONFIG);
+		}
+	}
+}
+
 static void
 parse_tasks(struct json_object *tasks, rtapp_options_t *opts)
 {
@@ -1478,6 +2092,8 @@ parse_tasks(struct json_object *tasks, rtapp_options_t *opts)
 	opts->threads_data = malloc(sizeof(thread_data_t) * opts->num_tasks);
 	foreach (tasks, entry, key, val, idx)
 		parse_task_data(key, val, -1, &opts->threads_data[i++], opts);
+
+	check_queues(opts);
 }
 
 static void
@@ -1492,22 +2108,63 @@ parse_global(struct json_object *global, rtapp_options_t *opts)
 	if (!global) {
 		log_info(PFX " No global section Found: Use default value");
 		opts->duration = -1;
+		opts->start_margin = 0;
+		opts->start_spin = 0;
+		opts->graceful_stop = 0;
 		opts->gnuplot = 0;
 		opts->policy = other;
 		opts->calib_cpu = 0;
 		opts->calib_ns_per_loop = 0;
+		opts->capacity_normalized = 0;
+		opts->calib_cache = NULL;
+		opts->calib_ci = CALIB_DEFAULT_CI;
+		opts->calib_budget = CALIB_DEFAULT_BUDGET;
 		opts->logdir = strdup("./");
 		opts->logbasename = strdup("rt-app");
 		opts->logsize = 0;
-		opts->lock_pages = 1;
+		opts->log_format = LOG_FORMAT_TEXT;
+		opts->ftrace_format = LOG_FORMAT_TEXT;
+		opts->logger_prio = 0;
+		opts->logger_cpu_data.cpuset = NULL;
+		opts->logger_cpu_data.cpuset_str = strdup("-");
+		opts->logger_cpu_data.cpusetsize = 0;
+		opts->logger_ring = LOGGER_DEFAULT_RING;
+		opts->logger_period = LOGGER_DEFAULT_PERIOD;
+		opts->lock_pages = LOCK_PAGES_THREAD;
+		opts->prefault = 0;
+		opts->stack_size = 0;
+		opts->stack_lock = DEFAULT_STACK_LOCK;
+		opts->startup_threads = 0;
+		opts->log_shared = 0;
 		opts->pi_enabled = 0;
 		opts->io_device = strdup("/dev/null");
 		opts->mem_buffer_size = DEFAULT_MEM_BUF_SIZE;
+		memset(&opts->mem_alloc, 0, sizeof(opts->mem_alloc));
+		opts->mem_alloc.node = MEM_NODE_ANY;
+		opts->numa_matrix = 0;
+		opts->numa_matrix_count = NUMA_MATRIX_COUNT;
 		opts->cumulative_slack = 0;
+		opts->histogram = 0;
+		opts->hist_interval = 0;
+		opts->timeline = 0;
+		opts->die_on_dmiss = 0;
+		opts->pmu_events = 0;
 		return;
 	}
 
-	opts->duration = get_int_value_from(global, "duration", TRUE, -1);
+	opts->duration = get_double_value_from(global, "duration", TRUE, -1);
+	opts->start_margin = get_int_value_from(global, "start_margin", TRUE, 0);
+	opts->start_spin = get_int_value_from(global, "start_spin", TRUE, 0);
+	if (opts->start_margin < 0 || opts->start_spin < 0) {
+		log_critical(PFX "Invalid start_margin %d or start_spin %d",
+			     opts->start_margin, opts->start_spin);
+		exit(EXIT_INV_CONFIG);
+	}
+	opts->graceful_stop = get_int_value_from(global, "graceful_stop", TRUE, 0);
+	if (opts->graceful_stop < 0) {
+		log_critical(PFX "Invalid graceful_stop %d", opts->graceful_stop);
+		exit(EXIT_INV_CONFIG);
+	}
 	opts->gnuplot = get_bool_value_from(global, "gnuplot", TRUE, 0);
 	policy = get_string_value_from(global, "default_policy",
 				       TRUE, "SCHED_OTHER");
@@ -1531,12 +2188,19 @@ parse_global(struct json_object *global, rtapp_options_t *opts)
 		if (json_object_is_type(tmp_obj, json_type_int)) {
 			/* integer (no " ") detected. */
 			opts->calib_ns_per_loop = json_object_get_int(tmp_obj);
+			/* the other burn kernels are calibrated on CPU0 */
+			opts->calib_cpu = 0;
 			log_debug("ns_per_loop %d", opts->calib_ns_per_loop);
 		} else {
 			/* Get CPU number */
 			tmp_str = get_string_value_from(global, "calibration",
 					 TRUE, "CPU0");
-			scan_cnt = sscanf(tmp_str, "CPU%d", &opts->calib_cpu);
+			if (!strcmp(tmp_str, "all")) {
+				opts->calib_cpu = CALIB_ALL_CPUS;
+				scan_cnt = 1;
+			} else {
+				scan_cnt = sscanf(tmp_str, "CPU%d", &opts->calib_cpu);
+			}
 			/*
 			 * get_string_value_from allocate the string so with have to free it
 			 * once useless
@@ -1550,6 +2214,30 @@ parse_global(struct json_object *global, rtapp_options_t *opts)
 		}
 	}
 
+	opts->capacity_normalized = get_bool_value_from(global,
+				"capacity_normalized", TRUE, 0);
+	if (opts->capacity_normalized) {
+		if (opts->calib_ns_per_loop) {
+			log_critical(PFX "capacity_normalized needs per CPU calibration");
+			exit(EXIT_INV_CONFIG);
+		}
+		if (opts->calib_cpu != CALIB_ALL_CPUS) {
+			log_notice("capacity_normalized: calibrating all CPUs");
+			opts->calib_cpu = CALIB_ALL_CPUS;
+		}
+	}
+
+	opts->calib_cache = get_string_value_from(global, "calibration_cache",
+						  TRUE, NULL);
+	opts->calib_ci = get_double_value_from(global, "calibration_ci",
+					       TRUE, CALIB_DEFAULT_CI);
+	opts->calib_budget = get_int_value_from(global, "calibration_budget",
+						TRUE, CALIB_DEFAULT_BUDGET);
+	if (opts->calib_ci <= 0 || opts->calib_budget <= 0) {
+		log_critical(PFX "Invalid calibration_ci or calibration_budget");
+		exit(EXIT_INV_CONFIG);
+	}
+
 	tmp_obj = get_in_object(global, "log_size", TRUE);
 	if (tmp_obj == NULL) {
 		/* no size ? use file system */
@@ -1569,6 +2257,8 @@ parse_global(struct json_object *global, rtapp_options_t *opts)
 				opts->logsize = 0;
 			else if (!strcmp(tmp_str, "file"))
 				opts->logsize = -2;
+			else if (!strcmp(tmp_str, "async"))
+				opts->logsize = LOG_SIZE_ASYNC;
 			else if (!strcmp(tmp_str, "auto"))
 				opts->logsize = -2; /* Automatic buffer size computation is not supported yet so we fall back on file system mode */
 			log_debug("Log buffer set to %s mode", tmp_str);
@@ -1581,6 +2271,61 @@ parse_global(struct json_object *global, rtapp_options_t *opts)
 		}
 	}
 
+	tmp_str = get_string_value_from(global, "log_format", TRUE, "text");
+	if (!strcmp(tmp_str, "text")) {
+		opts->log_format = LOG_FORMAT_TEXT;
+	} else if (!strcmp(tmp_str, "binary")) {
+		opts->log_format = LOG_FORMAT_BINARY;
+	} else {
+		log_critical(PFX "Invalid log_format %s", tmp_str);
+		exit(EXIT_INV_CONFIG);
+	}
+	free(tmp_str);
+
+	/*
+	 * A binary log which grows is extended and mapped chunk by chunk, so
+	 * the logger thread writes it instead of the threads of the use case.
+	 */
+	if (opts->log_format == LOG_FORMAT_BINARY && opts->logsize == -2) {
+		log_notice("Binary log written by the logger thread");
+		opts->logsize = LOG_SIZE_ASYNC;
+	}
+
+	opts->log_shared = get_bool_value_from(global, "log_shared", TRUE, 0);
+	if (opts->log_shared && opts->log_format == LOG_FORMAT_BINARY) {
+		log_critical(PFX "log_shared needs the text log_format");
+		exit(EXIT_INV_CONFIG);
+	}
+
+	tmp_obj = get_in_object(global, "logger", TRUE);
+	if (tmp_obj) {
+		assure_type_is(tmp_obj, global, "logger", json_type_object);
+		opts->logger_prio = get_int_value_from(tmp_obj, "priority",
+						       TRUE, 0);
+		opts->logger_ring = get_int_value_from(tmp_obj, "ring_size",
+						       TRUE, LOGGER_DEFAULT_RING);
+		opts->logger_period = get_int_value_from(tmp_obj, "period",
+						 TRUE, LOGGER_DEFAULT_PERIOD);
+		parse_cpuset_data(tmp_obj, &opts->logger_cpu_data);
+	} else {
+		opts->logger_prio = 0;
+		opts->logger_ring = LOGGER_DEFAULT_RING;
+		opts->logger_period = LOGGER_DEFAULT_PERIOD;
+		opts->logger_cpu_data.cpuset = NULL;
+		opts->logger_cpu_data.cpuset_str = strdup("-");
+		opts->logger_cpu_data.cpusetsize = 0;
+	}
+	if (opts->logger_ring <= 0 ||
+	    (opts->logger_ring & (opts->logger_ring - 1))) {
+		log_critical(PFX "logger ring_size %d is not a power of 2",
+			     opts->logger_ring);
+		exit(EXIT_INV_CONFIG);
+	}
+	if (opts->logger_period <= 0 || opts->logger_prio < 0) {
+		log_critical(PFX "Invalid logger period or priority");
+		exit(EXIT_INV_CONFIG);
+	}
+
 	opts->logdir = get_string_value_from(global, "logdir", TRUE, "./");
 	opts->logbasename = get_string_value_from(global, "log_basename",
 						  TRUE, "rt-app");
@@ -1602,14 +2347,120 @@ parse_global(struct json_object *global, rtapp_options_t *opts)
 	    exit(EXIT_INV_CONFIG);
 	}
 
-	opts->lock_pages = get_bool_value_from(global, "lock_pages", TRUE, 1);
+	tmp_str = get_string_value_from(global, "ftrace_format", TRUE, "text");
+	if (!strcmp(tmp_str, "text")) {
+		opts->ftrace_format = LOG_FORMAT_TEXT;
+	} else if (!strcmp(tmp_str, "binary")) {
+		opts->ftrace_format = LOG_FORMAT_BINARY;
+	} else {
+		log_critical(PFX "Invalid ftrace_format %s", tmp_str);
+		exit(EXIT_INV_CONFIG);
+	}
+	free(tmp_str);
+
+	/* lock_pages: a boolean or "process" for the former mlockall() */
+	tmp_obj = get_in_object(global, "lock_pages", TRUE);
+	if (tmp_obj && json_object_is_type(tmp_obj, json_type_string)) {
+		if (strcmp(json_object_get_string(tmp_obj), "process")) {
+			log_critical(PFX "Invalid lock_pages %s",
+				     json_object_get_string(tmp_obj));
+			exit(EXIT_INV_CONFIG);
+		}
+		opts->lock_pages = LOCK_PAGES_PROCESS;
+	} else if (get_bool_value_from(global, "lock_pages", TRUE, 1)) {
+		opts->lock_pages = LOCK_PAGES_THREAD;
+	} else {
+		opts->lock_pages = LOCK_PAGES_NONE;
+	}
+	opts->prefault = get_bool_value_from(global, "prefault", TRUE, 0);
+	opts->stack_size = parse_stack_size(global, 0);
+	opts->stack_lock = parse_stack_lock(global, DEFAULT_STACK_LOCK);
+	opts->startup_threads = get_int_value_from(global, "startup_threads",
+						   TRUE, 0);
+	if (opts->startup_threads < 0) {
+		log_critical(PFX "Invalid startup_threads %d",
+			     opts->startup_threads);
+		exit(EXIT_INV_CONFIG);
+	}
 	opts->pi_enabled = get_bool_value_from(global, "pi_enabled", TRUE, 0);
 	opts->io_device = get_string_value_from(global, "io_device", TRUE,
 						"/dev/null");
 	opts->mem_buffer_size = get_int_value_from(global, "mem_buffer_size",
 							TRUE, DEFAULT_MEM_BUF_SIZE);
+	memset(&opts->mem_alloc, 0, sizeof(opts->mem_alloc));
+	opts->mem_alloc.node = MEM_NODE_ANY;
+	parse_mem_alloc(get_in_object(global, "mem_alloc", TRUE),
+			&opts->mem_alloc);
+	parse_numa_matrix(global, opts);
 	opts->cumulative_slack = get_bool_value_from(global, "cumulative_slack", TRUE, 0);
 
+	/* die_on_dmiss: true or the number of consecutive misses */
+	tmp_obj = get_in_object(global, "die_on_dmiss", TRUE);
+	if (tmp_obj && json_object_is_type(tmp_obj, json_type_int))
+		opts->die_on_dmiss = json_object_get_int(tmp_obj);
+	else
+		opts->die_on_dmiss = get_bool_value_from(global, "die_on_dmiss",
+							 TRUE, 0);
+	if (opts->die_on_dmiss < 0) {
+		log_critical(PFX "Invalid die_on_dmiss %d", opts->die_on_dmiss);
+		exit(EXIT_INV_CONFIG);
+	}
+
+	/* histogram: true or an object with the period of the summary dump */
+	opts->hist_interval = 0;
+	tmp_obj = get_in_object(global, "histogram", TRUE);
+	if (tmp_obj && json_object_is_type(tmp_obj, json_type_object)) {
+		opts->histogram = 1;
+		opts->hist_interval = get_int_value_from(tmp_obj, "interval",
+							 TRUE, 0);
+		if (opts->hist_interval < 0) {
+			log_critical(PFX "Invalid histogram interval %d",
+				     opts->hist_interval);
+			exit(EXIT_INV_CONFIG);
+		}
+	} else {
+		opts->histogram = get_bool_value_from(global, "histogram",
+						      TRUE, 0);
+	}
+
+	/* timeline: true or the number of slices kept per thread */
+	tmp_obj = get_in_object(global, "timeline", TRUE);
+	if (tmp_obj && json_object_is_type(tmp_obj, json_type_int)) {
+		opts->timeline = json_object_get_int(tmp_obj);
+		if (opts->timeline <= 0 ||
+		    (opts->timeline & (opts->timeline - 1))) {
+			log_critical(PFX "Invalid timeline %d, must be a power of 2",
+				     opts->timeline);
+			exit(EXIT_INV_CONFIG);
+		}
+	} else if (get_bool_value_from(global, "timeline", TRUE, 0)) {
+		opts->timeline = TIMELINE_DEFAULT_SIZE;
+	} else {
+		opts->timeline = 0;
+	}
+
+	/* perf_events: true for all the counters or an array of counter names */
+	opts->pmu_events = 0;
+	tmp_obj = get_in_object(global, "perf_events", TRUE);
+	if (tmp_obj && json_object_is_type(tmp_obj, json_type_array)) {
+		int i, mask;
+
+		for (i = 0; i < json_object_array_length(tmp_obj); i++) {
+			struct json_object *ev = json_object_array_get_idx(tmp_obj, i);
+
+			assure_type_is(ev, global, "perf_events", json_type_string);
+			mask = pmu_event_mask(json_object_get_string(ev));
+			if (!mask) {
+				log_critical(PFX "Invalid perf_events counter %s",
+					     json_object_get_string(ev));
+				exit(EXIT_INV_CONFIG);
+			}
+			opts->pmu_events |= mask;
+		}
+	} else if (get_bool_value_from(global, "perf_events", TRUE, 0)) {
+		opts->pmu_events = PMU_ALL_EVENTS;
+	}
+
 }
 
 static void
@@ -0,0 +1,243 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "rt-app_utils.h"
+#include "rt-app_pmu.h"
+
+pmu_data_t pmu;
+
+static const struct {
+	const char *name;
+	uint32_t type;
+	__u64 config;
+} pmu_events[PMU_NR_EVENTS] = {
+	[PMU_CYCLES] = { "cycles", PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_CPU_CYCLES },
+	[PMU_INSTRUCTIONS] = { "instructions", PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_INSTRUCTIONS },
+	[PMU_CACHE_MISSES] = { "cache-misses", PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_CACHE_MISSES },
+	[PMU_BRANCH_MISSES] = { "branch-misses", PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_BRANCH_MISSES },
+	[PMU_CONTEXT_SWITCHES] = { "context-switches", PERF_TYPE_SOFTWARE,
+		PERF_COUNT_SW_CONTEXT_SWITCHES },
+	[PMU_CPU_MIGRATIONS] = { "cpu-migrations", PERF_TYPE_SOFTWARE,
+		PERF_COUNT_SW_CPU_MIGRATIONS },
+	[PMU_TASK_CLOCK] = { "task-clock", PERF_TYPE_SOFTWARE,
+		PERF_COUNT_SW_TASK_CLOCK },
+};
+
+int pmu_event_mask(const char *name)
+{
+	int i;
+
+	for (i = 0; i < PMU_TASK_CLOCK; i++)
+		if (!strcmp(pmu_events[i].name, name))
+			return 1 << i;
+
+	return 0;
+}
+
+const char *pmu_event_name(int id)
+{
+	return pmu_events[id].name;
+}
+
+static int pmu_open_event(int id, int group_fd)
+{
+	struct perf_event_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = pmu_events[id].type;
+	attr.config = pmu_events[id].config;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+			   PERF_FORMAT_TOTAL_TIME_RUNNING;
+	/* The software events are raised in the kernel */
+	attr.exclude_kernel = (attr.type == PERF_TYPE_HARDWARE);
+	attr.exclude_hv = 1;
+
+	/* Measure the calling thread on any CPU */
+	fd = syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+	if (fd < 0 && errno == EACCES && !attr.exclude_kernel) {
+		/* Restricted by perf_event_paranoid */
+		attr.exclude_kernel = 1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+	}
+
+	return fd;
+}
+
+/*
+ * Open the @nr_wanted counters of @wanted as a group on the calling thread.
+ * The ids and fds of the opened counters are set in @ids and @fds, the first
+ * one is the group leader. With @fallback, the counters which fail are skipped
+ * and cycles are replaced by the task clock when there is no PMU, like in most
+ * VMs.
+ */
+static int pmu_open_group(const int *wanted, int nr_wanted, int *ids, int *fds,
+			  int *nr, int fallback)
+{
+	int i, id, fd, leader = -1;
+
+	*nr = 0;
+	for (i = 0; i < nr_wanted; i++) {
+		id = wanted[i];
+
+		fd = pmu_open_event(id, leader);
+		if (fd < 0 && fallback && id == PMU_CYCLES) {
+			log_notice("perf_events: %s not available (%s), using %s",
+				   pmu_events[id].name, strerror(errno),
+				   pmu_events[PMU_TASK_CLOCK].name);
+			id = PMU_TASK_CLOCK;
+			fd = pmu_open_event(id, leader);
+		}
+
+		if (fd < 0) {
+			log_notice("perf_events: %s not available (%s)",
+				   pmu_events[id].name, strerror(errno));
+			if (fallback)
+				continue;
+			break;
+		}
+
+		if (leader < 0)
+			leader = fd;
+		/* Closing a fd removes the counter from the group */
+		fds[*nr] = fd;
+		ids[(*nr)++] = id;
+	}
+
+	return leader;
+}
+
+static void pmu_close_group(int *fds, int nr)
+{
+	int i;
+
+	for (i = nr - 1; i >= 0; i--)
+		close(fds[i]);
+}
+
+void pmu_init(int mask)
+{
+	int wanted[PMU_MAX_EVENTS], fds[PMU_MAX_EVENTS];
+	int id, nr_wanted = 0;
+
+	pmu.nr = 0;
+
+	for (id = 0; id < PMU_TASK_CLOCK && nr_wanted < PMU_MAX_EVENTS; id++)
+		if (mask & (1 << id))
+			wanted[nr_wanted++] = id;
+
+	if (!nr_wanted)
+		return;
+
+	if (pmu_open_group(wanted, nr_wanted, pmu.ids, fds, &pmu.nr, 1) < 0) {
+		log_error("perf_events: no counter available, disabled");
+		pmu.nr = 0;
+		return;
+	}
+
+	pmu_close_group(fds, pmu.nr);
+}
+
+void pmu_thread_open(pmu_thread_t *pt)
+{
+	int ids[PMU_MAX_EVENTS];
+
+	pt->fd = -1;
+	pt->nr = 0;
+	memset(pt->prev, 0, sizeof(pt->prev));
+	pt->prev_enabled = 0;
+	pt->prev_running = 0;
+	pt->multiplexed = 0;
+
+	if (!pmu.nr)
+		return;
+
+	pt->fd = pmu_open_group(pmu.ids, pmu.nr, ids, pt->fds, &pt->nr, 0);
+	if (pt->nr != pmu.nr) {
+		/* The columns must be the same for all threads */
+		log_error("perf_events: cannot open all the counters in thread %d",
+			  gettid());
+		pmu_close_group(pt->fds, pt->nr);
+		pt->fd = -1;
+		pt->nr = 0;
+	}
+
+	/* Start values */
+	pmu_thread_read(pt, NULL);
+}
+
+void pmu_thread_read(pmu_thread_t *pt, __u64 *values)
+{
+	/* nr, time enabled, time running and the values */
+	__u64 buf[3 + PMU_MAX_EVENTS];
+	__u64 enabled, running;
+	int i;
+
+	if (pt->fd < 0 ||
+	    read(pt->fd, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(__u64))) {
+		if (values)
+			memset(values, 0, sizeof(__u64) * pmu.nr);
+		return;
+	}
+
+	enabled = buf[1] - pt->prev_enabled;
+	running = buf[2] - pt->prev_running;
+	pt->prev_enabled = buf[1];
+	pt->prev_running = buf[2];
+
+	if (values && running < enabled)
+		pt->multiplexed++;
+
+	for (i = 0; i < pt->nr && i < (int)buf[0]; i++) {
+		if (values) {
+			values[i] = buf[3 + i] - pt->prev[i];
+			if (running && running < enabled)
+				values[i] = (double)values[i] * enabled / running;
+		}
+		pt->prev[i] = buf[3 + i];
+	}
+}
+
+void pmu_thread_close(pmu_thread_t *pt)
+{
+	if (pt->multiplexed)
+		log_notice("perf_events: counters multiplexed by the kernel in "
+			   "%lu loops of thread %d, their counts are scaled",
+			   pt->multiplexed, gettid());
+
+	pmu_close_group(pt->fds, pt->nr);
+	pt->fd = -1;
+	pt->nr = 0;
+}
@@ -0,0 +1,89 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef _RTAPP_PMU_H_
+#define _RTAPP_PMU_H_
+
+
+#include "rt-app_types.h"
+
+/*
+ * Per thread performance counters, read with perf_event_open().
+ *
+ * All the counters of a thread are in one group so they are read with a
+ * single read() at the end of each loop and the logged values are the deltas
+ * since the previous loop, with the times enabled and running of the group
+ * to detect and scale multiplexed loops.
+ */
+
+/* Counters which can be selected in the perf_events global option */
+enum pmu_event_id {
+	PMU_CYCLES = 0,
+	PMU_INSTRUCTIONS,
+	PMU_CACHE_MISSES,
+	PMU_BRANCH_MISSES,
+	PMU_CONTEXT_SWITCHES,
+	PMU_CPU_MIGRATIONS,
+	PMU_TASK_CLOCK,		/* software replacement of cycles */
+	PMU_NR_EVENTS,
+};
+
+#define PMU_ALL_EVENTS	((1 << PMU_TASK_CLOCK) - 1)
+
+typedef struct _pmu_data_t {
+	int nr;				/* number of opened counters */
+	int ids[PMU_MAX_EVENTS];	/* enum pmu_event_id of each column */
+} pmu_data_t;
+
+/* Counters of a thread */
+typedef struct _pmu_thread_t {
+	int fd;				/* group leader, -1 if disabled */
+	int fds[PMU_MAX_EVENTS];	/* fds of all the counters */
+	int nr;
+	__u64 prev[PMU_MAX_EVENTS];
+	__u64 prev_enabled;		/* time enabled of the group */
+	__u64 prev_running;		/* time running of the group */
+	unsigned long multiplexed;	/* loops with scaled counts */
+} pmu_thread_t;
+
+extern pmu_data_t pmu;
+
+/* Return the bit of the counter @name in the perf_events mask, 0 if unknown */
+int pmu_event_mask(const char *name);
+
+const char *pmu_event_name(int id);
+
+/* Select the counters of @mask which are available on this system */
+void pmu_init(int mask);
+
+void pmu_thread_open(pmu_thread_t *pt);
+
+/*
+ * Fill @values with the counts since the previous call. When the kernel
+ * multiplexed the group with other events in the meantime, the counts are
+ * scaled by the ratio of the time enabled to the time running.
+ */
+void pmu_thread_read(pmu_thread_t *pt, __u64 *values);
+
+void pmu_thread_close(pmu_thread_t *pt);
+
+#endif /* _RTAPP_PMU_H_ */
@@ -0,0 +1,98 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _RTAPP_PROGRAM_H_
+#define _RTAPP_PROGRAM_H_
+
+#include <signal.h>
+
+#include "rt-app_types.h"
+#include "rt-app_utils.h"
+#include "rt-app_ftrace.h"
+#include "rt-app_timeline.h"
+
+/*
+ * Execute the compiled program of a phase.
+ *
+ * Each op carries its own handler so there is no switch on the event type
+ * (call threaded dispatch). @traced must be a constant at the call site: the
+ * compiler then generates a variant without any debug or ftrace hook, which
+ * is the one used unless those logs or the timeline have been enabled.
+ *
+ * Once @running is cleared, only the lock/unlock events are executed until
+ * all the mutexes taken in the phase have been released.
+ */
+static inline void
+prog_run(const phase_prog_t *prog, event_ctx_t *ctx,
+	 volatile sig_atomic_t *running, const int traced)
+{
+	const event_op_t *op = prog->ops;
+	const event_op_t *end = op + prog->nbevents;
+	int lock = 0;
+	uint64_t start = 0;
+
+	for (; op < end; op++) {
+		if (!*running) {
+			if (!lock)
+				return;
+			if (!(op->flags & EVENT_OP_LOCK))
+				continue;
+		}
+
+		if (traced) {
+			const event_data_t *ev = &prog->events[op - prog->ops];
+
+			log_debug("[%d] runs event %d type %d desc=%s duration %d count %d",
+				  ctx->tdata ? ctx->tdata->ind : -1,
+				  (int)(op - prog->ops), ev->type, ev->name,
+				  op->duration, op->count);
+			if (ftrace_level & FTRACE_EVENT)
+				ftrace_event(ctx, prog, op - prog->ops);
+			if (ctx->timeline) {
+				ctx->flow_out = ctx->flow_in = 0;
+				start = timeline_now();
+			}
+		}
+
+		lock += op->handler(op, ctx);
+
+		if (traced && ctx->timeline) {
+			timeline_rec_t *rec;
+
+			rec = timeline_rec(ctx->timeline, TIMELINE_EVENT,
+					   prog->phase, op - prog->ops,
+					   start, timeline_now());
+			if (ctx->flow_out || ctx->flow_in) {
+				rec->res = op->rdata->index;
+				rec->flow_out = ctx->flow_out;
+				rec->flow_in = ctx->flow_in;
+			}
+		}
+	}
+}
+
+/* True if the debug or ftrace hooks of prog_run() have something to do */
+static inline int prog_traced(void)
+{
+	return (ftrace_level & FTRACE_EVENT) || (log_level >= LOG_LEVEL_DEBUG);
+}
+
+#endif /* _RTAPP_PROGRAM_H_ */
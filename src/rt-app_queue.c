@@ -0,0 +1,333 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+
+#define _GNU_SOURCE
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rt-app_queue.h"
+#include "rt-app_sync.h"
+#include "rt-app_utils.h"
+
+static const char *policy_names[queue_policies] = {
+	[queue_block] = "block",
+	[queue_spin] = "spin",
+	[queue_drop] = "drop",
+};
+
+const char *queue_policy_name(queue_policy_t policy)
+{
+	return policy_names[policy];
+}
+
+int queue_policy_index(const char *name)
+{
+	int i;
+
+	for (i = 0; i < queue_policies; i++)
+		if (!strcmp(name, policy_names[i]))
+			return i;
+
+	return -1;
+}
+
+int queue_init(struct _rtapp_queue *queue)
+{
+	queue_ring_t *q;
+	size_t len = (size_t)queue->capacity * queue->size;
+	int i;
+
+	if (posix_memalign((void **)&q, QUEUE_CACHE_LINE, sizeof(*q)))
+		return -1;
+	memset(q, 0, sizeof(*q));
+
+	q->slots = calloc(queue->capacity, sizeof(*q->slots));
+	if (len && posix_memalign((void **)&q->payloads, QUEUE_CACHE_LINE, len))
+		q->payloads = NULL;
+	if (!q->slots || (len && !q->payloads)) {
+		free(q->payloads);
+		free(q->slots);
+		free(q);
+		return -1;
+	}
+
+	for (i = 0; i < queue->capacity; i++)
+		q->slots[i].seq = i;
+	/* fault the ring in before the use case starts */
+	if (len)
+		memset(q->payloads, 0, len);
+
+	q->mask = queue->capacity - 1;
+	q->size = queue->size;
+	q->mpmc = queue->mpmc;
+	queue->ring = q;
+
+	return 0;
+}
+
+void queue_free(struct _rtapp_queue *queue)
+{
+	queue_ring_t *q = queue->ring;
+
+	if (!q)
+		return;
+
+	free(q->payloads);
+	free(q->slots);
+	free(q);
+	queue->ring = NULL;
+}
+
+void queue_payload_write(char *buf, int size, unsigned long val)
+{
+	memset(buf, val, size);
+}
+
+void queue_payload_read(const char *buf, int size)
+{
+	const unsigned long *p = (const unsigned long *)buf;
+	unsigned long sum = 0;
+	int i;
+
+	for (i = 0; i < size / (int)sizeof(*p); i++)
+		sum += p[i];
+	for (i *= sizeof(*p); i < size; i++)
+		sum += buf[i];
+
+	/* Prevent compiler from optimizing away the reads */
+	__asm__ __volatile__("" : : "r"(sum));
+}
+
+/*
+ * The counters of a side of the queue have a single writer unless the queue
+ * is mpmc, and are only read at the end of the use case.
+ */
+static inline void queue_add(const queue_ring_t *q, unsigned long long *c,
+			     unsigned long long v)
+{
+	if (q->mpmc)
+		__atomic_add_fetch(c, v, __ATOMIC_RELAXED);
+	else
+		*c += v;
+}
+
+static inline void queue_inc(const queue_ring_t *q, unsigned long *c)
+{
+	if (q->mpmc)
+		__atomic_add_fetch(c, 1, __ATOMIC_RELAXED);
+	else
+		(*c)++;
+}
+
+static inline void queue_max(const queue_ring_t *q, long *max, long v)
+{
+	long cur;
+
+	if (!q->mpmc) {
+		if (v > *max)
+			*max = v;
+		return;
+	}
+
+	cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+	while (v > cur &&
+	       !__atomic_compare_exchange_n(max, &cur, v, 0, __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+/*
+ * The slot had the sequence @seen when its side found the queue full or
+ * empty: poll it again or sleep until the other side bumps @word.
+ */
+static void queue_wait(queue_policy_t policy, queue_slot_t *slot,
+		       unsigned long seen, unsigned int *word,
+		       unsigned int *sleepers, int *polls)
+{
+	unsigned int v;
+
+	if (policy == queue_spin) {
+		if (!(++(*polls) % SYNC_CANCEL_POLLS))
+			pthread_testcancel();
+		cpu_relax();
+		return;
+	}
+
+	__atomic_add_fetch(sleepers, 1, __ATOMIC_SEQ_CST);
+	v = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) == seen)
+		sync_futex_wait(word, v);
+	__atomic_sub_fetch(sleepers, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * A slot has just been published: wake up the other side if it sleeps. The
+ * fence orders the publication before the read of the sleepers, which have
+ * registered before checking the slot, so that no wake up is lost.
+ */
+static inline void queue_wake(unsigned int *word, unsigned int *sleepers)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(sleepers, __ATOMIC_RELAXED)) {
+		__atomic_add_fetch(word, 1, __ATOMIC_SEQ_CST);
+		sync_futex_wake(word, INT_MAX);
+	}
+}
+
+int queue_push(queue_ring_t *q, queue_policy_t policy, const char *src)
+{
+	queue_slot_t *slot;
+	struct timespec t_now;
+	unsigned long pos, seq;
+	int polls = 0, waited = 0;
+	char *payload;
+	long diff;
+
+	pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &q->slots[pos & q->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (long)(seq - pos);
+
+		if (!diff) {
+			if (!q->mpmc) {
+				__atomic_store_n(&q->tail, pos + 1,
+						 __ATOMIC_RELAXED);
+				break;
+			}
+			if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1,
+							0, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+			continue;
+		}
+
+		if (diff < 0) {
+			/* the slot still holds the message of the last round */
+			if (policy == queue_drop) {
+				queue_inc(q, &q->drops);
+				return -1;
+			}
+			waited = 1;
+			queue_wait(policy, slot, seq, &q->not_full,
+				   &q->push_sleepers, &polls);
+		}
+		/* or another producer has taken the slot */
+		pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	}
+
+	if (q->size) {
+		payload = q->payloads + (pos & q->mask) * q->size;
+		if (src)
+			memcpy(payload, src, q->size);
+		else
+			queue_payload_write(payload, q->size, pos);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t_now);
+	slot->ts = timespec_to_nsec(&t_now);
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	queue_wake(&q->not_empty, &q->pop_sleepers);
+
+	/* the consumers can already have taken later messages */
+	diff = (long)(pos + 1 - __atomic_load_n(&q->head, __ATOMIC_RELAXED));
+	if (diff < 0)
+		diff = 0;
+	queue_inc(q, &q->pushes);
+	if (waited)
+		queue_inc(q, &q->full_waits);
+	queue_add(q, &q->depth_sum, diff);
+	queue_max(q, &q->depth_max, diff);
+
+	return 0;
+}
+
+int queue_pop(queue_ring_t *q, queue_policy_t policy, char *dst)
+{
+	queue_slot_t *slot;
+	struct timespec t_now;
+	unsigned long pos, seq;
+	int polls = 0, waited = 0;
+	char *payload;
+	long diff, lat;
+
+	pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &q->slots[pos & q->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (long)(seq - (pos + 1));
+
+		if (!diff) {
+			if (!q->mpmc) {
+				__atomic_store_n(&q->head, pos + 1,
+						 __ATOMIC_RELAXED);
+				break;
+			}
+			if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1,
+							0, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+			continue;
+		}
+
+		if (diff < 0) {
+			/* the message of this round hasn't been pushed yet */
+			if (policy == queue_drop) {
+				queue_inc(q, &q->misses);
+				return -1;
+			}
+			waited = 1;
+			queue_wait(policy, slot, seq, &q->not_empty,
+				   &q->pop_sleepers, &polls);
+		}
+		/* or another consumer has taken the message */
+		pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t_now);
+	lat = timespec_to_nsec(&t_now) - slot->ts;
+
+	if (q->size) {
+		payload = q->payloads + (pos & q->mask) * q->size;
+		if (dst)
+			memcpy(dst, payload, q->size);
+		else
+			queue_payload_read(payload, q->size);
+	}
+
+	/* free for the push of the next round */
+	__atomic_store_n(&slot->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+	queue_wake(&q->not_full, &q->push_sleepers);
+
+	queue_inc(q, &q->pops);
+	if (waited)
+		queue_inc(q, &q->empty_waits);
+	queue_add(q, &q->lat_sum, lat);
+	queue_max(q, &q->lat_max, lat);
+
+	return 0;
+}
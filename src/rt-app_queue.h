@@ -0,0 +1,100 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+
+#ifndef _RTAPP_QUEUE_H_
+#define _RTAPP_QUEUE_H_
+
+#include "rt-app_types.h"
+
+/*
+ * Bounded ring of messages with a sequence number per slot: a slot is free
+ * for the push of position pos when its sequence is pos and holds a message
+ * for the pop of position pos when its sequence is pos + 1. The producers and
+ * the consumers claim their position with a CAS when the queue is mpmc and
+ * with a plain store otherwise, and write or read the payload in the slot
+ * before publishing it. The producer and the consumer sides are on their own
+ * cache lines.
+ */
+#define QUEUE_CACHE_LINE	64
+#define QUEUE_DEFAULT_CAPACITY	64
+#define QUEUE_DEFAULT_SIZE	64
+
+typedef struct _queue_slot_t {
+	unsigned long seq;
+	__u64 ts;		/* time of the push, nsec */
+} queue_slot_t;
+
+typedef struct _queue_ring_t {
+	/* producers */
+	unsigned long tail __attribute__((aligned(QUEUE_CACHE_LINE)));
+	unsigned int not_full;		/* futex word bumped by the pops */
+	unsigned int push_sleepers;
+	unsigned long pushes;
+	unsigned long drops;		/* pushes which found the queue full */
+	unsigned long full_waits;	/* pushes which waited for a slot */
+	unsigned long long depth_sum;	/* messages queued after each push */
+	long depth_max;
+
+	/* consumers */
+	unsigned long head __attribute__((aligned(QUEUE_CACHE_LINE)));
+	unsigned int not_empty;		/* futex word bumped by the pushes */
+	unsigned int pop_sleepers;
+	unsigned long pops;
+	unsigned long misses;		/* pops which found the queue empty */
+	unsigned long empty_waits;	/* pops which waited for a message */
+	unsigned long long lat_sum;	/* time in the queue, nsec */
+	long lat_max;
+
+	/* read only */
+	queue_slot_t *slots __attribute__((aligned(QUEUE_CACHE_LINE)));
+	char *payloads;			/* capacity * size bytes */
+	unsigned long mask;
+	int size;
+	int mpmc;
+} queue_ring_t;
+
+/* Name of a policy and policy of a name, -1 if unknown */
+const char *queue_policy_name(queue_policy_t policy);
+int queue_policy_index(const char *name);
+
+/* Allocate the ring of @queue with its parameters, -1 on failure */
+int queue_init(struct _rtapp_queue *queue);
+void queue_free(struct _rtapp_queue *queue);
+
+/*
+ * Push a message, with the payload copied from @src or written in place when
+ * @src is NULL. Returns -1 if the message has been dropped.
+ */
+int queue_push(queue_ring_t *q, queue_policy_t policy, const char *src);
+
+/*
+ * Pop a message, with the payload copied to @dst or read in place when @dst
+ * is NULL. Returns -1 if no message has been received.
+ */
+int queue_pop(queue_ring_t *q, queue_policy_t policy, char *dst);
+
+/* Produce and consume the payload of a message in @buf */
+void queue_payload_write(char *buf, int size, unsigned long val);
+void queue_payload_read(const char *buf, int size);
+
+#endif /* _RTAPP_QUEUE_H_ */
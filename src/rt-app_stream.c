@@ -0,0 +1,256 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define STREAM_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "rt-app_stream.h"
+
+/* The scalar of scale and triad */
+#define STREAM_SCALAR	3.0
+
+typedef void (*stream_fn_t)(stream_kernel_t kernel, int nt, double *a,
+			    const double *b, const double *c, size_t n);
+
+typedef struct _stream_isa_t {
+	const char *name;
+	stream_fn_t fn;
+	int (*supported)(void);	/* NULL if always supported */
+} stream_isa_t;
+
+static const char *kernel_names[stream_kernels] = {
+	[stream_copy] = "copy",
+	[stream_scale] = "scale",
+	[stream_add] = "add",
+	[stream_triad] = "triad",
+};
+
+const char *stream_kernel_name(stream_kernel_t kernel)
+{
+	return kernel_names[kernel];
+}
+
+int stream_kernel_index(const char *name)
+{
+	int i;
+
+	for (i = 0; i < stream_kernels; i++)
+		if (!strcmp(name, kernel_names[i]))
+			return i;
+
+	return -1;
+}
+
+/*
+ * The 4 kernels over @n doubles with vectors of @step doubles, @n being a
+ * multiple of @step. @st is either the normal or the non-temporal store.
+ */
+#define STREAM_LOOPS(step, vec_t, set1, ld, st, add, mul) do {		\
+	vec_t q = set1(STREAM_SCALAR);					\
+	size_t i;							\
+									\
+	switch (kernel) {						\
+	case stream_copy:						\
+		for (i = 0; i < n; i += step)				\
+			st(a + i, ld(b + i));				\
+		break;							\
+	case stream_scale:						\
+		for (i = 0; i < n; i += step)				\
+			st(a + i, mul(q, ld(b + i)));			\
+		break;							\
+	case stream_add:						\
+		for (i = 0; i < n; i += step)				\
+			st(a + i, add(ld(b + i), ld(c + i)));		\
+		break;							\
+	default:							\
+		for (i = 0; i < n; i += step)				\
+			st(a + i, add(ld(b + i), mul(q, ld(c + i))));	\
+		break;							\
+	}								\
+} while (0)
+
+/* Plain C, for the architectures without vector kernels */
+#define C_SET1(x)	(x)
+#define C_LD(p)		(*(p))
+#define C_ST(p, v)	(*(p) = (v))
+#define C_ADD(x, y)	((x) + (y))
+#define C_MUL(x, y)	((x) * (y))
+
+static void stream_c(stream_kernel_t kernel, int nt, double *a,
+		     const double *b, const double *c, size_t n)
+{
+	STREAM_LOOPS(1, double, C_SET1, C_LD, C_ST, C_ADD, C_MUL);
+}
+
+#ifdef STREAM_X86
+/* 128 bits */
+static void __attribute__((target("sse2")))
+stream_sse2(stream_kernel_t kernel, int nt, double *a,
+	    const double *b, const double *c, size_t n)
+{
+	if (nt) {
+		STREAM_LOOPS(2, __m128d, _mm_set1_pd, _mm_load_pd,
+			     _mm_stream_pd, _mm_add_pd, _mm_mul_pd);
+		_mm_sfence();
+	} else {
+		STREAM_LOOPS(2, __m128d, _mm_set1_pd, _mm_load_pd,
+			     _mm_store_pd, _mm_add_pd, _mm_mul_pd);
+	}
+}
+
+static int sse2_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+/* 256 bits */
+static void __attribute__((target("avx")))
+stream_avx(stream_kernel_t kernel, int nt, double *a,
+	   const double *b, const double *c, size_t n)
+{
+	if (nt) {
+		STREAM_LOOPS(4, __m256d, _mm256_set1_pd, _mm256_load_pd,
+			     _mm256_stream_pd, _mm256_add_pd, _mm256_mul_pd);
+		_mm_sfence();
+	} else {
+		STREAM_LOOPS(4, __m256d, _mm256_set1_pd, _mm256_load_pd,
+			     _mm256_store_pd, _mm256_add_pd, _mm256_mul_pd);
+	}
+}
+
+static int avx_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx");
+}
+
+/* 512 bits, a whole cache line per load and store */
+static void __attribute__((target("avx512f")))
+stream_avx512(stream_kernel_t kernel, int nt, double *a,
+	      const double *b, const double *c, size_t n)
+{
+	if (nt) {
+		STREAM_LOOPS(8, __m512d, _mm512_set1_pd, _mm512_load_pd,
+			     _mm512_stream_pd, _mm512_add_pd, _mm512_mul_pd);
+		_mm_sfence();
+	} else {
+		STREAM_LOOPS(8, __m512d, _mm512_set1_pd, _mm512_load_pd,
+			     _mm512_store_pd, _mm512_add_pd, _mm512_mul_pd);
+	}
+}
+
+static int avx512_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+#ifdef __aarch64__
+/* 128 bits NEON, without non-temporal stores */
+static void stream_neon(stream_kernel_t kernel, int nt, double *a,
+			const double *b, const double *c, size_t n)
+{
+	STREAM_LOOPS(2, float64x2_t, vdupq_n_f64, vld1q_f64, vst1q_f64,
+		     vaddq_f64, vmulq_f64);
+}
+#endif
+
+/* By order of preference */
+static const stream_isa_t stream_isas[] = {
+#ifdef STREAM_X86
+	{ .name = "avx512",	.fn = stream_avx512,	.supported = avx512_supported },
+	{ .name = "avx",	.fn = stream_avx,	.supported = avx_supported },
+	{ .name = "sse2",	.fn = stream_sse2,	.supported = sse2_supported },
+#endif
+#ifdef __aarch64__
+	{ .name = "neon",	.fn = stream_neon },
+#endif
+	{ .name = "c",		.fn = stream_c },
+};
+
+/* Selected when the resources are parsed, before the threads start */
+static const stream_isa_t *stream_impl;
+
+static const stream_isa_t *stream_select(void)
+{
+	int i;
+
+	if (stream_impl)
+		return stream_impl;
+
+	for (i = 0; !stream_impl; i++)
+		if (!stream_isas[i].supported || stream_isas[i].supported())
+			stream_impl = &stream_isas[i];
+
+	return stream_impl;
+}
+
+const char *stream_isa(void)
+{
+	return stream_select()->name;
+}
+
+static void stream_set(double *p, size_t size, double val)
+{
+	size_t i;
+
+	for (i = 0; p && i < size / sizeof(double); i++)
+		p[i] = val;
+}
+
+void stream_fill(struct _rtapp_mem_stream_buf *stream)
+{
+	stream_set(stream->a, stream->size, 0.0);
+	stream_set(stream->b, stream->size, 1.0);
+	stream_set(stream->c, stream->size, 2.0);
+}
+
+unsigned long stream_run(struct _rtapp_mem_stream_buf *stream,
+			 unsigned long count)
+{
+	unsigned long done = 0, len;
+
+	count &= ~(unsigned long)(STREAM_ALIGN - 1);
+
+	while (count) {
+		len = count < stream->size ? count : stream->size;
+		stream_impl->fn(stream->kernel, stream->nontemporal, stream->a,
+				stream->b, stream->c, len / sizeof(double));
+		done += len;
+		count -= len;
+	}
+
+	return done * (stream->kernel >= stream_add ? 3 : 2);
+}
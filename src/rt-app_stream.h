@@ -0,0 +1,56 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+
+#ifndef _RTAPP_STREAM_H_
+#define _RTAPP_STREAM_H_
+
+#include "rt-app_types.h"
+
+/*
+ * STREAM kernels of the memrun events: copy, scale, add and triad over arrays
+ * of doubles, with the widest vector loads and stores of the CPU and
+ * optionally non-temporal stores which bypass the caches. The bytes moved
+ * are counted as in STREAM: 2 arrays for copy and scale, 3 for add and triad.
+ */
+
+/* Alignment of the arrays, the granularity of the kernels */
+#define STREAM_ALIGN	64
+
+/* Name of a kernel and kernel of a name, -1 if unknown */
+const char *stream_kernel_name(stream_kernel_t kernel);
+int stream_kernel_index(const char *name);
+
+/* Vector instructions used by the kernels, selected by the first call */
+const char *stream_isa(void);
+
+/* Initialize the arrays of @stream, allocated by the caller */
+void stream_fill(struct _rtapp_mem_stream_buf *stream);
+
+/*
+ * Run the kernel over @count bytes of each array, wrapping at the end of the
+ * arrays. Returns the bytes loaded and stored.
+ */
+unsigned long stream_run(struct _rtapp_mem_stream_buf *stream,
+			 unsigned long count);
+
+#endif /* _RTAPP_STREAM_H_ */
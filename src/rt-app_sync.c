@@ -0,0 +1,238 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "rt-app_sync.h"
+
+/* the futex waits time out to check for a cancellation of the thread */
+#define SYNC_FUTEX_TIMEOUT_NS	10000000
+
+/* futex word of a condvar: number of waiters and of wake up tokens */
+#define COND_WAITER		(1U << 16)
+#define COND_TOKENS(v)		((v) & (COND_WAITER - 1))
+#define COND_WAITERS(v)		((v) >> 16)
+
+static const char *strategy_names[sync_strategies] = {
+	[sync_block] = "block",
+	[sync_spin] = "spin",
+	[sync_spin_block] = "spin_block",
+};
+
+const char *sync_strategy_name(sync_strategy_t strategy)
+{
+	return strategy_names[strategy];
+}
+
+int sync_strategy_index(const char *name)
+{
+	int i;
+
+	for (i = 0; i < sync_strategies; i++)
+		if (!strcmp(name, strategy_names[i]))
+			return i;
+
+	return -1;
+}
+
+void sync_wait_init(sync_wait_t *sync)
+{
+	memset(sync, 0, sizeof(*sync));
+	sync->strategy = sync_block;
+	sync->spin = SYNC_DEFAULT_SPIN;
+}
+
+void sync_futex_wait(unsigned int *word, unsigned int val)
+{
+	struct timespec timeout = { 0, SYNC_FUTEX_TIMEOUT_NS };
+
+	syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, &timeout, NULL, 0);
+	pthread_testcancel();
+}
+
+void sync_futex_wake(unsigned int *word, int nr)
+{
+	syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, nr, NULL, NULL, 0);
+}
+
+/*
+ * A waiter of @sync has seen @val in its word and must wait more: poll again
+ * or, once spin_block has polled enough, sleep until the word changes.
+ * Returns 1 if it has slept.
+ */
+static int sync_poll(sync_wait_t *sync, unsigned int val, int *polls)
+{
+	if (sync->strategy == sync_spin_block && *polls >= sync->spin) {
+		sync_futex_wait(&sync->word, val);
+		return 1;
+	}
+
+	if (!(++(*polls) % SYNC_CANCEL_POLLS))
+		pthread_testcancel();
+	cpu_relax();
+
+	return 0;
+}
+
+static void sync_account(sync_wait_t *sync, int polls, int slept)
+{
+	__atomic_add_fetch(&sync->waits, 1, __ATOMIC_RELAXED);
+	if (polls)
+		__atomic_add_fetch(&sync->spins, polls, __ATOMIC_RELAXED);
+	if (slept)
+		__atomic_add_fetch(&sync->sleeps, 1, __ATOMIC_RELAXED);
+}
+
+void sync_cond_wait(struct _rtapp_cond *cond, pthread_mutex_t *m)
+{
+	sync_wait_t *sync = &cond->sync;
+	int polls = 0, slept = 0;
+	unsigned int v;
+
+	if (sync->strategy == sync_block) {
+		pthread_cond_wait(&cond->obj, m);
+		sync_account(sync, 0, 1);
+		return;
+	}
+
+	/* register as a waiter before releasing the mutex, as a condvar */
+	v = __atomic_add_fetch(&sync->word, COND_WAITER, __ATOMIC_ACQ_REL);
+	pthread_mutex_unlock(m);
+
+	for (;;) {
+		if (!COND_TOKENS(v)) {
+			slept |= sync_poll(sync, v, &polls);
+			v = __atomic_load_n(&sync->word, __ATOMIC_ACQUIRE);
+			continue;
+		}
+		/* take a token and leave the waiters */
+		if (__atomic_compare_exchange_n(&sync->word, &v,
+						v - COND_WAITER - 1, 0,
+						__ATOMIC_ACQ_REL,
+						__ATOMIC_ACQUIRE))
+			break;
+	}
+
+	pthread_mutex_lock(m);
+	sync_account(sync, polls, slept);
+}
+
+void sync_cond_signal(struct _rtapp_cond *cond, int all)
+{
+	sync_wait_t *sync = &cond->sync;
+	unsigned int v, next;
+
+	if (sync->strategy == sync_block) {
+		if (all)
+			pthread_cond_broadcast(&cond->obj);
+		else
+			pthread_cond_signal(&cond->obj);
+		return;
+	}
+
+	/* one token per waiter to wake up, a signal without waiter is lost */
+	v = __atomic_load_n(&sync->word, __ATOMIC_ACQUIRE);
+	do {
+		if (COND_TOKENS(v) >= COND_WAITERS(v))
+			return;
+		next = all ? v - COND_TOKENS(v) + COND_WAITERS(v) : v + 1;
+	} while (!__atomic_compare_exchange_n(&sync->word, &v, next, 0,
+					      __ATOMIC_ACQ_REL,
+					      __ATOMIC_ACQUIRE));
+
+	if (sync->strategy == sync_spin_block)
+		sync_futex_wake(&sync->word, all ? INT_MAX : 1);
+}
+
+void sync_barrier_wait(struct _rtapp_barrier_like *barrier)
+{
+	sync_wait_t *sync = &barrier->sync;
+	int polls = 0, slept = 0;
+	unsigned int round;
+
+	if (sync->strategy == sync_block) {
+		pthread_mutex_lock(&barrier->m_obj);
+		if (barrier->waiting == 0) {
+			/* everyone is already waiting, signal */
+			pthread_cond_broadcast(&barrier->c_obj);
+		} else {
+			/* not everyone is waiting, mark then wait */
+			barrier->waiting -= 1;
+			pthread_cond_wait(&barrier->c_obj, &barrier->m_obj);
+			barrier->waiting += 1;
+			slept = 1;
+		}
+		pthread_mutex_unlock(&barrier->m_obj);
+		sync_account(sync, 0, slept);
+		return;
+	}
+
+	/*
+	 * Sense-reversing barrier: the word is the round, which can't change
+	 * before we have arrived. The last one to arrive starts the next round.
+	 */
+	round = __atomic_load_n(&sync->word, __ATOMIC_ACQUIRE);
+	if (__atomic_add_fetch(&barrier->arrived, 1, __ATOMIC_ACQ_REL) >
+	    barrier->waiting) {
+		__atomic_store_n(&barrier->arrived, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&sync->word, round + 1, __ATOMIC_RELEASE);
+		if (sync->strategy == sync_spin_block)
+			sync_futex_wake(&sync->word, INT_MAX);
+		sync_account(sync, 0, 0);
+		return;
+	}
+
+	while (__atomic_load_n(&sync->word, __ATOMIC_ACQUIRE) == round)
+		slept |= sync_poll(sync, round, &polls);
+
+	sync_account(sync, polls, slept);
+}
+
+void sync_sem_wait(struct _rtapp_sem *sem)
+{
+	sync_wait_t *sync = &sem->sync;
+	int polls = 0, slept = 0;
+
+	while (sem_trywait(&sem->obj)) {
+		if (sync->strategy == sync_block ||
+		    (sync->strategy == sync_spin_block && polls >= sync->spin)) {
+			sem_wait(&sem->obj);
+			slept = 1;
+			break;
+		}
+
+		if (!(++polls % SYNC_CANCEL_POLLS))
+			pthread_testcancel();
+		cpu_relax();
+	}
+
+	sync_account(sync, polls, slept);
+}
@@ -0,0 +1,77 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef _RTAPP_SYNC_H_
+#define _RTAPP_SYNC_H_
+
+#include <pthread.h>
+
+#include "rt-app_types.h"
+
+/*
+ * Wait strategies of the wait, barrier and semaphore resources. "block" is
+ * the pthread condvar or the POSIX semaphore. The spin strategies poll a
+ * futex word: "spin" never sleeps and "spin_block" sleeps in the futex once
+ * it has polled the word spin times. With them, a condvar doesn't go through
+ * its mutex to wake up the waiters and a barrier is a sense-reversing barrier
+ * without any mutex.
+ */
+
+/* Default number of polls of spin_block before sleeping */
+#define SYNC_DEFAULT_SPIN	1000
+/* polls between two checks of a cancellation of the thread */
+#define SYNC_CANCEL_POLLS	1024
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/*
+ * Sleep while *@word is @val, up to a timeout after which the caller checks
+ * the word again, and check for a cancellation of the thread.
+ */
+void sync_futex_wait(unsigned int *word, unsigned int val);
+void sync_futex_wake(unsigned int *word, int nr);
+
+/* Name of a strategy and strategy of a name, -1 if unknown */
+const char *sync_strategy_name(sync_strategy_t strategy);
+int sync_strategy_index(const char *name);
+
+void sync_wait_init(sync_wait_t *sync);
+
+/* Condvar of a wait resource, @m is held as with pthread_cond_wait() */
+void sync_cond_wait(struct _rtapp_cond *cond, pthread_mutex_t *m);
+void sync_cond_signal(struct _rtapp_cond *cond, int all);
+
+/* The caller is one of the waiting + 1 users of @barrier */
+void sync_barrier_wait(struct _rtapp_barrier_like *barrier);
+
+void sync_sem_wait(struct _rtapp_sem *sem);
+
+#endif /* _RTAPP_SYNC_H_ */
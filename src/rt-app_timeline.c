@@ -0,0 +1,280 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rt-app_utils.h"
+#include "rt-app_timeline.h"
+
+void timeline_thread_init(thread_data_t *tdata, int size)
+{
+	timeline_t *tl;
+
+	tl = malloc(sizeof(*tl));
+	if (!tl) {
+		log_error("Cannot allocate timeline of %s", tdata->name);
+		exit(EXIT_FAILURE);
+	}
+	memset(tl, 0, sizeof(*tl));
+
+	tl->size = size;
+	tl->recs = malloc(size * sizeof(timeline_rec_t));
+	if (!tl->recs) {
+		log_error("Cannot allocate timeline of %s", tdata->name);
+		exit(EXIT_FAILURE);
+	}
+	/* fault the ring in now rather than in the loop of the task */
+	memset(tl->recs, 0, size * sizeof(timeline_rec_t));
+
+	tdata->timeline = tl;
+}
+
+void timeline_thread_free(thread_data_t *tdata)
+{
+	if (!tdata->timeline)
+		return;
+
+	free(tdata->timeline->recs);
+	free(tdata->timeline);
+	tdata->timeline = NULL;
+}
+
+/* Writer of the items of the traceEvents array */
+typedef struct _timeline_writer_t {
+	FILE *out;
+	int first;
+	pid_t pid;
+	uint64_t zero;		/* ns */
+} timeline_writer_t;
+
+static void tw_begin(timeline_writer_t *tw)
+{
+	fprintf(tw->out, tw->first ? "\n" : ",\n");
+	tw->first = 0;
+}
+
+static double tw_us(const timeline_writer_t *tw, uint64_t ns)
+{
+	return (double)((int64_t)(ns - tw->zero)) / 1000.0;
+}
+
+static void tw_name(timeline_writer_t *tw, const char *what, pid_t tid,
+		    const char *name)
+{
+	tw_begin(tw);
+	fprintf(tw->out, "{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+		"\"args\":{\"name\":\"%s\"}}", what, tw->pid, tid, name);
+}
+
+static void tw_slice(timeline_writer_t *tw, pid_t tid, const char *cat,
+		     const char *name, const timeline_rec_t *rec)
+{
+	tw_begin(tw);
+	fprintf(tw->out, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+		"\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+		name, cat, tw_us(tw, rec->ts), rec->dur / 1000.0, tw->pid, tid);
+	if (rec->kind == TIMELINE_LOOP || rec->kind == TIMELINE_EVENT)
+		fprintf(tw->out, ",\"args\":{\"phase\":%d,\"%s\":%d}",
+			rec->phase, rec->kind == TIMELINE_LOOP ? "loop" : "id",
+			rec->id);
+	fprintf(tw->out, "}");
+}
+
+/* One end of a flow arrow, bound to the slice which encloses @ts */
+static void tw_flow(timeline_writer_t *tw, pid_t tid, const char *ph,
+		    unsigned long id, uint64_t ts)
+{
+	tw_begin(tw);
+	fprintf(tw->out, "{\"name\":\"wakeup\",\"cat\":\"flow\",\"ph\":\"%s\","
+		"\"id\":%lu,\"ts\":%.3f,\"pid\":%d,\"tid\":%d%s}",
+		ph, id, tw_us(tw, ts), tw->pid, tid,
+		ph[0] == 'f' ? ",\"bp\":\"e\"" : "");
+}
+
+typedef struct _timeline_wake_t {
+	int32_t res;
+	uint32_t seq;
+	pid_t tid;
+	uint64_t ts;
+} timeline_wake_t;
+
+static int wake_cmp(const void *a, const void *b)
+{
+	const timeline_wake_t *wa = a, *wb = b;
+
+	if (wa->res != wb->res)
+		return wa->res < wb->res ? -1 : 1;
+	if (wa->seq != wb->seq)
+		return wa->seq < wb->seq ? -1 : 1;
+	return 0;
+}
+
+/* Index of the first kept record and number of kept records */
+static unsigned long timeline_kept(const timeline_t *tl, unsigned long *first)
+{
+	if (tl->nr > tl->size) {
+		*first = tl->nr - tl->size;
+		return tl->size;
+	}
+	*first = 0;
+	return tl->nr;
+}
+
+void timeline_write(const char *path, thread_data_t **tdata, int nr,
+		    const struct timespec *t_zero,
+		    const rtapp_resources_t *resources)
+{
+	timeline_writer_t tw;
+	timeline_wake_t *wakes = NULL, key, *w;
+	unsigned long nr_wakes = 0, max_wakes = 0, flow_id = 0;
+	unsigned long i, n, first;
+	uint64_t last;
+	char name[64];
+	int t;
+
+	tw.out = fopen(path, "w");
+	if (!tw.out) {
+		log_error("Cannot write timeline %s", path);
+		return;
+	}
+	tw.first = 1;
+	tw.pid = getpid();
+	tw.zero = t_zero->tv_sec * 1000000000ULL + t_zero->tv_nsec;
+
+	fprintf(tw.out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	tw_name(&tw, "process_name", tw.pid, "rt-app");
+
+	/* Slices, and the signals and resumes which can wake a thread */
+	for (t = 0; t < nr; t++) {
+		timeline_t *tl = tdata[t]->timeline;
+
+		if (!tl)
+			continue;
+
+		tw_name(&tw, "thread_name", tl->tid, tdata[t]->name);
+
+		last = 0;
+		n = timeline_kept(tl, &first);
+		for (i = first; i < first + n; i++) {
+			timeline_rec_t *rec = &tl->recs[i & (tl->size - 1)];
+
+			if (rec->ts + rec->dur > last)
+				last = rec->ts + rec->dur;
+
+			switch (rec->kind) {
+			case TIMELINE_PHASE:
+				snprintf(name, sizeof(name), "phase%d", rec->phase);
+				tw_slice(&tw, tl->tid, "phase", name, rec);
+				break;
+			case TIMELINE_LOOP:
+				snprintf(name, sizeof(name), "loop%d", rec->id);
+				tw_slice(&tw, tl->tid, "loop", name, rec);
+				break;
+			case TIMELINE_EVENT:
+				tw_slice(&tw, tl->tid, "event",
+					 tdata[t]->progs[rec->phase].events[rec->id].name,
+					 rec);
+				break;
+			case TIMELINE_HOLD:
+				snprintf(name, sizeof(name), "hold:%s",
+					 rec->id < resources->nresources ?
+					 resources->resources[rec->id].name : "?");
+				tw_slice(&tw, tl->tid, "lock", name, rec);
+				break;
+			}
+
+			if (!rec->flow_out)
+				continue;
+
+			if (nr_wakes == max_wakes) {
+				max_wakes = max_wakes ? 2 * max_wakes : 1024;
+				wakes = realloc(wakes, max_wakes * sizeof(*wakes));
+				if (!wakes) {
+					log_error("Cannot allocate timeline flows");
+					fclose(tw.out);
+					return;
+				}
+			}
+			wakes[nr_wakes].res = rec->res;
+			wakes[nr_wakes].seq = rec->flow_out;
+			wakes[nr_wakes].tid = tl->tid;
+			wakes[nr_wakes].ts = rec->ts + rec->dur / 2;
+			nr_wakes++;
+		}
+
+		/*
+		 * The phase was still running when the thread stopped or was
+		 * cancelled: close it with the last slice.
+		 */
+		if (tl->phase_ts && last > tl->phase_ts) {
+			timeline_rec_t rec = {
+				.ts = tl->phase_ts,
+				.dur = last - tl->phase_ts,
+				.kind = TIMELINE_PHASE,
+				.phase = tl->phase,
+			};
+
+			snprintf(name, sizeof(name), "phase%d", rec.phase);
+			tw_slice(&tw, tl->tid, "phase", name, &rec);
+		}
+	}
+
+	/* Arrows from the signal or resume to the end of the wait */
+	if (nr_wakes)
+		qsort(wakes, nr_wakes, sizeof(*wakes), wake_cmp);
+
+	for (t = 0; nr_wakes && t < nr; t++) {
+		timeline_t *tl = tdata[t]->timeline;
+
+		if (!tl)
+			continue;
+
+		n = timeline_kept(tl, &first);
+		for (i = first; i < first + n; i++) {
+			timeline_rec_t *rec = &tl->recs[i & (tl->size - 1)];
+
+			if (!rec->flow_in)
+				continue;
+
+			key.res = rec->res;
+			key.seq = rec->flow_in;
+			w = bsearch(&key, wakes, nr_wakes, sizeof(*wakes), wake_cmp);
+			if (!w || w->ts > rec->ts + rec->dur)
+				continue;
+
+			flow_id++;
+			tw_flow(&tw, w->tid, "s", flow_id, w->ts);
+			/* just before the end of the wait event */
+			tw_flow(&tw, tl->tid, "f", flow_id,
+				rec->ts + rec->dur - (rec->dur ? 1 : 0));
+		}
+	}
+
+	fprintf(tw.out, "\n]}\n");
+	fclose(tw.out);
+	free(wakes);
+
+	log_notice("timeline written in %s", path);
+}
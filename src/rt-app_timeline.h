@@ -0,0 +1,151 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef _RTAPP_TIMELINE_H_
+#define _RTAPP_TIMELINE_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "rt-app_types.h"
+
+/*
+ * Timeline of the activity of a task: phases, loops, events and lock holds
+ * are recorded as complete slices in a per-thread ring, and written in the
+ * Chrome trace event format at the end of the use case. The file can be
+ * opened by Perfetto UI or chrome://tracing and doesn't need tracefs.
+ */
+
+/* Default number of slices kept per thread */
+#define TIMELINE_DEFAULT_SIZE	65536
+/* Max number of mutexes held at the same time by a thread */
+#define TIMELINE_MAX_HELD	16
+
+enum timeline_kind {
+	TIMELINE_PHASE = 0,
+	TIMELINE_LOOP,
+	TIMELINE_EVENT,
+	TIMELINE_HOLD,
+};
+
+typedef struct _timeline_rec_t {
+	uint64_t ts;		/* start, in ns of CLOCK_MONOTONIC */
+	uint64_t dur;		/* ns */
+	uint16_t kind;		/* enum timeline_kind */
+	uint16_t phase;
+	int32_t id;		/* loop or event index, resource of a hold */
+	int32_t res;		/* resource of a flow, -1 if none */
+	uint32_t flow_out;	/* signal/resume sequence, 0 if none */
+	uint32_t flow_in;	/* sequence of the signal/resume which woke us */
+	uint32_t reserved;
+} timeline_rec_t;
+
+typedef struct _timeline_t {
+	timeline_rec_t *recs;
+	unsigned long size;	/* number of records, a power of 2 */
+	unsigned long nr;	/* records written, the last size are kept */
+	pid_t tid;
+	int phase;		/* current phase of the thread */
+	uint64_t phase_ts;	/* start of the current phase, 0 if none */
+
+	/* mutexes held: when and which */
+	uint64_t held_ts[TIMELINE_MAX_HELD];
+	int held_res[TIMELINE_MAX_HELD];
+	int nr_held;
+} timeline_t;
+
+static inline uint64_t timeline_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline timeline_rec_t *timeline_rec(timeline_t *tl, int kind,
+					   int phase, int id,
+					   uint64_t start, uint64_t end)
+{
+	timeline_rec_t *rec = &tl->recs[tl->nr++ & (tl->size - 1)];
+
+	rec->ts = start;
+	rec->dur = end - start;
+	rec->kind = kind;
+	rec->phase = phase;
+	rec->id = id;
+	rec->res = -1;
+	rec->flow_out = 0;
+	rec->flow_in = 0;
+
+	return rec;
+}
+
+/* Called by lock/unlock events to record how long the mutex is held */
+static inline void timeline_lock(timeline_t *tl, const rtapp_resource_t *rdata)
+{
+	if (tl->nr_held < TIMELINE_MAX_HELD) {
+		tl->held_ts[tl->nr_held] = timeline_now();
+		tl->held_res[tl->nr_held] = rdata->index;
+	}
+	tl->nr_held++;
+}
+
+static inline void timeline_unlock(timeline_t *tl, const rtapp_resource_t *rdata)
+{
+	int i;
+
+	if (!tl->nr_held)
+		return;
+	tl->nr_held--;
+	if (tl->nr_held >= TIMELINE_MAX_HELD)
+		return;
+
+	/* mutexes are usually released in reverse order */
+	for (i = tl->nr_held; i >= 0; i--) {
+		if (tl->held_res[i] == rdata->index)
+			break;
+	}
+	if (i < 0)
+		return;
+
+	timeline_rec(tl, TIMELINE_HOLD, tl->phase, rdata->index,
+		     tl->held_ts[i], timeline_now());
+	for (; i < tl->nr_held; i++) {
+		tl->held_ts[i] = tl->held_ts[i + 1];
+		tl->held_res[i] = tl->held_res[i + 1];
+	}
+}
+
+void timeline_thread_init(thread_data_t *tdata, int size);
+void timeline_thread_free(thread_data_t *tdata);
+
+/*
+ * Write the timelines of the @nr threads in @tdata in @path. @t_zero is the
+ * start of the use case and @resources the global resources which name the
+ * mutexes.
+ */
+void timeline_write(const char *path, thread_data_t **tdata, int nr,
+		    const struct timespec *t_zero,
+		    const rtapp_resources_t *resources);
+
+#endif /* _RTAPP_TIMELINE_H_ */
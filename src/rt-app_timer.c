@@ -0,0 +1,171 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "rt-app_utils.h"
+#include "rt-app_timer.h"
+
+/* older libc don't name the thread of SIGEV_THREAD_ID */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* signal of the POSIX timers, blocked in the threads which use them */
+#define TIMER_SIGNAL	(SIGRTMIN)
+
+static const char *backend_names[timer_backends] = {
+	[timer_nanosleep] = "nanosleep",
+	[timer_timerfd] = "timerfd",
+	[timer_signal] = "signal",
+	[timer_hybrid] = "hybrid",
+};
+
+const char *timer_backend_name(timer_backend_t backend)
+{
+	return backend_names[backend];
+}
+
+int timer_backend_index(const char *name)
+{
+	int i;
+
+	for (i = 0; i < timer_backends; i++)
+		if (!strcmp(name, backend_names[i]))
+			return i;
+
+	return -1;
+}
+
+void timer_waiter_init(timer_waiter_t *w)
+{
+	w->fd = -1;
+	w->epoll = -1;
+	w->posix_init = 0;
+}
+
+void timer_waiter_close(timer_waiter_t *w)
+{
+	if (w->fd >= 0) {
+		close(w->epoll);
+		close(w->fd);
+		w->fd = w->epoll = -1;
+	}
+	if (w->posix_init) {
+		timer_delete(w->posix);
+		w->posix_init = 0;
+	}
+}
+
+static void timerfd_wait(timer_waiter_t *w, struct timespec *t)
+{
+	struct itimerspec its = { .it_value = *t };
+	struct epoll_event ev;
+	uint64_t expirations;
+
+	if (w->fd < 0) {
+		w->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		w->epoll = epoll_create1(EPOLL_CLOEXEC);
+		ev.events = EPOLLIN;
+		ev.data.fd = w->fd;
+		if (w->fd < 0 || w->epoll < 0 ||
+		    epoll_ctl(w->epoll, EPOLL_CTL_ADD, w->fd, &ev)) {
+			perror("timerfd");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	timerfd_settime(w->fd, TFD_TIMER_ABSTIME, &its, NULL);
+	while (epoll_wait(w->epoll, &ev, 1, -1) < 0 && errno == EINTR)
+		;
+	if (read(w->fd, &expirations, sizeof(expirations)) < 0)
+		log_debug("timerfd read: %s", strerror(errno));
+}
+
+static void signal_wait(timer_waiter_t *w, struct timespec *t)
+{
+	struct itimerspec its = { .it_value = *t };
+	sigset_t set;
+
+	sigemptyset(&set);
+	sigaddset(&set, TIMER_SIGNAL);
+
+	if (!w->posix_init) {
+		struct sigevent sev;
+
+		memset(&sev, 0, sizeof(sev));
+		sev.sigev_notify = SIGEV_THREAD_ID;
+		sev.sigev_signo = TIMER_SIGNAL;
+		sev.sigev_notify_thread_id = gettid();
+
+		pthread_sigmask(SIG_BLOCK, &set, NULL);
+		if (timer_create(CLOCK_MONOTONIC, &sev, &w->posix)) {
+			perror("timer_create");
+			exit(EXIT_FAILURE);
+		}
+		w->posix_init = 1;
+	}
+
+	timer_settime(w->posix, TIMER_ABSTIME, &its, NULL);
+	while (sigwaitinfo(&set, NULL) < 0 && errno == EINTR)
+		;
+}
+
+static void hybrid_wait(struct timespec *t, int spin)
+{
+	struct timespec t_now, t_wake, t_spin = usec_to_timespec(spin);
+
+	t_wake = timespec_sub(t, &t_spin);
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t_wake, NULL);
+
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &t_now);
+	} while (timespec_lower(&t_now, t));
+}
+
+void timer_wait(timer_waiter_t *w, timer_backend_t backend,
+		struct timespec *t, int spin)
+{
+	switch (backend) {
+	case timer_timerfd:
+		timerfd_wait(w, t);
+		break;
+	case timer_signal:
+		signal_wait(w, t);
+		break;
+	case timer_hybrid:
+		hybrid_wait(t, spin);
+		break;
+	default:
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, t, NULL);
+		break;
+	}
+}
@@ -0,0 +1,51 @@
+/*
+This file is part of rt-app - https://launchpad.net/rt-app
+Copyright (C) 2010  Giacomo Bagnoli <g.bagnoli@asidev.com>
+Copyright (C) 2014  Juri Lelli <juri.lelli@gmail.com>
+Copyright (C) 2014  Vincent Guittot <vincent.guittot@linaro.org>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef _RTAPP_TIMER_H_
+#define _RTAPP_TIMER_H_
+
+#include <time.h>
+
+#include "rt-app_types.h"
+
+/*
+ * Backends of the timer event: the way a thread waits for the absolute time
+ * of the next activation. They give the wake up latency of the mechanisms
+ * used by the applications, and the hybrid one reaches shorter periods than
+ * a plain sleep by polling the clock for the last usec.
+ */
+
+/* Default usec polled by the hybrid backend before the activation */
+#define TIMER_DEFAULT_SPIN	50
+
+/* Name of a backend and backend of a name, -1 if unknown */
+const char *timer_backend_name(timer_backend_t backend);
+int timer_backend_index(const char *name);
+
+void timer_waiter_init(timer_waiter_t *w);
+void timer_waiter_close(timer_waiter_t *w);
+
+/* Wait until @t with @backend, @spin usec of polling for the hybrid one */
+void timer_wait(timer_waiter_t *w, timer_backend_t backend,
+		struct timespec *t, int spin);
+
+#endif /* _RTAPP_TIMER_H_ */
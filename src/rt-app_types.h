@@ -29,6 +29,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <time.h>
 #include <limits.h>
 #include "config.h"
 
@@ -50,11 +51,27 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #define PATH_LENGTH 256
 
+/* log_format */
+#define LOG_FORMAT_TEXT 0
+#define LOG_FORMAT_BINARY 1
+
+/* lock_pages */
+#define LOCK_PAGES_NONE 0
+#define LOCK_PAGES_THREAD 1	/* the stack and buffers used by each thread */
+#define LOCK_PAGES_PROCESS 2	/* mlockall() */
+
+/* log_size value of the logs written by the logger thread */
+#define LOG_SIZE_ASYNC -3
+
+/* max number of perf_events counters logged per loop */
+#define PMU_MAX_EVENTS 8
+
 /* exit codes */
 #define EXIT_SUCCESS 0
 #define EXIT_FAILURE 1
 #define EXIT_INV_CONFIG 2
 #define EXIT_INV_COMMANDLINE 3
+#define EXIT_DEADLINE_MISS 4
 
 /* SCHED_BATCH and SCHED_IDLE are not available if __USE_GNU is not defined */
 #ifndef __USE_GNU
@@ -101,9 +118,55 @@ typedef enum resource_t
 	rtapp_barrier,
 	rtapp_fork,
 	rtapp_sem_wait,
-	rtapp_sem_post
+	rtapp_sem_post,
+	rtapp_cputime,
+	rtapp_push,
+	rtapp_pop,
+	rtapp_mem_stream,
+	rtapp_migrate_pages
 } resource_t;
 
+/* How a thread waits on a wait, barrier or semaphore resource */
+typedef enum sync_strategy_t
+{
+	sync_block = 0,		/* pthread condvar or semaphore */
+	sync_spin,		/* poll without ever sleeping */
+	sync_spin_block,	/* poll up to spin times, then sleep in a futex */
+	sync_strategies
+} sync_strategy_t;
+
+/* Wait strategy of a resource and how its waits went */
+typedef struct _sync_wait_t {
+	sync_strategy_t strategy;
+	int spin;		/* polls before sleeping with spin_block */
+	unsigned int word;	/* futex of the spin strategies */
+	unsigned long waits;
+	unsigned long spins;	/* polls done by the spin strategies */
+	unsigned long sleeps;	/* waits which blocked in the kernel */
+} sync_wait_t;
+
+/* Wake up latency of the activations of a timer or of the waiters */
+typedef struct _lat_stats_t {
+	unsigned long wakeups;
+	unsigned long long lat_sum;	/* nsec */
+	long lat_max;			/* nsec */
+} lat_stats_t;
+
+/*
+ * Stamp of the last wake up of a wait or semaphore resource, which gives the
+ * latency between the waker and the return of each wakee. After a broadcast
+ * or a resume, the wakees are also accounted in the order they return.
+ */
+#define WAKE_LAT_RANKS	8
+
+typedef struct _wake_stamp_t {
+	unsigned int seq;	/* wake ups sent, also links them in the timeline */
+	unsigned int rank;	/* wakees returned since the last wake up */
+	__u64 ts;		/* time of the last wake up, nsec */
+	lat_stats_t lat;
+	lat_stats_t ranks[WAKE_LAT_RANKS]; /* the last one counts the next ranks too */
+} wake_stamp_t;
+
 struct _rtapp_mutex {
 		pthread_mutex_t obj;
 		pthread_mutexattr_t attr;
@@ -112,6 +175,8 @@ struct _rtapp_mutex {
 struct _rtapp_cond {
 	pthread_cond_t obj;
 	pthread_condattr_t attr;
+	wake_stamp_t wake;
+	sync_wait_t sync;
 };
 
 struct _rtapp_barrier_like {
@@ -126,42 +191,206 @@ struct _rtapp_barrier_like {
 	int waiting;
 	/* condvar to wait/signal on */
 	pthread_cond_t c_obj;
+	/* threads arrived in the current round of the spin strategies */
+	int arrived;
+	sync_wait_t sync;
 };
 
 struct _rtapp_signal {
 	pthread_cond_t *target;
 };
 
+/* What a timer does when its next activation has already passed */
+typedef enum timer_overrun_t
+{
+	timer_reset_relative = 0,	/* next period starts now */
+	timer_catch_up,			/* keep the reference, don't sleep */
+	timer_skip_to_next,		/* sleep until the next period boundary */
+	timer_abort			/* stop the use case */
+} timer_overrun_t;
+
+/* How a thread waits for the next activation of a timer */
+typedef enum timer_backend_t
+{
+	timer_nanosleep = 0,	/* clock_nanosleep(TIMER_ABSTIME) */
+	timer_timerfd,		/* timerfd in an epoll instance */
+	timer_signal,		/* POSIX timer signaling the thread */
+	timer_hybrid,		/* clock_nanosleep then poll the clock */
+	timer_backends
+} timer_backend_t;
+
+/* Per-thread objects of the timer backends, created at their first use */
+typedef struct _timer_waiter_t {
+	int fd;			/* timerfd, -1 if not created */
+	int epoll;		/* epoll instance watching fd */
+	timer_t posix;		/* POSIX timer signaling the thread */
+	int posix_init;
+} timer_waiter_t;
+
+/* Deadline misses of a timer or of a task */
+typedef struct _dmiss_stats_t {
+	unsigned long activations;
+	unsigned long misses;
+	unsigned long consecutive;
+	unsigned long max_consecutive;
+	unsigned long long overrun_sum;	/* usec */
+	long overrun_max;		/* usec */
+} dmiss_stats_t;
+
 struct _rtapp_timer {
 	struct timespec t_next;
 	int init;
 	int relative;
+	timer_overrun_t overrun;
+	timer_backend_t backend;
+	int spin;		/* usec polled by the hybrid backend */
+	dmiss_stats_t dmiss;
+	lat_stats_t lat;
 };
 
+/* Pages of the buffers of the memory resources */
+typedef enum mem_pages_t
+{
+	mem_pages_normal = 0,
+	mem_pages_thp,		/* transparent huge pages, madvise() */
+	mem_pages_hugetlb,	/* huge pages of the hugetlb pool */
+	mem_pages_kinds
+} mem_pages_t;
+
+#define MEM_NODE_ANY		-1	/* policy of the parser */
+#define MEM_NODE_FIRST_TOUCH	-2	/* initialized by its first thread */
+
+/* How the buffers of a memory resource are allocated */
+typedef struct _mem_alloc_t {
+	mem_pages_t pages;
+	int populate;		/* fault in all the pages at allocation */
+	int node;		/* node or MEM_NODE_* */
+	int touched;		/* first touch: 0 to do, 1 running, 2 done */
+} mem_alloc_t;
+
+/* Migrations of the pages of a memory resource by migrate_pages events */
+typedef struct _mem_migrate_t {
+	unsigned long count;
+	unsigned long failed;		/* migrations with pages not moved */
+	unsigned long long bytes;	/* bytes of the buffers to migrate */
+	unsigned long long moved;	/* bytes of the pages which were moved */
+	unsigned long long ns;
+	unsigned long long max_ns;
+} mem_migrate_t;
+
 struct _rtapp_iomem_buf {
 	char *ptr;
 	int size;
 };
 
+/* Order of the positions of a memrun chase */
+typedef enum chase_pattern_t
+{
+	chase_sequential = 0,
+	chase_random,		/* random cycle drawn with Sattolo's algorithm */
+	chase_bitreverse,	/* bit-reversed positions */
+	chase_patterns
+} chase_pattern_t;
+
+#define CHASE_MAX_CHAINS	16
+
 struct _rtapp_mem_chase_buf {
 	char *base;		/* aligned buffer */
 	size_t size;		/* buffer size in bytes */
+	size_t len;		/* bytes of the chain, allocated in base */
 	size_t stride;		/* bytes between pointer positions */
-	int random;		/* 1 = bit-reversed, 0 = sequential */
+	chase_pattern_t pattern;
+	int chains;		/* independent chains followed together */
+	unsigned int seed;	/* of the random pattern */
+	int tlb;		/* one position per page */
+	char *heads[CHASE_MAX_CHAINS];	/* where each chain goes on */
+};
+
+/* STREAM kernels of the memrun events */
+typedef enum stream_kernel_t
+{
+	stream_copy = 0,	/* a = b */
+	stream_scale,		/* a = q * b */
+	stream_add,		/* a = b + c */
+	stream_triad,		/* a = b + q * c */
+	stream_kernels
+} stream_kernel_t;
+
+struct _rtapp_mem_stream_buf {
+	double *a;		/* destination */
+	double *b, *c;		/* sources, c is only used by add and triad */
+	size_t size;		/* bytes of each array */
+	stream_kernel_t kernel;
+	int nontemporal;	/* stores which bypass the caches */
 };
 
 struct _rtapp_iodev {
 	int fd;
 };
 
+/*
+ * To prevent infinite loops in fork bombs, we will limit the number of
+ * permissible forks before we exit on error.
+ *
+ * This limit is per forking task/thread NOT the aggregated number of forks.
+ */
+#define FORKS_LIMIT		1024
+
+/* Time between fork events and the first loop of the forked threads */
+typedef struct _fork_stats_t {
+	unsigned long forks;
+	unsigned long pooled;	/* forks served by a parked thread */
+	__u64 lat_sum;		/* ns */
+	__u64 lat_min;
+	__u64 lat_max;
+} fork_stats_t;
+
 struct _rtapp_fork {
 	struct _thread_data_t *tdata;
 	char *ref;
 	int nforks;
+
+	/* threads created at start and parked until a fork event */
+	int pool;
+	sem_t pool_sem;		/* posted by a fork to wake up a parked thread */
+	unsigned int pool_posted; /* forks which tried the pool */
+	unsigned int pool_taken; /* parked threads woken up */
+	__u64 *pool_ts;		/* time of each fork served by the pool, ns */
+
+	fork_stats_t stats;
+};
+
+/* What a push does on a full queue and a pop on an empty one */
+typedef enum queue_policy_t
+{
+	queue_block = 0,	/* sleep in a futex until a slot or a message */
+	queue_spin,		/* poll the queue without ever sleeping */
+	queue_drop,		/* give up: the message is lost or not received */
+	queue_policies
+} queue_policy_t;
+
+/*
+ * Ring of messages shared by the push and pop events with the same name. The
+ * payloads are written in place in the ring and read there, or copied from
+ * and to a buffer of each thread with "copy".
+ */
+struct _rtapp_queue {
+	struct _queue_ring_t *ring;
+	int capacity;		/* messages, a power of 2 */
+	int size;		/* bytes of payload of each message */
+	int mpmc;		/* several producers or consumers */
+	int copy;		/* copy the payloads through the thread buffers */
+	int configured;		/* set by the first event with parameters */
+	int producers;		/* threads of the push and pop events */
+	int consumers;
+	struct _thread_data_t *last_producer; /* last task counted */
+	struct _thread_data_t *last_consumer;
 };
 
 struct _rtapp_sem {
 	sem_t obj;
+	wake_stamp_t wake;
+	sync_wait_t sync;
 };
 
 /* Shared resources */
@@ -173,14 +402,19 @@ typedef struct _rtapp_resource_t {
 		struct _rtapp_timer timer;
 		struct _rtapp_iomem_buf buf;
 		struct _rtapp_mem_chase_buf chase;
+		struct _rtapp_mem_stream_buf stream;
 		struct _rtapp_iodev dev;
 		struct _rtapp_barrier_like barrier;
 		struct _rtapp_fork fork;
 		struct _rtapp_sem sem;
+		struct _rtapp_queue queue;
 	} res;
 	int index;
 	resource_t type;
 	char *name;
+	mem_alloc_t alloc;	/* memory resources */
+	mem_migrate_t migrate;
+	int prepared;		/* PAGES_FAULTED and PAGES_LOCKED by a thread */
 } rtapp_resource_t;
 
 typedef struct _rtapp_resources_t {
@@ -188,6 +422,11 @@ typedef struct _rtapp_resources_t {
 	rtapp_resource_t resources[0];
 } rtapp_resources_t;
 
+/*
+ * Parsed description of an event. This is the "cold" part of an event: the
+ * name is only used for traces and debug, and the resources are referenced by
+ * index in tables that can still move while the configuration is parsed.
+ */
 typedef struct _event_data_t {
 	char name[48];
 	resource_t type;
@@ -195,8 +434,45 @@ typedef struct _event_data_t {
 	int dep;
 	int duration;
 	int count;
+	int kernel;	/* burn kernel of run events */
 } event_data_t;
 
+struct _event_op_t;
+struct _burn_kernel_t;
+struct _event_ctx_t;
+
+typedef int (*event_handler_t)(const struct _event_op_t *op,
+			       struct _event_ctx_t *ctx);
+
+/* The event takes or releases a mutex and must run even when stopping */
+#define EVENT_OP_LOCK	0x01
+
+/*
+ * Compiled, "hot" part of an event: the handler and the resources are
+ * resolved once when the thread is created so that executing a phase is a
+ * walk over a compact array of ops with no lookup and no switch.
+ */
+typedef struct _event_op_t {
+	event_handler_t handler;
+	struct _rtapp_resource_t *rdata;
+	struct _rtapp_resource_t *ddata;
+	struct _burn_kernel_t *kernel;
+	int duration;
+	int count;
+	int flags;
+} event_op_t;
+
+struct _ftrace_marker_t;
+
+/* Per-thread compiled program of a phase */
+typedef struct _phase_prog_t {
+	event_op_t *ops;
+	event_data_t *events;	/* cold data, same index as ops */
+	struct _ftrace_marker_t *markers; /* preformatted rtapp_event, or NULL */
+	int nbevents;
+	int phase;
+} phase_prog_t;
+
 typedef struct _cpuset_data_t {
 	cpu_set_t *cpuset;
 	char *cpuset_str;
@@ -216,6 +492,7 @@ typedef struct _sched_data_t {
 	unsigned long period;
 	int util_min;
 	int util_max;
+	int dl_overrun; /* get SIGXCPU when the runtime is exceeded */
 } sched_data_t;
 
 typedef struct _taskgroup_data_t {
@@ -237,11 +514,13 @@ typedef struct _thread_data_t {
 	int ind;
 	char *name;
 	int lock_pages;
+	int prefault; /* fault in the stack and buffers before starting */
 	int duration;
 
 	cpuset_data_t cpu_data; /* cpu set information */
 	cpuset_data_t *curr_cpu_data; /* Current cpu set being used */
 	cpuset_data_t def_cpu_data; /* Default cpu set for task */
+	int run_cpu; /* CPU used by run events if pinned on one, -1 otherwise */
 
 	numaset_data_t numa_data; /* numa bind set mask */
 	numaset_data_t *curr_numa_data; /* Current numa bind set being used */
@@ -255,14 +534,34 @@ typedef struct _thread_data_t {
 	int loop;
 	int nphases;
 	phase_data_t *phases;
+	phase_prog_t *progs; /* compiled phases, one per phase */
+	int progs_shared; /* progs and local_resources belong to the task */
 
 	struct timespec main_app_start;
 
 	FILE *log_handler;
+	struct _binlog_t *binlog; /* binary log, NULL if text log */
+	struct _log_ring_t *log_ring; /* ring drained by the logger thread */
+	struct _hist_t *hists; /* histograms of each metric of each phase */
+	struct _timeline_t *timeline; /* slices exported at the end, or NULL */
+
+	dmiss_stats_t dmiss; /* timer activations missed by the task */
+	long minflt, majflt; /* page faults while running the phases */
+	long start_skew; /* ns between the start of the use case and ours */
+	timer_waiter_t timer_waiter;
+	long timer_slack; /* PR_SET_TIMERSLACK in ns, -1 to keep it */
+	char *payload; /* copies of the payloads of the copy queues */
+	int payload_size;
+	volatile unsigned long dl_overruns; /* SIGXCPU received */
 
 	unsigned long delay;
+	size_t stack_size; /* bytes, 0 for the default of the system */
+	size_t stack_lock; /* bytes of the default stack locked, at its top */
 
 	int forked;
+	struct _rtapp_resource_t *fork_res; /* fork event which created us */
+	int fork_pooled; /* parked until a fork event wakes us up */
+	__u64 fork_ts; /* time of the fork event, ns, 0 once started */
 	int num_instances;
 
 	rtapp_resources_t *local_resources;
@@ -272,12 +571,14 @@ typedef struct _thread_data_t {
 typedef struct _pthread_data_t {
 	thread_data_t *data;
 	pthread_t thread;
+	int joined;
 } pthread_data_t;
 
 typedef struct _ftrace_data_t {
 	char *tracefs;
 	int trace_fd;
 	int marker_fd;
+	int raw_fd;	/* trace_marker_raw, -1 unless binary ftrace_format */
 } ftrace_data_t;
 
 typedef struct _log_data_t {
@@ -287,33 +588,80 @@ typedef struct _log_data_t {
 	unsigned long c_duration;
 	unsigned long c_period;
 	long slack;
+	long overshoot;
+	unsigned long long mem_bytes;	/* moved by the memrun STREAM kernels */
+	unsigned long long mem_ns;
+	unsigned long long chase_hops;	/* pointers followed by memrun chase */
+	unsigned long long chase_ns;
 } log_data_t;
 
+/* State shared by the handlers of the events of a phase */
+typedef struct _event_ctx_t {
+	thread_data_t *tdata;
+	struct timespec *t_first;
+	log_data_t *ldata;
+	unsigned long perf;
+	int marker_fd;
+	int raw_fd;
+	struct _timeline_t *timeline;
+	unsigned int flow_out;	/* set by a signal which can wake a thread */
+	unsigned int flow_in;	/* set by a wait, the signal which woke us */
+} event_ctx_t;
+
 typedef struct _rtapp_options_t {
 	int lock_pages;
+	int prefault; /* default of the tasks */
+	size_t stack_size; /* default of the tasks */
+	size_t stack_lock; /* default of the tasks */
+	int startup_threads; /* threads creating the tasks, 0 for auto */
 
 	thread_data_t *threads_data;
 	int nthreads;
 	int num_tasks;
 
 	policy_t policy;
-	int duration;
+	double duration; /* in sec from the start of the use case, <= 0 never */
+	int start_margin; /* usec between the creation of the threads and start */
+	int start_spin; /* usec spent polling the clock before the start */
+	int graceful_stop; /* msec to finish the current loops when stopping */
 
 	char *logdir;
 	char *logbasename;
 	int logsize;
+	int log_format;
+	int log_shared; /* one text log for all the threads */
+	int ftrace_format;
+	int logger_prio;
+	cpuset_data_t logger_cpu_data;
+	int logger_ring;
+	int logger_period;
 	int gnuplot;
 	int calib_cpu;
 	int calib_ns_per_loop;
+	int capacity_normalized;
+	char *calib_cache;
+	double calib_ci;
+	int calib_budget;
 
 	rtapp_resources_t *resources;
 	int pi_enabled;
 
-	int die_on_dmiss;
+	int die_on_dmiss; /* consecutive misses which stop rt-app, 0 never */
 	int mem_buffer_size;
+	mem_alloc_t mem_alloc; /* default of the memory resources */
 	char *io_device;
 
 	int cumulative_slack;
+
+	int histogram;
+	int hist_interval; /* period of the summary dump in sec, 0 for none */
+
+	int timeline; /* slices kept per thread for the timeline, 0 for none */
+
+	int pmu_events; /* mask of the perf_events counters */
+
+	long numa_matrix; /* bytes of the buffers of the NUMA matrix, 0 for none */
+	int numa_matrix_count; /* accesses of the latency measurements */
 } rtapp_options_t;
 
 typedef struct _timing_point_t {
@@ -325,6 +673,10 @@ typedef struct _timing_point_t {
 	unsigned long c_period;
 	unsigned long wu_latency;
 	long slack;
+	long overshoot;
+	unsigned long mem_bw;	/* MB/s of the memrun STREAM kernels */
+	unsigned long chase_lat;	/* ns per access of memrun chase */
+	__u64 pmu[PMU_MAX_EVENTS];
 	__u64 start_time;
 	__u64 end_time;
 	__u64 rel_start_time;
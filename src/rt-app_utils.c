@@ -27,6 +27,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <math.h>
 #include <stdarg.h>
 #include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
 #include <sys/syscall.h>
 
 #include "rt-app_utils.h"
@@ -146,10 +148,12 @@ timespec_sub_to_ns(struct timespec *t1, struct timespec *t2)
 
 
 void
-log_timing(FILE *handler, timing_point_t *t)
+log_timing(FILE *handler, timing_point_t *t, int nr_pmu)
 {
+	int i;
+
 	fprintf(handler,
-		"%4d %8lu %8lu %8lu %15llu %15llu %15llu %10ld %10lu %10lu %10lu",
+		"%4d %8lu %8lu %8lu %15llu %15llu %15llu %10ld %10lu %10lu %10lu %10ld %10lu %10lu",
 		t->ind,
 		t->perf,
 		t->duration,
@@ -160,8 +164,13 @@ log_timing(FILE *handler, timing_point_t *t)
 		t->slack,
 		t->c_duration,
 		t->c_period,
-		t->wu_latency
+		t->wu_latency,
+		t->overshoot,
+		t->mem_bw,
+		t->chase_lat
 	);
+	for (i = 0; i < nr_pmu; i++)
+		fprintf(handler, " %14llu", t->pmu[i]);
 	fprintf(handler, "\n");
 }
 
@@ -300,55 +309,56 @@ int ftrace_setup(char *categories)
 	return 0;
 }
 
-void ftrace_write(int mark_fd, const char *fmt, ...)
+/*
+ * Each thread formats its markers in its own buffer so that tracing never
+ * allocates memory. Longer markers are truncated.
+ */
+static __thread char ftrace_buf[FTRACE_BUF_SIZE];
+
+void thread_attr_block_signals(pthread_attr_t *attr)
 {
-	va_list ap;
-	int n, size = BUF_SIZE, ret;
-	char *tmp, *ntmp;
+	sigset_t sigset;
+
+	/* the shutdown signals are handled by the main thread */
+	sigemptyset(&sigset);
+	sigaddset(&sigset, SIGQUIT);
+	sigaddset(&sigset, SIGTERM);
+	sigaddset(&sigset, SIGHUP);
+	sigaddset(&sigset, SIGINT);
+	pthread_attr_setsigmask_np(attr, &sigset);
+}
+
+void ftrace_write_buf(int mark_fd, const void *buf, int len)
+{
+	int ret;
 
 	if (mark_fd < 0) {
 		log_error("invalid mark_fd");
 		exit(EXIT_FAILURE);
 	}
 
-	if ((tmp = malloc(size)) == NULL) {
-		log_error("Cannot allocate ftrace buffer");
+	ret = write(mark_fd, buf, len);
+	if (ret < 0) {
+		log_error("Cannot write mark_fd: %s\n", strerror(errno));
 		exit(EXIT_FAILURE);
+	} else if (ret < len) {
+		log_debug("Cannot write all bytes at once into mark_fd\n");
 	}
+}
 
-	while(1) {
-		/* Try to print in the allocated space */
-		va_start(ap, fmt);
-		n = vsnprintf(tmp, BUF_SIZE, fmt, ap);
-		va_end(ap);
-
-		/* If it worked return success */
-		if (n > -1 && n < size) {
-			ret = write(mark_fd, tmp, n);
-			free(tmp);
-			if (ret < 0) {
-				log_error("Cannot write mark_fd: %s\n",
-						strerror(errno));
-				exit(EXIT_FAILURE);
-			} else if (ret < n) {
-				log_debug("Cannot write all bytes at once into mark_fd\n");
-			}
-			return;
-		}
-
-		/* Else try again with more space */
-		if (n > -1)	/* glibc 2.1 */
-			size = n+1;
-		else		/* glibc 2.0 */
-			size *= 2;
-
-		if ((ntmp = realloc(tmp, size)) == NULL) {
-			free(tmp);
-			log_error("Cannot reallocate ftrace buffer");
-			exit(EXIT_FAILURE);
-		} else {
-			tmp = ntmp;
-		}
-	}
+void ftrace_write(int mark_fd, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(ftrace_buf, sizeof(ftrace_buf), fmt, ap);
+	va_end(ap);
+
+	if (n < 0)
+		return;
+	if (n >= sizeof(ftrace_buf))
+		n = sizeof(ftrace_buf) - 1;
 
+	ftrace_write_buf(mark_fd, ftrace_buf, n);
 }
@@ -38,7 +38,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define LOG_LEVEL_ERROR 10
 #define LOG_LEVEL_CRITICAL 10
 
-#define BUF_SIZE 100
+#define FTRACE_BUF_SIZE 512
 
 extern int log_level;
 extern int ftrace_level;
@@ -121,7 +121,7 @@ int64_t
 timespec_sub_to_ns(struct timespec *t1, struct timespec *t2);
 
 void
-log_timing(FILE *handler, timing_point_t *t);
+log_timing(FILE *handler, timing_point_t *t, int nr_pmu);
 
 pid_t
 gettid(void);
@@ -147,6 +147,13 @@ ftrace_setup(char *categories);
 void
 ftrace_write(int mark_fd, const char *fmt, ...);
 
+void
+ftrace_write_buf(int mark_fd, const void *buf, int len);
+
+/* Block in the threads created with @attr the signals of the main thread */
+void
+thread_attr_block_signals(pthread_attr_t *attr);
+
 #endif // _TIMESPEC_UTILS_H_
 
 /* vim: set ts=8 noexpandtab shiftwidth=8: */